@@ -4,7 +4,9 @@
 // You may do anything with this. It has no warranty.
 // <http://creativecommons.org/publicdomain/zero/1.0/>
 
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -54,3 +56,57 @@ Tnxt(Tbl *tbl, const char *key) {
 	Tnext(tbl, &key, &value);
 	return(key);
 }
+
+// Append to a string like snprintf(), keeping track of the length
+// needed even if it does not fit.
+//
+typedef struct Str {
+	char *buf;
+	size_t size, len;
+} Str;
+
+static void
+append(Str *s, const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	size_t room = s->len < s->size ? s->size - s->len : 0;
+	int n = vsnprintf(room > 0 ? s->buf + s->len : NULL, room, fmt, ap);
+	va_end(ap);
+	if(n > 0)
+		s->len += (size_t)n;
+}
+
+// Omit the zeroes at the end of a histogram.
+//
+static void
+histogram(Str *s, const char *name, const size_t *h, size_t n) {
+	while(n > 0 && h[n - 1] == 0)
+		n--;
+	append(s, ",\"%s\":[", name);
+	for(size_t i = 0; i < n; i++)
+		append(s, i == 0 ? "%zu" : ",%zu", h[i]);
+	append(s, "]");
+}
+
+size_t
+Tstatjson(const Tstats *st, char *buf, size_t size) {
+	Str s = { buf, size, 0 };
+	size_t depth = 0;
+	for(size_t i = 0; i < TSTAT_DEPTH; i++)
+		depth += i * st->depth[i];
+	append(&s, "{\"type\":\"%s\",\"complete\":%s,"
+	       "\"leaves\":%zu,\"branches\":%zu,\"twigs\":%zu,"
+	       "\"roots\":%zu,\"mean_depth\":%.3f,\"mean_fanout\":%.3f",
+	       st->type == NULL ? "" : st->type,
+	       st->complete ? "true" : "false",
+	       st->leaves, st->branches, st->twigs, st->roots,
+	       st->leaves == 0 ? 0.0 : (double)depth / (double)st->leaves,
+	       st->branches == 0 ? 0.0 :
+	       (double)st->twigs / (double)st->branches);
+	histogram(&s, "depth", st->depth, TSTAT_DEPTH);
+	histogram(&s, "fanout", st->fanout, TSTAT_FANOUT);
+	histogram(&s, "position", st->position, TSTAT_POSITION);
+	histogram(&s, "position_twigs", st->postwigs, TSTAT_POSITION);
+	append(&s, "}");
+	return(s.len);
+}
@@ -53,6 +53,116 @@ bool Tnextl(Tbl *tbl, const char **pkey, size_t *pklen, void **pvalue);
 bool Tnext(Tbl *tbl, const char **pkey, void **pvalue);
 const char *Tnxt(Tbl *tbl, const char *key);
 
+// Longest prefix match. (Only the DNS-trie supports this.)
+//
+// Find the longest key in the table that is a prefix of (or equal to)
+// the search key, in one descent of the trie.
+//
+bool Tgetprefix(Tbl *tbl, const char *key, size_t klen, const char **rkey, void **rval);
+
+// Copy-on-write transactions. (Only the DNS-trie supports these, and
+// tables compiled WITH_SNAPSHOTS, for which txn.c implements them.)
+//
+// A transaction makes a batch of changes to a table without disturbing
+// readers of the original table, which can run concurrently. Tbegin()
+// returns a new transaction on the table, which may be NULL, or it
+// returns NULL if allocation failed. The Tx...() functions are like
+// their table counterparts, except that they return false and set errno
+// if there is an error. Even if a change fails, the transaction can
+// still be committed or aborted.
+//
+// Tcommit() returns the new version of the table, which replaces the
+// original. The memory that was replaced remains valid until the
+// transaction is passed to Treclaim(), which you must not do until all
+// readers of the original table have finished. Tabort() discards the
+// transaction's changes and frees it immediately; the original table
+// remains current.
+//
+typedef struct Ttxn Ttxn;
+
+Ttxn *Tbegin(Tbl *tbl);
+bool Txgetkv(Ttxn *txn, const char *key, size_t klen, const char **rkey, void **rval);
+bool Txsetl(Ttxn *txn, const char *key, size_t klen, void *value);
+bool Txdelkv(Ttxn *txn, const char *key, size_t klen, const char **rkey, void **rval);
+Tbl *Tcommit(Ttxn *txn);
+void Tabort(Ttxn *txn);
+void Treclaim(Ttxn *txn);
+
+// Concurrent updates. (Only the concurrent HAMT supports these.)
+//
+// Any number of threads can call Tgetkv() and Tsetl() with a non-NULL
+// value at the same time on the same non-empty table, and Tsetl() then
+// returns the same table pointer. Deletion must not run at the same
+// time as anything else. The memory that concurrent changes replace
+// remains valid until Tcollect() frees it, which you must not do while
+// other threads are using the table.
+//
+void Tcollect(Tbl *tbl);
+
+// Optimistic readers. (Only qp compiled WITH_SEQLOCK supports this.)
+//
+// Any number of threads can call Tgetkv() and Tnextl() without locking
+// while one other thread changes the table; a reader quietly retries if
+// a change overlapped it. The table pointer stays the same until the
+// last key is deleted, which must not happen while there are readers.
+// The memory that changes replace remains valid until Tcollect(), as
+// above, and so must the keys and values that were deleted.
+
+// Snapshots. (Only qp, fn, and the DNS-trie compiled WITH_SNAPSHOTS
+// support these.)
+//
+// Tsnapshot() returns a copy of the table in constant time, or NULL if
+// the table is empty or allocation failed. The copies share their
+// memory until one of them changes, after which they are independent,
+// and each must eventually be passed to Trelease(). Taking a snapshot
+// must not overlap changes to the table, but once taken, a snapshot
+// can be read and released by another thread while the table changes.
+// The keys and values deleted from one copy must remain valid until
+// the other copies that contain them are released.
+//
+Tbl *Tsnapshot(Tbl *tbl);
+void Trelease(Tbl *tbl);
+
+// Structural statistics. (Only qp and the DNS-trie support these.)
+//
+// Tstat() walks the trie a bit at a time, so that it does not stall a
+// thread that is also serving queries. Each call visits about `budget`
+// nodes (and then enough more to reach a leaf) and returns true if
+// there is more to do. Start with a zeroed Tstats, and call Tstat()
+// until it returns false; st->complete is then true, unless copying
+// the cursor failed, in which case errno is set. The cursor is a copy
+// of the last key visited, so the table can be changed between calls,
+// though the statistics will then be approximate. If you abandon a
+// walk before it is complete, free(st->cursor).
+//
+// A branch's key position counts nibbles in qp and bytes in the
+// DNS-trie. The depth of a leaf is the number of branches above it.
+// There is one root, unless qp has a jump table, which has a subtrie
+// in each occupied slot; every other node is a twig of one branch.
+// The last element of each histogram counts everything bigger.
+//
+// Tstatjson() writes a JSON summary of the statistics into buf, and
+// like snprintf() it returns the length that the summary needs.
+//
+#define TSTAT_DEPTH 64
+#define TSTAT_FANOUT 64
+#define TSTAT_POSITION 512
+
+typedef struct Tstats {
+	const char *type;
+	bool complete;
+	char *cursor;
+	size_t cursorlen;
+	size_t leaves, branches, twigs, roots;
+	size_t depth[TSTAT_DEPTH];		// leaves at each depth
+	size_t fanout[TSTAT_FANOUT];		// branches with each twig count
+	size_t position[TSTAT_POSITION];	// branches at each key position
+	size_t postwigs[TSTAT_POSITION];	// their twigs
+} Tstats;
+
+bool Tstat(Tbl *tbl, Tstats *st, size_t budget);
+size_t Tstatjson(const Tstats *st, char *buf, size_t size);
+
 // Debugging
 //
 void Tdump(Tbl *tbl);
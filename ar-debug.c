@@ -0,0 +1,137 @@
+// ar-debug.c: adaptive radix tree debug support
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Tbl.h"
+#include "ar.h"
+
+static const char *const typename[] = {
+	"node4", "node16", "node48", "node256"
+};
+
+static void
+dump_rec(void *p, size_t depth) {
+	if(isleaf(p)) {
+		Leaf *l = leaf(p);
+		printf("Tdump%*s leaf %p\n", (int)depth, "", l);
+		printf("Tdump%*s leaf key %p %s\n", (int)depth, "",
+		       l->key, l->key);
+		printf("Tdump%*s leaf val %p\n", (int)depth, "", l->val);
+		return;
+	}
+	Node *n = p;
+	printf("Tdump%*s %s %p count %u prefix %u \"%.*s\"\n",
+	       (int)depth, "", typename[n->type], n, n->count,
+	       n->prefixlen, (int)prefixmin(n), n->prefix);
+	depth += n->prefixlen;
+	uint count = 0;
+	for(uint c = 0; c < 256; c++) {
+		// Deliberately avoid the SIMD search so it gets checked.
+		void *child = NULL;
+		switch(n->type) {
+		case(NODE4):
+		case(NODE16): {
+			byte *key = n->type == NODE4
+				? ((Node4 *)n)->key : ((Node16 *)n)->key;
+			void **kids = n->type == NODE4
+				? ((Node4 *)n)->child : ((Node16 *)n)->child;
+			for(uint i = 0; i < n->count; i++)
+				if(key[i] == c)
+					child = kids[i];
+			break;
+		}
+		case(NODE48): {
+			Node48 *n48 = (Node48 *)n;
+			if(n48->index[c] != 0)
+				child = n48->child[n48->index[c] - 1];
+			break;
+		}
+		case(NODE256):
+			child = ((Node256 *)n)->child[c];
+			break;
+		}
+		if(child == NULL)
+			continue;
+		count++;
+		printf("Tdump%*s child %02x depth %zu\n",
+		       (int)depth, "", c, depth);
+		dump_rec(child, depth + 1);
+	}
+	assert(count == n->count);
+	assert(count >= 2);
+}
+
+void
+Tdump(Tbl *tbl) {
+	printf("Tdump root %p\n", tbl);
+	if(tbl != NULL)
+		dump_rec(tbl->root, 0);
+}
+
+static void
+size_rec(void *p, size_t depth, size_t *rsize,
+	 size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	if(isleaf(p)) {
+		*rsize += sizeof(Leaf);
+		*rdepth += depth;
+		*rleaves += 1;
+		return;
+	}
+	Node *n = p;
+	*rbranches += 1;
+	switch(n->type) {
+	case(NODE4): {
+		Node4 *n4 = (Node4 *)n;
+		*rsize += sizeof(*n4);
+		for(uint i = 0; i < n->count; i++)
+			size_rec(n4->child[i], depth + 1,
+				 rsize, rdepth, rbranches, rleaves);
+		return;
+	}
+	case(NODE16): {
+		Node16 *n16 = (Node16 *)n;
+		*rsize += sizeof(*n16);
+		for(uint i = 0; i < n->count; i++)
+			size_rec(n16->child[i], depth + 1,
+				 rsize, rdepth, rbranches, rleaves);
+		return;
+	}
+	case(NODE48): {
+		Node48 *n48 = (Node48 *)n;
+		*rsize += sizeof(*n48);
+		for(uint i = 0; i < 48; i++)
+			if(n48->child[i] != NULL)
+				size_rec(n48->child[i], depth + 1,
+					 rsize, rdepth, rbranches, rleaves);
+		return;
+	}
+	case(NODE256): {
+		Node256 *n256 = (Node256 *)n;
+		*rsize += sizeof(*n256);
+		for(uint c = 0; c < 256; c++)
+			if(n256->child[c] != NULL)
+				size_rec(n256->child[c], depth + 1,
+					 rsize, rdepth, rbranches, rleaves);
+		return;
+	}
+	}
+}
+
+void
+Tsize(Tbl *tbl, const char **rtype,
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	*rtype = "ar";
+	*rsize = *rdepth = *rbranches = *rleaves = 0;
+	if(tbl == NULL)
+		return;
+	*rsize = sizeof(*tbl);
+	size_rec(tbl->root, 0, rsize, rdepth, rbranches, rleaves);
+}
@@ -0,0 +1,562 @@
+// ar.c: tables implemented with adaptive radix trees.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Tbl.h"
+#include "ar.h"
+
+// Returns a pointer to the child slot for byte c, or NULL.
+//
+static void **
+findchild(Node *n, byte c) {
+	switch(n->type) {
+	case(NODE4): {
+		Node4 *n4 = (Node4 *)n;
+		for(uint i = 0; i < n->count; i++)
+			if(n4->key[i] == c)
+				return(&n4->child[i]);
+		return(NULL);
+	}
+	case(NODE16): {
+		Node16 *n16 = (Node16 *)n;
+#ifdef __SSE2__
+		__m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+				_mm_loadu_si128((const __m128i *)n16->key));
+		uint mask = (uint)_mm_movemask_epi8(cmp) &
+			((1U << n->count) - 1);
+		if(mask != 0)
+			return(&n16->child[__builtin_ctz(mask)]);
+#else
+		for(uint i = 0; i < n->count; i++)
+			if(n16->key[i] == c)
+				return(&n16->child[i]);
+#endif
+		return(NULL);
+	}
+	case(NODE48): {
+		Node48 *n48 = (Node48 *)n;
+		if(n48->index[c] == 0)
+			return(NULL);
+		return(&n48->child[n48->index[c] - 1]);
+	}
+	case(NODE256): {
+		Node256 *n256 = (Node256 *)n;
+		if(n256->child[c] == NULL)
+			return(NULL);
+		return(&n256->child[c]);
+	}
+	}
+	abort();
+}
+
+// The leaf with the smallest key below p.
+//
+static Leaf *
+minleaf(void *p) {
+	while(!isleaf(p)) {
+		Node *n = p;
+		switch(n->type) {
+		case(NODE4):
+			p = ((Node4 *)n)->child[0];
+			break;
+		case(NODE16):
+			p = ((Node16 *)n)->child[0];
+			break;
+		case(NODE48): {
+			Node48 *n48 = (Node48 *)n;
+			uint c = 0;
+			while(n48->index[c] == 0)
+				c++;
+			p = n48->child[n48->index[c] - 1];
+			break;
+		}
+		case(NODE256): {
+			Node256 *n256 = (Node256 *)n;
+			uint c = 0;
+			while(n256->child[c] == NULL)
+				c++;
+			p = n256->child[c];
+			break;
+		}
+		}
+	}
+	return(leaf(p));
+}
+
+// How many bytes of the node's prefix match the key? This only checks
+// the bytes that are stored in the node, and the search checks the
+// rest when it compares the whole key with the leaf.
+//
+static uint
+prefix_check(Node *n, const char *key, size_t len, size_t depth) {
+	uint i, max = prefixmin(n);
+	for(i = 0; i < max; i++)
+		if(n->prefix[i] != keyat(key, len, depth + i))
+			break;
+	return(i);
+}
+
+// As above, but check the whole prefix, using a leaf for the bytes
+// that are not stored in the node.
+//
+static uint
+prefix_mismatch(Node *n, const char *key, size_t len, size_t depth) {
+	uint i = prefix_check(n, key, len, depth);
+	if(i < MAXPREFIX || n->prefixlen <= MAXPREFIX)
+		return(i);
+	Leaf *l = minleaf(n);
+	size_t llen = strlen(l->key);
+	for(; i < n->prefixlen; i++)
+		if(keyat(l->key, llen, depth + i) != keyat(key, len, depth + i))
+			break;
+	return(i);
+}
+
+bool
+Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(false);
+	void *p = tbl->root;
+	size_t depth = 0;
+	while(!isleaf(p)) {
+		Node *n = p;
+		if(n->prefixlen != 0) {
+			if(prefix_check(n, key, len, depth) != prefixmin(n))
+				return(false);
+			depth += n->prefixlen;
+		}
+		void **child = findchild(n, keyat(key, len, depth));
+		if(child == NULL)
+			return(false);
+		p = *child;
+		depth += 1;
+	}
+	Leaf *l = leaf(p);
+	if(strcmp(key, l->key) != 0)
+		return(false);
+	*pkey = l->key;
+	*pval = l->val;
+	return(true);
+}
+
+static bool
+next_rec(void *p, size_t depth, const char **pkey, size_t *plen, void **pval) {
+	if(isleaf(p)) {
+		Leaf *l = leaf(p);
+		// We have found the next leaf.
+		if(*pkey == NULL) {
+			*pkey = l->key;
+			*plen = strlen(*pkey);
+			*pval = l->val;
+			return(true);
+		}
+		// We have found this leaf, so start looking for the next one.
+		if(strcmp(*pkey, l->key) == 0) {
+			*pkey = NULL;
+			*plen = 0;
+		}
+		return(false);
+	}
+	// Recurse to find either this leaf (*pkey != NULL)
+	// or the next one (*pkey == NULL).
+	Node *n = p;
+	depth += n->prefixlen;
+	uint c = *pkey == NULL ? 0 : keyat(*pkey, *plen, depth);
+	switch(n->type) {
+	case(NODE4):
+	case(NODE16): {
+		byte *key = n->type == NODE4
+			? ((Node4 *)n)->key : ((Node16 *)n)->key;
+		void **child = n->type == NODE4
+			? ((Node4 *)n)->child : ((Node16 *)n)->child;
+		for(uint i = 0; i < n->count; i++)
+			if(key[i] >= c &&
+			   next_rec(child[i], depth + 1, pkey, plen, pval))
+				return(true);
+		return(false);
+	}
+	case(NODE48): {
+		Node48 *n48 = (Node48 *)n;
+		for(; c < 256; c++)
+			if(n48->index[c] != 0 &&
+			   next_rec(n48->child[n48->index[c] - 1],
+				    depth + 1, pkey, plen, pval))
+				return(true);
+		return(false);
+	}
+	case(NODE256): {
+		Node256 *n256 = (Node256 *)n;
+		for(; c < 256; c++)
+			if(n256->child[c] != NULL &&
+			   next_rec(n256->child[c], depth + 1, pkey, plen, pval))
+				return(true);
+		return(false);
+	}
+	}
+	abort();
+}
+
+bool
+Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
+	if(tbl == NULL) {
+		*pkey = NULL;
+		*plen = 0;
+		return(false);
+	}
+	return(next_rec(tbl->root, 0, pkey, plen, pval));
+}
+
+static Node *
+newnode(byte type, size_t size) {
+	Node *n = calloc(1, size);
+	if(n != NULL)
+		n->type = type;
+	return(n);
+}
+
+static void
+copyheader(Node *to, Node *from) {
+	to->count = from->count;
+	to->prefixlen = from->prefixlen;
+	memcpy(to->prefix, from->prefix, MAXPREFIX);
+}
+
+// Insert a child into a sorted Node4 or Node16 that has room.
+//
+static void
+addsorted(byte *key, void **child, uint count, byte c, void *p) {
+	uint i = 0;
+	while(i < count && key[i] < c)
+		i++;
+	memmove(key + i + 1, key + i, count - i);
+	memmove(child + i + 1, child + i, sizeof(*child) * (count - i));
+	key[i] = c;
+	child[i] = p;
+}
+
+// Add a child to a node, replacing the node at *ref with a bigger one
+// if it is full.
+//
+static bool
+addchild(void **ref, Node *n, byte c, void *p) {
+	switch(n->type) {
+	case(NODE4): {
+		Node4 *n4 = (Node4 *)n;
+		if(n->count < 4) {
+			addsorted(n4->key, n4->child, n->count++, c, p);
+			return(true);
+		}
+		Node16 *n16 = (Node16 *)newnode(NODE16, sizeof(*n16));
+		if(n16 == NULL)
+			return(false);
+		copyheader(&n16->n, n);
+		memcpy(n16->key, n4->key, 4);
+		memcpy(n16->child, n4->child, sizeof(n4->child));
+		addsorted(n16->key, n16->child, n16->n.count++, c, p);
+		*ref = n16;
+		free(n4);
+		return(true);
+	}
+	case(NODE16): {
+		Node16 *n16 = (Node16 *)n;
+		if(n->count < 16) {
+			addsorted(n16->key, n16->child, n->count++, c, p);
+			return(true);
+		}
+		Node48 *n48 = (Node48 *)newnode(NODE48, sizeof(*n48));
+		if(n48 == NULL)
+			return(false);
+		copyheader(&n48->n, n);
+		memcpy(n48->child, n16->child, sizeof(n16->child));
+		for(uint i = 0; i < 16; i++)
+			n48->index[n16->key[i]] = (byte)(i + 1);
+		n48->index[c] = 17;
+		n48->child[16] = p;
+		n48->n.count++;
+		*ref = n48;
+		free(n16);
+		return(true);
+	}
+	case(NODE48): {
+		Node48 *n48 = (Node48 *)n;
+		if(n->count < 48) {
+			uint i = 0;
+			while(n48->child[i] != NULL)
+				i++;
+			n48->index[c] = (byte)(i + 1);
+			n48->child[i] = p;
+			n->count++;
+			return(true);
+		}
+		Node256 *n256 = (Node256 *)newnode(NODE256, sizeof(*n256));
+		if(n256 == NULL)
+			return(false);
+		copyheader(&n256->n, n);
+		for(uint b = 0; b < 256; b++)
+			if(n48->index[b] != 0)
+				n256->child[b] = n48->child[n48->index[b] - 1];
+		n256->child[c] = p;
+		n256->n.count++;
+		*ref = n256;
+		free(n48);
+		return(true);
+	}
+	case(NODE256): {
+		Node256 *n256 = (Node256 *)n;
+		n256->child[c] = p;
+		n->count++;
+		return(true);
+	}
+	}
+	abort();
+}
+
+// Remove the child at *slot (for byte c) from a node, replacing the
+// node at *ref with a smaller one if it is sparse enough. A Node4 with
+// one child is replaced by the child, merging their prefixes.
+//
+static void
+delchild(void **ref, Node *n, byte c, void **slot) {
+	switch(n->type) {
+	case(NODE4):
+	case(NODE16): {
+		byte *key = n->type == NODE4
+			? ((Node4 *)n)->key : ((Node16 *)n)->key;
+		void **child = n->type == NODE4
+			? ((Node4 *)n)->child : ((Node16 *)n)->child;
+		uint i = (uint)(slot - child);
+		n->count--;
+		memmove(key + i, key + i + 1, n->count - i);
+		memmove(child + i, child + i + 1, sizeof(*child) * (n->count - i));
+		break;
+	}
+	case(NODE48): {
+		Node48 *n48 = (Node48 *)n;
+		n48->index[c] = 0;
+		*slot = NULL;
+		n->count--;
+		break;
+	}
+	case(NODE256): {
+		*slot = NULL;
+		n->count--;
+		break;
+	}
+	}
+	// Shrinking can fail to allocate, in which case we keep the
+	// bigger node.
+	if(n->type == NODE4 && n->count == 1) {
+		Node4 *n4 = (Node4 *)n;
+		void *p = n4->child[0];
+		if(!isleaf(p)) {
+			Node *cn = p;
+			uint len = prefixmin(n);
+			if(len < MAXPREFIX)
+				n->prefix[len++] = n4->key[0];
+			if(len < MAXPREFIX) {
+				uint more = prefixmin(cn);
+				if(more > MAXPREFIX - len)
+					more = MAXPREFIX - len;
+				memcpy(n->prefix + len, cn->prefix, more);
+				len += more;
+			}
+			memcpy(cn->prefix, n->prefix, len);
+			cn->prefixlen += n->prefixlen + 1;
+		}
+		*ref = p;
+		free(n4);
+	} else if(n->type == NODE16 && n->count == 3) {
+		Node16 *n16 = (Node16 *)n;
+		Node4 *n4 = (Node4 *)newnode(NODE4, sizeof(*n4));
+		if(n4 == NULL)
+			return;
+		copyheader(&n4->n, n);
+		memcpy(n4->key, n16->key, 3);
+		memcpy(n4->child, n16->child, sizeof(*n4->child) * 3);
+		*ref = n4;
+		free(n16);
+	} else if(n->type == NODE48 && n->count == 12) {
+		Node48 *n48 = (Node48 *)n;
+		Node16 *n16 = (Node16 *)newnode(NODE16, sizeof(*n16));
+		if(n16 == NULL)
+			return;
+		copyheader(&n16->n, n);
+		uint i = 0;
+		for(uint b = 0; b < 256; b++)
+			if(n48->index[b] != 0) {
+				n16->key[i] = (byte)b;
+				n16->child[i++] = n48->child[n48->index[b] - 1];
+			}
+		*ref = n16;
+		free(n48);
+	} else if(n->type == NODE256 && n->count == 37) {
+		Node256 *n256 = (Node256 *)n;
+		Node48 *n48 = (Node48 *)newnode(NODE48, sizeof(*n48));
+		if(n48 == NULL)
+			return;
+		copyheader(&n48->n, n);
+		uint i = 0;
+		for(uint b = 0; b < 256; b++)
+			if(n256->child[b] != NULL) {
+				n48->index[b] = (byte)(i + 1);
+				n48->child[i++] = n256->child[b];
+			}
+		*ref = n48;
+		free(n256);
+	}
+}
+
+Tbl *
+Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(NULL);
+	void **ref = &tbl->root;
+	size_t depth = 0;
+	while(!isleaf(*ref)) {
+		Node *n = *ref;
+		if(n->prefixlen != 0) {
+			if(prefix_check(n, key, len, depth) != prefixmin(n))
+				return(tbl);
+			depth += n->prefixlen;
+		}
+		byte c = keyat(key, len, depth);
+		void **child = findchild(n, c);
+		if(child == NULL)
+			return(tbl);
+		if(isleaf(*child)) {
+			Leaf *l = leaf(*child);
+			if(strcmp(key, l->key) != 0)
+				return(tbl);
+			*pkey = l->key;
+			*pval = l->val;
+			free(l);
+			delchild(ref, n, c, child);
+			return(tbl);
+		}
+		ref = child;
+		depth += 1;
+	}
+	// The root is a leaf.
+	Leaf *l = leaf(*ref);
+	if(strcmp(key, l->key) != 0)
+		return(tbl);
+	*pkey = l->key;
+	*pval = l->val;
+	free(l);
+	free(tbl);
+	return(NULL);
+}
+
+// Replace the leaf or node at *ref with a Node4 whose children are
+// the old node and the new leaf. The old node's prefix has been checked
+// up to (not including) depth + plen, where the new key differs.
+//
+static bool
+split(void **ref, size_t depth, uint plen, const char *key, size_t len,
+      Leaf *new) {
+	Node4 *n4 = (Node4 *)newnode(NODE4, sizeof(*n4));
+	if(n4 == NULL)
+		return(false);
+	void *old = *ref;
+	Leaf *l = minleaf(old);
+	size_t llen = strlen(l->key);
+	n4->n.prefixlen = plen;
+	for(uint i = 0; i < plen && i < MAXPREFIX; i++)
+		n4->n.prefix[i] = keyat(key, len, depth + i);
+	byte oc = keyat(l->key, llen, depth + plen);
+	if(!isleaf(old)) {
+		// Shorten the old node's prefix to the part after oc.
+		Node *n = old;
+		n->prefixlen -= plen + 1;
+		uint max = prefixmin(n);
+		for(uint i = 0; i < max; i++)
+			n->prefix[i] = keyat(l->key, llen, depth + plen + 1 + i);
+	}
+	addsorted(n4->key, n4->child, n4->n.count++, oc, old);
+	addsorted(n4->key, n4->child, n4->n.count++,
+		  keyat(key, len, depth + plen), tagleaf(new));
+	*ref = n4;
+	return(true);
+}
+
+Tbl *
+Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
+	// Ensure values are word-aligned, like the tries.
+	if(((uint64_t)val & 3) != 0) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if(val == NULL)
+		return(Tdell(tbl, key, len));
+	Leaf *new = malloc(sizeof(*new));
+	if(new == NULL)
+		return(NULL);
+	new->key = key;
+	new->val = val;
+	// First leaf in an empty tbl?
+	if(tbl == NULL) {
+		tbl = malloc(sizeof(*tbl));
+		if(tbl == NULL) {
+			free(new);
+			return(NULL);
+		}
+		tbl->root = tagleaf(new);
+		return(tbl);
+	}
+	void **ref = &tbl->root;
+	size_t depth = 0;
+	for(;;) {
+		if(isleaf(*ref)) {
+			Leaf *l = leaf(*ref);
+			if(strcmp(key, l->key) == 0) {
+				l->val = val;
+				free(new);
+				return(tbl);
+			}
+			break;
+		}
+		Node *n = *ref;
+		if(n->prefixlen != 0) {
+			uint plen = prefix_mismatch(n, key, len, depth);
+			if(plen < n->prefixlen) {
+				if(!split(ref, depth, plen, key, len, new))
+					goto fail;
+				return(tbl);
+			}
+			depth += n->prefixlen;
+		}
+		byte c = keyat(key, len, depth);
+		void **child = findchild(n, c);
+		if(child == NULL) {
+			if(!addchild(ref, n, c, tagleaf(new)))
+				goto fail;
+			return(tbl);
+		}
+		ref = child;
+		depth += 1;
+	}
+	// We broke out of the loop at a leaf that differs from the key.
+	Leaf *l = leaf(*ref);
+	size_t llen = strlen(l->key);
+	uint plen = 0;
+	while(keyat(key, len, depth + plen) == keyat(l->key, llen, depth + plen))
+		plen++;
+	if(split(ref, depth, plen, key, len, new))
+		return(tbl);
+fail:
+	free(new);
+	return(NULL);
+}
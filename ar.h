@@ -0,0 +1,109 @@
+// ar.h: tables implemented with adaptive radix trees.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This is a comparison baseline: the adaptive radix tree from Viktor
+// Leis, Alfons Kemper and Thomas Neumann, "The adaptive radix tree:
+// ARTful indexing for main-memory databases", ICDE 2013.
+//	https://db.in.tum.de/~leis/papers/ART.pdf
+//
+// Like a qp trie, an ART is a radix tree that uses a byte of the key at
+// each level and adapts the size of its nodes to the number of children,
+// but instead of a popcount bitmap it has four node types:
+//
+//	Node4	up to 4 children, with a sorted array of their key bytes
+//	Node16	up to 16 children, whose key bytes are searched with SIMD
+//	Node48	a 256 byte index into an array of up to 48 children
+//	Node256	an array of 256 child pointers
+//
+// Leaves are separately allocated, and child pointers to leaves are
+// tagged with their least significant bit. Like the paper we use
+// "lazy expansion" (a leaf is a single key, not a chain of one-child
+// nodes) and "hybrid path compression": each node stores the number of
+// key bytes that its keys have in common before the byte it tests, and
+// the first MAXPREFIX of them. When the prefix is longer, a search skips
+// the rest and relies on the final comparison with the leaf, and an
+// insertion or deletion checks it against one of the node's leaves.
+//
+// We include the NUL terminator in each key, so no key is a prefix of
+// another and the child for a NUL byte is always a leaf.
+
+typedef unsigned char byte;
+typedef unsigned int uint;
+
+#define MAXPREFIX 8
+
+typedef struct Leaf {
+	const char *key;
+	void *val;
+} Leaf;
+
+enum {
+	NODE4, NODE16, NODE48, NODE256
+};
+
+typedef struct Node {
+	byte type;
+	uint16_t count;
+	uint32_t prefixlen;
+	byte prefix[MAXPREFIX];
+} Node;
+
+typedef struct Node4 {
+	Node n;
+	byte key[4];
+	void *child[4];
+} Node4;
+
+typedef struct Node16 {
+	Node n;
+	byte key[16];
+	void *child[16];
+} Node16;
+
+// index[b] is zero if there is no child for byte b,
+// otherwise it is one more than the child's position
+typedef struct Node48 {
+	Node n;
+	byte index[256];
+	void *child[48];
+} Node48;
+
+typedef struct Node256 {
+	Node n;
+	void *child[256];
+} Node256;
+
+struct Tbl {
+	void *root;
+};
+
+static inline bool
+isleaf(void *p) {
+	return((uintptr_t)p & 1);
+}
+
+static inline Leaf *
+leaf(void *p) {
+	return((Leaf *)((uintptr_t)p - 1));
+}
+
+static inline void *
+tagleaf(Leaf *l) {
+	return((void *)((uintptr_t)l + 1));
+}
+
+// The key byte at a given depth; past the end of the key
+// there are only NULs.
+//
+static inline byte
+keyat(const char *key, size_t len, size_t depth) {
+	return(depth < len ? (byte)key[depth] : 0);
+}
+
+static inline uint
+prefixmin(Node *n) {
+	return(n->prefixlen < MAXPREFIX ? n->prefixlen : MAXPREFIX);
+}
@@ -0,0 +1,155 @@
+#!/usr/bin/perl
+
+use warnings;
+use strict;
+
+use POSIX qw(lgamma);
+use Sys::Hostname;
+
+sub usage {
+	die <<EOF;
+usage: $0 [-t <percent>] [-p <alpha>] [-i <impl>]... [<results> [<base> [<new>]]]
+	Compare two commits in a results file written by bench-record.pl
+	(default results.csv). The <new> commit defaults to the one most
+	recently recorded on this host, and <base> to the one before it.
+	A change is significant if Welch's t-test gives p < <alpha>
+	(default 0.01). Exits with status 1 if any significant change
+	makes an implementation slower or bigger by more than <percent>
+	(default 5); -i restricts this check to some implementations.
+EOF
+}
+
+my $threshold = 5;
+my $alpha = 0.01;
+my %check;
+while (@ARGV and $ARGV[0] =~ m{^-[tpi]$}) {
+	my $o = shift;
+	usage unless @ARGV;
+	$threshold = shift if $o eq '-t';
+	$alpha = shift if $o eq '-p';
+	$check{shift()} = 1 if $o eq '-i';
+}
+usage if @ARGV > 3;
+my $in = shift // 'results.csv';
+
+my $host = hostname;
+my %value;
+my @commit;
+open my $csv, '<', $in
+    or die "open $in: $!\n";
+while (<$csv>) {
+	chomp;
+	my ($commit, $date, $h, $impl, $input, $phase, $run, $value)
+	    = split m{,};
+	next if $commit eq 'commit' or $h ne $host;
+	@commit = grep { $_ ne $commit } @commit;
+	push @commit, $commit;
+	push @{ $value{$commit}{"$impl $input $phase"} }, $value;
+}
+
+my $new = shift // $commit[-1];
+my $base = shift // (grep { $_ ne $new } @commit)[-1];
+die "$0: need two commits recorded on $host in $in\n"
+    unless defined $new and defined $base
+	and $value{$new} and $value{$base};
+
+# Continued fraction for the regularized incomplete beta function,
+# from Numerical Recipes.
+sub betacf {
+	my ($a, $b, $x) = @_;
+	my $tiny = 1e-300;
+	my $c = 1;
+	my $d = 1 - ($a + $b) * $x / ($a + 1);
+	$d = $tiny if abs $d < $tiny;
+	$d = 1 / $d;
+	my $h = $d;
+	for my $m (1 .. 200) {
+		my $m2 = 2 * $m;
+		my $aa = $m * ($b - $m) * $x / (($a + $m2 - 1) * ($a + $m2));
+		$d = 1 + $aa * $d;
+		$d = $tiny if abs $d < $tiny;
+		$c = 1 + $aa / $c;
+		$c = $tiny if abs $c < $tiny;
+		$d = 1 / $d;
+		$h *= $d * $c;
+		$aa = -($a + $m) * ($a + $b + $m) * $x
+		    / (($a + $m2) * ($a + $m2 + 1));
+		$d = 1 + $aa * $d;
+		$d = $tiny if abs $d < $tiny;
+		$c = 1 + $aa / $c;
+		$c = $tiny if abs $c < $tiny;
+		$d = 1 / $d;
+		my $del = $d * $c;
+		$h *= $del;
+		last if abs($del - 1) < 1e-12;
+	}
+	return $h;
+}
+
+sub ibeta {
+	my ($a, $b, $x) = @_;
+	return 0 if $x <= 0;
+	return 1 if $x >= 1;
+	my $bt = exp(lgamma($a + $b) - lgamma($a) - lgamma($b)
+		     + $a * log($x) + $b * log(1 - $x));
+	return $bt * betacf($a, $b, $x) / $a
+	    if $x < ($a + 1) / ($a + $b + 2);
+	return 1 - $bt * betacf($b, $a, 1 - $x) / $b;
+}
+
+sub mean {
+	my $mean = 0;
+	$mean += $_ / @_ for @_;
+	return $mean;
+}
+
+sub meanvar {
+	my $n = @_;
+	my $mean = mean @_;
+	my $var = 0;
+	$var += ($_ - $mean) ** 2 / ($n - 1) for @_;
+	return ($mean, $var);
+}
+
+# Two-sided p-value of Welch's t-test, or undef if there
+# are not enough samples.
+sub welch {
+	my ($x, $y) = @_;
+	return undef if @$x < 2 or @$y < 2;
+	my ($mx, $vx) = meanvar @$x;
+	my ($my, $vy) = meanvar @$y;
+	my $sx = $vx / @$x;
+	my $sy = $vy / @$y;
+	return $mx == $my ? 1 : 0 if $sx + $sy == 0;
+	my $t = ($mx - $my) / sqrt($sx + $sy);
+	my $df = ($sx + $sy) ** 2
+	    / ($sx ** 2 / (@$x - 1) + $sy ** 2 / (@$y - 1));
+	return ibeta($df / 2, 0.5, $df / ($df + $t * $t));
+}
+
+printf "%-24s %12s %12s %8s %8s\n", "$base -> $new", 'base', 'new', 'change', 'p';
+my $regressed = 0;
+for my $key (sort keys %{ $value{$new} }) {
+	my $x = $value{$base}{$key} or next;
+	my $y = $value{$new}{$key};
+	my $mx = mean @$x;
+	my $my = mean @$y;
+	my $change = $mx == 0 ? 0 : 100 * ($my - $mx) / $mx;
+	my $p = welch $x, $y;
+	my $mark = '';
+	if (defined $p and $p < $alpha and abs $change > $threshold) {
+		my ($impl) = split ' ', $key;
+		if ($change < 0) {
+			$mark = 'better';
+		} elsif (not %check or $check{$impl}) {
+			$mark = 'REGRESSION';
+			$regressed++;
+		} else {
+			$mark = 'worse';
+		}
+	}
+	printf "%-24s %12.4f %12.4f %+7.1f%% %8s %s\n",
+	    $key, $mx, $my, $change,
+	    defined $p ? sprintf("%.4f", $p) : '-', $mark;
+}
+exit 1 if $regressed;
@@ -11,10 +11,26 @@ sub maxlen {
 
 sub usage {
 	die <<EOF;
-usage: $0 <count> <prog>... -- <input>...
+usage: $0 [-l] [-k <keys>] [-y <mixes>] <count> <prog>... -- <input>...
+	-l	also tabulate latency percentiles
+	-k -y	passed on to the benchmarks
 EOF
 }
 
+my $lat;
+my $opt = '';
+while (@ARGV and $ARGV[0] =~ m{^-[lky]$}) {
+	my $o = shift;
+	if ($o eq '-l') {
+		$lat = 1;
+		$opt .= "$o ";
+	} else {
+		usage unless @ARGV;
+		$opt .= "$o ".shift()." ";
+	}
+}
+my @pc = qw(p50 p99 p99.9);
+
 usage if @ARGV < 4 or $ARGV[0] !~ m{^\d+$};
 my $count = shift;
 
@@ -35,6 +51,8 @@ my $wf = maxlen @file, "0.000";
 my $waf = ($wf+1) * scalar @file;
 
 my %stats;
+my %pc;
+my %mem;
 
 open my $rnd, '<', '/dev/urandom'
     or die "open /dev/urandom: $!\n";
@@ -46,8 +64,14 @@ for (my $N = 1 ;; ++$N) {
 
 	for my $file (@file) {
 		for my $prog (@prog) {
-			print "$prog $seed $count $file\n";
-			for (qx{$prog $seed $count $file}) {
+			print "$prog $opt$seed $count $file\n";
+			for (qx{$prog $opt$seed $count $file}) {
+				if(m{^- (\w+) ns (.*)$}) {
+					my %ns = split ' ', $2;
+					$pc{$1}{$prog}{$file}{$_} += $ns{$_} for @pc;
+				}
+				$mem{$prog}{$file} = $1
+				    if m{^- memory ([0-9.]+) bytes/key$};
 				if(m{^(\w+)... ([0-9.]+) s$}) {
 					my $test = $1;
 					my $time = $2;
@@ -80,4 +104,29 @@ for (my $N = 1 ;; ++$N) {
 			print "\e[0m\n";
 		}
 	}
+	if (%mem) {
+		printf "%-*s  | bytes/key\n", $wp + $wf, "memory";
+		for my $file (@file) {
+			for my $prog (@prog) {
+				printf "%s%-*s %-*s | %.1f\e[0m\n",
+				    $col{$prog}, $wp, $prog, $wf, $file,
+				    $mem{$prog}{$file} // 0;
+			}
+		}
+	}
+	next unless $lat;
+	printf "%-*s ", $wp + $wf, "mean ns";
+	printf " | %-31s", "$_ ".join '/', @pc for sort keys %pc;
+	print "\n";
+	for my $file (@file) {
+		for my $prog (@prog) {
+			printf "%s%-*s %-*s", $col{$prog}, $wp, $prog, $wf, $file;
+			for my $test (sort keys %pc) {
+				printf " | %-31s", join ' / ', map {
+					sprintf "%.0f", $pc{$test}{$prog}{$file}{$_} / $N
+				} @pc;
+			}
+			print "\e[0m\n";
+		}
+	}
 }
@@ -0,0 +1,79 @@
+#!/usr/bin/perl
+
+use warnings;
+use strict;
+
+use MIME::Base64;
+
+sub maxlen {
+	return (sort { $a <=> $b } map { length } @_)[-1];
+}
+
+sub usage {
+	die <<EOF;
+usage: $0 <count> <prog>... -- <input>...
+	Run each benchmark once with hardware performance counters,
+	and tabulate the counts per operation for each phase.
+EOF
+}
+
+usage if @ARGV < 4 or $ARGV[0] !~ m{^\d+$};
+my $count = shift;
+
+my @prog;
+
+push @prog, shift while @ARGV and $ARGV[0] ne '--';
+usage if '--' ne shift @ARGV;
+
+my @file = @ARGV;
+
+my $wp = maxlen @prog;
+my $wf = maxlen @file;
+
+# use the same seed for every run so they do the same work
+open my $rnd, '<', '/dev/urandom'
+    or die "open /dev/urandom: $!\n";
+my $seed;
+sysread $rnd, $seed, 12;
+$seed = encode_base64 $seed, "";
+
+my %stats;
+my @phase;
+my @counter;
+my %seen;
+
+for my $file (@file) {
+	for my $prog (@prog) {
+		print STDERR "$prog -p $seed $count $file\n";
+		for (qx{$prog -p $seed $count $file}) {
+			print STDERR $_ if m{^- perf counters unavailable};
+			next unless m{^- (\w+) per op (.*)$};
+			my $phase = $1;
+			my %n = split ' ', $2;
+			push @phase, $phase unless $seen{phase}{$phase}++;
+			$stats{$phase}{$prog}{$file} = \%n;
+			for my $c (split m{ [\d.]+ ?}, $2) {
+				push @counter, $c unless $seen{counter}{$c}++;
+			}
+		}
+	}
+}
+
+die "no counters\n" unless @counter;
+
+for my $phase (@phase) {
+	printf "%-*s", $wp + $wf + 1, $phase;
+	printf " %13s", $_ for @counter;
+	print "\n";
+	for my $file (@file) {
+		for my $prog (@prog) {
+			printf "%-*s %-*s", $wp, $prog, $wf, $file;
+			for my $c (@counter) {
+				my $n = $stats{$phase}{$prog}{$file}{$c};
+				printf " %13s", defined $n ? sprintf "%.2f", $n : "-";
+			}
+			print "\n";
+		}
+	}
+	print "\n";
+}
@@ -0,0 +1,70 @@
+#!/usr/bin/perl
+
+use warnings;
+use strict;
+
+use Sys::Hostname;
+
+sub usage {
+	die <<EOF;
+usage: $0 [-n <runs>] [-o <results>] <count> <prog>... -- <input>...
+	Run each benchmark <runs> times (default 5) on each input, and
+	append the time of each phase and the memory per key to the
+	<results> CSV file (default results.csv), keyed by git commit.
+	Run <i> uses the same random seed on every commit, so
+	bench-compare.pl compares like with like.
+EOF
+}
+
+my $runs = 5;
+my $out = 'results.csv';
+while (@ARGV and $ARGV[0] =~ m{^-[no]$}) {
+	my $o = shift;
+	usage unless @ARGV;
+	$runs = shift if $o eq '-n';
+	$out = shift if $o eq '-o';
+}
+usage if @ARGV < 4 or $ARGV[0] !~ m{^\d+$} or $runs !~ m{^\d+$};
+my $count = shift;
+
+my @prog;
+push @prog, shift while @ARGV and $ARGV[0] ne '--';
+usage if '--' ne shift @ARGV;
+my @file = @ARGV;
+
+# Uncommitted changes get their own key, so they are not
+# mixed up with the commit they are based on.
+my $commit = qx{git rev-parse --short HEAD};
+chomp $commit;
+$commit .= '-dirty' if qx{git status --porcelain --untracked-files=no} ne '';
+my $host = hostname;
+my $date = time;
+
+my $new = not -e $out;
+open my $csv, '>>', $out
+    or die "open $out: $!\n";
+print $csv "commit,date,host,impl,input,phase,run,value\n" if $new;
+
+for my $run (1 .. $runs) {
+	my $seed = sprintf "seed%012d", $run;
+	for my $file (@file) {
+		for my $prog (@prog) {
+			(my $impl = $prog) =~ s{^.*/bench-}{};
+			print "$prog $seed $count $file\n";
+			my @line = qx{$prog $seed $count $file};
+			die "$prog failed\n" if $?;
+			for (@line) {
+				my ($phase, $value);
+				($phase, $value) = ($1, $2)
+				    if m{^(\w+)... ([0-9.]+) s$};
+				($phase, $value) = ('memory', $1)
+				    if m{^- memory ([0-9.]+) bytes/key$};
+				next unless defined $phase;
+				print $csv join(',', $commit, $date, $host,
+				    $impl, $file, $phase, $run, $value), "\n";
+			}
+		}
+	}
+}
+close $csv or die "write $out: $!\n";
+print "recorded $runs runs of $commit in $out\n";
@@ -6,47 +6,57 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include <sys/stat.h>
 #include <sys/time.h>
 
-#include <fcntl.h>
+#include <malloc.h>
 #include <unistd.h>
 
 #include "Tbl.h"
-
-static const char *progname;
-
-static void
-die(const char *cause) {
-	fprintf(stderr, "%s: %s: %s\n", progname, cause, strerror(errno));
-	exit(1);
-}
+#include "util.h"
 
 static void
 usage(void) {
 	fprintf(stderr,
-"usage: %s <seed> <count> <input>\n"
+"usage: %s [-l] [-p] [-k <keys>] [-y <mixes>] <seed> <count> <input>\n"
 "	The seed must be at least 12 characters.\n"
+"	-l	report percentiles of the latency of each operation\n"
+"	-p	report hardware performance counters per operation\n"
+"	-k <keys>	how to choose keys, one of:\n"
+"		uniform		every key is equally likely (the default)\n"
+"		zipf:<s>	Zipf distribution with exponent <s>\n"
+"		hot:<f>:<p>	fraction <p> of operations use\n"
+"				fraction <f> of the keys\n"
+"		seq		keys in sorted order\n"
+"		trace:<file>	replay the keys in <file>\n"
+"	-y <mixes>	run YCSB-style mixed workloads, any of abcdef\n"
 		, progname);
 	exit(1);
 }
 
+static void perf_start(void);
+static void perf_stop(void);
+
 static struct timeval tu;
 
 static void
 start(const char *s) {
 	printf("%s... ", s);
 	gettimeofday(&tu, NULL);
+	perf_start();
 }
 
 static void
 done(void) {
 	struct timeval tv;
+	perf_stop();
 	gettimeofday(&tv, NULL);
 	tv.tv_sec -= tu.tv_sec;
 	tv.tv_usec -= tu.tv_usec;
@@ -58,81 +68,646 @@ done(void) {
 	       (long)tv.tv_sec, (long)tv.tv_usec);
 }
 
+// When the -l option is given, we time each operation and count the
+// times in a histogram like HdrHistogram: small values are counted
+// exactly, and each larger power of two is divided into 2^SUB buckets,
+// so percentiles are accurate to about 3%.
+//
+// On x86 the clock is the TSC, read with RDTSCP (which waits for the
+// operation to finish) followed by LFENCE (so the next operation does
+// not start early). The TSC rate is calibrated against
+// CLOCK_MONOTONIC_RAW, which we use directly on other CPUs. The
+// overhead of reading the clock is subtracted from each sample.
+
+static bool latency;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <x86intrin.h>
+
+static inline uint64_t
+ticks(void) {
+	unsigned aux;
+	uint64_t t = __rdtscp(&aux);
+	_mm_lfence();
+	return(t);
+}
+
+#else
+
+static inline uint64_t
+ticks(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return((uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec);
+}
+
+#endif
+
+#define SUB 5
+#define BUCKETS ((64 - SUB + 1) << SUB)
+
+static uint64_t hist[BUCKETS];
+static uint64_t overhead;
+static double ns_per_tick;
+
+static inline size_t
+bucket(uint64_t v) {
+	if(v < (1 << SUB))
+		return(v);
+	int e = 63 - __builtin_clzll(v);
+	return(((size_t)(e - SUB + 1) << SUB) + (v >> (e - SUB) & ((1 << SUB) - 1)));
+}
+
+// The middle of a bucket.
+//
+static double
+bucket_value(size_t b) {
+	if(b < (1 << SUB))
+		return((double)b);
+	int e = (int)(b >> SUB) + SUB - 1;
+	uint64_t lo = ((1 << SUB) + (b & ((1 << SUB) - 1))) << (e - SUB);
+	return((double)lo + (double)(UINT64_C(1) << (e - SUB)) / 2);
+}
+
+static inline void
+sample(uint64_t t0) {
+	uint64_t t = ticks() - t0;
+	hist[bucket(t > overhead ? t - overhead : 0)]++;
+}
+
+static double
+nanosecs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return((double)ts.tv_sec * 1e9 + (double)ts.tv_nsec);
+}
+
+static void
+calibrate(void) {
+	overhead = UINT64_MAX;
+	for(int i = 0; i < 10000; i++) {
+		uint64_t t0 = ticks();
+		uint64_t t = ticks() - t0;
+		if(overhead > t)
+			overhead = t;
+	}
+	double n0 = nanosecs();
+	uint64_t t0 = ticks();
+	while(nanosecs() - n0 < 50e6)
+		;
+	ns_per_tick = (nanosecs() - n0) / (double)(ticks() - t0);
+	printf("- clock overhead %.1f ns, %.3f ns per tick\n",
+	       (double)overhead * ns_per_tick, ns_per_tick);
+}
+
+// Print the latency percentiles for a phase, in nanoseconds, like
+//	- search ns p50 91 p90 180 p99 420 p99.9 1100 max 15000
+//
+static void
+percentiles(const char *phase) {
+	static const double pc[] = { 50, 90, 99, 99.9, 99.99 };
+	static const char *name[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+	uint64_t total = 0;
+	size_t max = 0;
+	for(size_t b = 0; b < BUCKETS; b++)
+		if(hist[b] != 0) {
+			total += hist[b];
+			max = b;
+		}
+	printf("- %s ns", phase);
+	uint64_t count = 0;
+	size_t b = 0;
+	for(size_t i = 0; i < sizeof(pc) / sizeof(*pc); i++) {
+		uint64_t rank = (uint64_t)(pc[i] / 100 * (double)total);
+		while(b < max && count + hist[b] <= rank)
+			count += hist[b++];
+		printf(" %s %.0f", name[i], bucket_value(b) * ns_per_tick);
+	}
+	printf(" max %.0f\n", bucket_value(max) * ns_per_tick);
+	memset(hist, 0, sizeof(hist));
+}
+
+// Time an operation if we are measuring latency.
+//
+#define TIMED(op) do {					\
+		if(latency) {				\
+			uint64_t t0 = ticks();		\
+			op;				\
+			sample(t0);			\
+		} else {				\
+			op;				\
+		}					\
+	} while(0)
+
+// When the -p option is given, we count hardware events in user space
+// during each phase, using Linux perf_event_open(2). The counters are
+// not in a group, so that we can still use the ones that are available
+// when others are not, and if the kernel has to multiplex them we scale
+// the counts by the time each counter was running.
+
+static bool perf;
+
+typedef struct Counter {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	int fd;
+	double count;
+} Counter;
+
+#ifdef __linux__
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#define CACHE_MISS(cache) (PERF_COUNT_HW_CACHE_##cache |		\
+			   PERF_COUNT_HW_CACHE_OP_READ << 8 |		\
+			   PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static Counter counter[] = {
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 0 },
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, 0 },
+	{ "l1d-misses", PERF_TYPE_HW_CACHE, CACHE_MISS(L1D), -1, 0 },
+	{ "llc-misses", PERF_TYPE_HW_CACHE, CACHE_MISS(LL), -1, 0 },
+	{ "dtlb-misses", PERF_TYPE_HW_CACHE, CACHE_MISS(DTLB), -1, 0 },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, 0 },
+};
+
+#define COUNTERS (sizeof(counter) / sizeof(*counter))
+
+static void
+perf_open(void) {
+	size_t open = 0;
+	for(size_t i = 0; i < COUNTERS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = counter[i].type;
+		attr.config = counter[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+		counter[i].fd = (int)syscall(SYS_perf_event_open,
+					     &attr, 0, -1, -1, 0);
+		open += counter[i].fd >= 0;
+	}
+	if(open == 0) {
+		printf("- perf counters unavailable: %s\n", strerror(errno));
+		perf = false;
+	}
+}
+
+static void
+perf_start(void) {
+	if(!perf) return;
+	for(size_t i = 0; i < COUNTERS; i++) {
+		if(counter[i].fd < 0) continue;
+		ioctl(counter[i].fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static void
+perf_stop(void) {
+	if(!perf) return;
+	for(size_t i = 0; i < COUNTERS; i++) {
+		if(counter[i].fd < 0) continue;
+		ioctl(counter[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+		uint64_t v[3];
+		counter[i].count = -1;
+		if(read(counter[i].fd, v, sizeof(v)) != sizeof(v) || v[2] == 0)
+			continue;
+		counter[i].count = (double)v[0] * (double)v[1] / (double)v[2];
+	}
+}
+
+// Print the counts per operation for a phase, like
+//	- search per op cycles 1203.4 instructions 310.2 ...
+//
+static void
+counters(const char *phase, size_t ops) {
+	printf("- %s per op", phase);
+	for(size_t i = 0; i < COUNTERS; i++)
+		if(counter[i].fd >= 0 && counter[i].count >= 0)
+			printf(" %s %.2f", counter[i].name,
+			       counter[i].count / (double)ops);
+	printf("\n");
+}
+
+#else // !__linux__
+
+static void
+perf_open(void) {
+	printf("- perf counters unavailable\n");
+	perf = false;
+}
+
+static void perf_start(void) {}
+static void perf_stop(void) {}
+static void counters(const char *phase, size_t ops) {
+	(void)phase, (void)ops;
+}
+
+#endif
+
+static void
+report(const char *phase, size_t ops) {
+	if(latency)
+		percentiles(phase);
+	if(perf)
+		counters(phase, ops);
+}
+
+// Bytes allocated from the heap, including malloc's per-chunk overhead.
+//
+static size_t
+heapsize(void) {
+	struct mallinfo2 mi = mallinfo2();
+	return(mi.uordblks + mi.hblkhd);
+}
+
+// Key distributions for the -k option.
+//
+// Each key has a rank, and the distribution chooses a rank. For zipf
+// and hot keys the ranks are a random permutation of the input, so
+// that the popular keys are scattered around the table instead of
+// being clustered in one subtrie. For seq the ranks are in sorted
+// order and we step through them one at a time, wrapping at the end.
+// A trace is replayed in order and the ranks are not used, except to
+// choose keys to insert in the mixed workloads.
+
+typedef enum Dist {
+	UNIFORM, ZIPF, HOT, SEQ, TRACE
+} Dist;
+
+static Dist dist = UNIFORM;
+static double zipf_s, hot_f, hot_p;
+
+static char **order;	// keys by rank
+static size_t keys;
+static double *zipf_cdf;
+static size_t seq_next;
+static char **trace;
+static size_t traces, trace_next;
+
+static double
+uniform01(void) {
+	return((double)random() / 2147483648.0);
+}
+
 static int
-ssrandom(char *s) {
-	// initialize random(3) from a string
-	size_t len = strlen(s);
-	if(len < 12) return(-1);
-	unsigned seed = s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24;
-	initstate(seed, s+4, len-4);
-	return(0);
+bystr(const void *a, const void *b) {
+	return(strcmp(*(char *const *)a, *(char *const *)b));
+}
+
+static bool
+parse_dist(const char *arg) {
+	char *end;
+	if(strcmp(arg, "uniform") == 0) {
+		dist = UNIFORM;
+	} else if(strcmp(arg, "seq") == 0) {
+		dist = SEQ;
+	} else if(strncmp(arg, "zipf:", 5) == 0) {
+		dist = ZIPF;
+		zipf_s = strtod(arg + 5, &end);
+		if(end == arg + 5 || *end != '\0' || zipf_s <= 0)
+			return(false);
+	} else if(strncmp(arg, "hot:", 4) == 0) {
+		dist = HOT;
+		hot_f = strtod(arg + 4, &end);
+		if(end == arg + 4 || *end != ':')
+			return(false);
+		hot_p = strtod(end + 1, &end);
+		if(*end != '\0' || hot_f <= 0 || hot_f >= 1 ||
+		   hot_p < 0 || hot_p > 1)
+			return(false);
+	} else if(strncmp(arg, "trace:", 6) == 0) {
+		dist = TRACE;
+		char *tbuf;
+		trace = read_lines(arg + 6, &traces, &tbuf);
+		if(traces == 0)
+			return(false);
+	} else {
+		return(false);
+	}
+	return(true);
+}
+
+static void
+dist_init(char **line, size_t lines) {
+	keys = lines;
+	order = calloc(keys, sizeof(*order));
+	if(order == NULL) die("calloc");
+	memcpy(order, line, keys * sizeof(*order));
+	if(dist == ZIPF || dist == HOT) {
+		for(size_t i = keys - 1; i > 0; i--) {
+			size_t j = (size_t)random() % (i + 1);
+			char *tmp = order[i];
+			order[i] = order[j];
+			order[j] = tmp;
+		}
+	}
+	if(dist == SEQ)
+		qsort(order, keys, sizeof(*order), bystr);
+	if(dist == ZIPF) {
+		zipf_cdf = calloc(keys, sizeof(*zipf_cdf));
+		if(zipf_cdf == NULL) die("calloc");
+		double sum = 0;
+		for(size_t i = 0; i < keys; i++)
+			zipf_cdf[i] = sum += pow((double)(i + 1), -zipf_s);
+	}
+}
+
+// Choose a rank less than n (which is at most the number of keys).
+//
+static size_t
+rank(size_t n) {
+	switch(dist) {
+	case ZIPF:
+		for(;;) {
+			double u = uniform01() * zipf_cdf[keys - 1];
+			size_t lo = 0, hi = keys - 1;
+			while(lo < hi) {
+				size_t mid = lo + (hi - lo) / 2;
+				if(zipf_cdf[mid] <= u)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if(lo < n)
+				return(lo);
+		}
+	case HOT: {
+		size_t hot = (size_t)(hot_f * (double)n);
+		if(hot == 0)
+			hot = 1;
+		if(hot == n || uniform01() < hot_p)
+			return((size_t)random() % hot);
+		else
+			return(hot + (size_t)random() % (n - hot));
+	}
+	case SEQ:
+		return(seq_next++ % n);
+	default:
+		return((size_t)random() % n);
+	}
+}
+
+// Choose a key from the first n ranks.
+//
+static const char *
+choose(size_t n) {
+	if(dist == TRACE)
+		return(trace[trace_next++ % traces]);
+	else
+		return(order[rank(n)]);
+}
+
+// Mixed workloads for the -y option, like the Yahoo! Cloud Serving
+// Benchmark core workloads. Each operation is chosen at random with
+// these percentages:
+//	a	50 read, 50 update (session store)
+//	b	95 read, 5 update (photo tagging)
+//	c	100 read (user profile cache)
+//	d	95 read, 5 insert, reading recent inserts (status updates)
+//	e	95 scan, 5 insert (threaded conversations)
+//	f	50 read, 50 read-modify-write (user database)
+// Workloads d and e start with some of the coldest keys removed from
+// the table, which are put back by the inserts. In workload d the
+// ranks count backwards from the most recently inserted key, and a
+// scan visits up to 100 keys in order.
+
+typedef enum OpType {
+	READ, UPDATE, INSERT, SCAN, RMW
+} OpType;
+
+typedef struct Mix {
+	char name;
+	unsigned read, update, insert, scan;	// rmw is the rest
+	bool latest;
+} Mix;
+
+static const Mix mixes[] = {
+	{ 'a', 50, 50, 0, 0, false },
+	{ 'b', 95, 5, 0, 0, false },
+	{ 'c', 100, 0, 0, 0, false },
+	{ 'd', 95, 0, 5, 0, true },
+	{ 'e', 0, 0, 5, 95, false },
+	{ 'f', 50, 0, 0, 0, false },
+};
+
+#define SCANMAX 100
+
+typedef struct Op {
+	OpType type;
+	unsigned len;
+	const char *key;
+} Op;
+
+static const Mix *
+find_mix(char name) {
+	for(size_t i = 0; i < sizeof(mixes) / sizeof(*mixes); i++)
+		if(mixes[i].name == (name | 0x20))
+			return(&mixes[i]);
+	return(NULL);
+}
+
+// Generate a workload's operations, and return the number of keys
+// that must be removed from the end of the ranks before it starts.
+//
+static size_t
+mix_ops(const Mix *m, Op *op, size_t N) {
+	size_t inserts = 0;
+	for(size_t i = 0; i < N; i++) {
+		unsigned pc = (unsigned)random() % 100;
+		op[i].len = 0;
+		if(pc < m->read)
+			op[i].type = READ;
+		else if((pc -= m->read) < m->update)
+			op[i].type = UPDATE;
+		else if((pc -= m->update) < m->insert)
+			op[i].type = INSERT;
+		else if((pc -= m->insert) < m->scan)
+			op[i].type = SCAN;
+		else
+			op[i].type = RMW;
+		if(op[i].type == SCAN)
+			op[i].len = 1 + (unsigned)random() % SCANMAX;
+		inserts += op[i].type == INSERT;
+	}
+	size_t held = inserts < keys / 2 ? inserts : keys / 2;
+	size_t present = keys - held;
+	for(size_t i = 0; i < N; i++) {
+		if(op[i].type == INSERT && present < keys)
+			op[i].key = order[present++];
+		else if(op[i].type == INSERT)
+			op[i].type = UPDATE;
+		if(op[i].type == INSERT)
+			continue;
+		if(m->latest && dist != TRACE)
+			op[i].key = order[present - 1 - rank(present)];
+		else
+			op[i].key = choose(present);
+	}
+	return(held);
+}
+
+// Put the table back to just the input keys, after a trace might have
+// added others.
+//
+static Tbl *
+reset(Tbl *t, char **line, size_t lines, void *val) {
+	for(size_t i = 0; dist == TRACE && i < traces; i++)
+		t = Tset(t, trace[i], NULL);
+	for(size_t l = 0; l < lines; l++)
+		t = Tset(t, line[l], val);
+	return(t);
+}
+
+static size_t
+scan(Tbl *t, const char *key, unsigned len) {
+	void *val = NULL;
+	size_t n = 0;
+	if(Tget(t, key) == NULL)
+		return(0);
+	while(n < len && Tnext(t, &key, &val))
+		n++;
+	return(n);
 }
 
 int
 main(int argc, char *argv[]) {
 	progname = argv[0];
+	const char *mix = "";
+	for(;;) {
+		if(argc > 1 && strcmp(argv[1], "-l") == 0) {
+			latency = true;
+			argv++;
+			argc--;
+		} else if(argc > 1 && strcmp(argv[1], "-p") == 0) {
+			perf = true;
+			argv++;
+			argc--;
+		} else if(argc > 2 && strcmp(argv[1], "-k") == 0) {
+			if(!parse_dist(argv[2])) usage();
+			argv += 2;
+			argc -= 2;
+		} else if(argc > 2 && strcmp(argv[1], "-y") == 0) {
+			mix = argv[2];
+			for(const char *m = mix; *m; m++)
+				if(find_mix(*m) == NULL) usage();
+			argv += 2;
+			argc -= 2;
+		} else {
+			break;
+		}
+	}
 	if(argc != 4 || argv[1][0] == '-') usage();
 	if(ssrandom(argv[1]) < 0) usage();
 	size_t N = (size_t)atoi(argv[2]);
 
-	int fd = open(argv[3], O_RDONLY);
-	if(fd < 0) die("open");
-	struct stat st;
-	if(fstat(fd, &st) < 0) die("stat");
-	size_t flen = (size_t)st.st_size;
-	char *fbuf = malloc(flen + 1);
-	if(fbuf == NULL) die("malloc");
-	if(read(fd, fbuf, flen) < 0) die("read");
-	close(fd);
-	fbuf[flen] = '\0';
-
-	size_t lines = 0;
-	for(char *p = fbuf; *p; p++)
-		if(*p == '\n')
-			++lines;
-	char **line = calloc(lines, sizeof(*line));
-	size_t l = 0;
-	bool bol = true;
-	for(char *p = fbuf; *p; p++) {
-		if(bol) {
-			line[l++] = p;
-			bol = false;
-		}
-		if(*p == '\n') {
-			*p = '\0';
-			bol = true;
-		}
-	}
+	size_t lines, l;
+	char *fbuf;
+	char **line = read_lines(argv[3], &lines, &fbuf);
+	if(lines == 0) usage();
 	printf("- got %zu lines\n", lines);
+	dist_init(line, lines);
+	if(latency)
+		calibrate();
+	if(perf)
+		perf_open();
+
+	// Keys are chosen before each phase, so that the time it takes
+	// to choose them is not counted.
+	const char **key = calloc(N, sizeof(*key));
+	if(key == NULL) die("calloc");
 
+	size_t heap = heapsize();
 	start("load");
 	Tbl *t = NULL;
 	for(l = 0; l < lines; l++)
-		t = Tset(t, line[l], main);
+		TIMED(t = Tset(t, line[l], main));
 	done();
+	report("load", lines);
+	// The keys are not part of the table, and were allocated earlier.
+	printf("- memory %.1f bytes/key\n",
+	       (double)(heapsize() - heap) / lines);
 
+	for(size_t i = 0; i < N; i++)
+		key[i] = choose(lines);
 	start("search");
 	l = 0;
 	for(size_t i = 0; i < N; i++)
-		if(Tget(t, line[random() % lines]) != NULL)
-			++l;
-	assert(l == N);
+		TIMED(l += Tget(t, key[i]) != NULL);
 	done();
+	if(dist == TRACE)
+		printf("- found %zu/%zu\n", l, N);
+	else
+		assert(l == N);
+	report("search", N);
 
-	start("mutate");
 	for(size_t i = 0; i < N; i++)
-		t = Tset(t, line[random() % lines],
-			 random() % 2 ? main : NULL);
+		key[i] = choose(lines);
+	start("mutate");
+	for(size_t i = 0; i < N; i++) {
+		void *val = random() % 2 ? main : NULL;
+		TIMED(t = Tset(t, key[i], val));
+	}
 	done();
+	report("mutate", N);
+
+	Op *op = mix[0] == '\0' ? NULL : calloc(N, sizeof(*op));
+	if(mix[0] != '\0' && op == NULL) die("calloc");
+	for(const char *m = mix; *m; m++) {
+		const Mix *y = find_mix(*m);
+		char phase[] = "ycsb_?";
+		phase[5] = y->name;
+		t = reset(t, line, lines, main);
+		size_t held = mix_ops(y, op, N);
+		for(l = keys - held; l < keys; l++)
+			t = Tset(t, order[l], NULL);
+		size_t found = 0;
+		start(phase);
+		for(size_t i = 0; i < N; i++) {
+			const char *k = op[i].key;
+			void *val;
+			switch(op[i].type) {
+			case READ:
+				TIMED(found += Tget(t, k) != NULL);
+				break;
+			case UPDATE:
+			case INSERT:
+				TIMED(t = Tset(t, k, main));
+				break;
+			case SCAN:
+				TIMED(found += scan(t, k, op[i].len));
+				break;
+			case RMW:
+				TIMED(val = Tget(t, k);
+				      t = Tset(t, k, val == main
+					       ? (void *)line : main));
+				break;
+			}
+		}
+		done();
+		printf("- %s found %zu\n", phase, found);
+		report(phase, N);
+	}
 
 	// ensure all keys present
-	for(l = 0; l < lines; l++)
-		t = Tset(t, line[l], main);
+	t = reset(t, line, lines, main);
 	start("free");
 	for(l = 0; l < lines; l++)
-		t = Tset(t, line[l], NULL);
+		TIMED(t = Tset(t, line[l], NULL));
 	assert(t == NULL);
 	done();
+	report("free", lines);
 
+	free(op);
+	free(key);
 	return(0);
 }
@@ -0,0 +1,206 @@
+// cache-bench.c: multi-threaded DNS cache benchmark.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+#include "util.h"
+
+// Cost of each entry's data against the memory limit.
+//
+#define SIZE 64
+
+// Entries live for up to this many ticks of the simulated clock; the
+// clock ticks about once a millisecond.
+//
+#define TTL 1000
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s <seed> <threads> <count> <input>\n"
+"	The seed must be at least 12 characters.\n"
+"	Each thread looks up <count> random names from the input,\n"
+"	and adds the names it misses to the cache. The memory limit\n"
+"	is big enough for about half the names.\n"
+		, progname);
+	exit(1);
+}
+
+static Cache *cache;
+static char **line;
+static size_t lines, N;
+static time_t ticks;
+static bool finished;
+
+typedef struct Worker {
+	pthread_t tid;
+	uint64_t rng;
+	size_t hits, misses, fails;
+	double secs;
+} Worker;
+
+static void *
+worker(void *arg) {
+	Worker *w = arg;
+	Creader *r = cache_reader(cache);
+	if(r == NULL) die("cache_reader");
+	double t0 = now_sec();
+	for(size_t i = 0; i < N; i++) {
+		char *name = line[xorshift(&w->rng) % lines];
+		time_t now = __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+		void *data = NULL;
+		cache_enter(r);
+		bool hit = cache_get(r, name, now, &data);
+		if(hit && strcmp(data, name) != 0) {
+			fprintf(stderr, "%s: got %s for %s\n",
+				progname, (char *)data, name);
+			exit(1);
+		}
+		cache_leave(r);
+		if(hit) {
+			w->hits++;
+			continue;
+		}
+		w->misses++;
+		time_t expires = now + 1 + (time_t)(xorshift(&w->rng) % TTL);
+		if(!cache_put(cache, name, name, SIZE, expires))
+			w->fails++;
+	}
+	w->secs = now_sec() - t0;
+	cache_reader_free(r);
+	return(NULL);
+}
+
+// A new entry must replace an old one straight away, whether or not the
+// old one has been merged into the trie.
+//
+static void
+check_replace(void) {
+	static char name[] = "replaced.example", old[] = "old", new[] = "new";
+	Creader *r = cache_reader(cache);
+	if(r == NULL) die("cache_reader");
+	for(int merged = 0; merged < 2; merged++) {
+		if(!cache_put(cache, name, old, SIZE, TTL)) die("cache_put");
+		if(merged && !cache_clean(cache, 0)) die("cache_clean");
+		if(!cache_put(cache, name, new, SIZE, TTL)) die("cache_put");
+		for(int cleaned = 0; cleaned < 2; cleaned++) {
+			if(cleaned && !cache_clean(cache, 0)) die("cache_clean");
+			void *data = NULL;
+			cache_enter(r);
+			bool hit = cache_get(r, name, 0, &data);
+			cache_leave(r);
+			if(hit && data == new)
+				continue;
+			fprintf(stderr, "%s: got %s for %s after replacing it\n",
+				progname, hit ? (char *)data : "nothing", name);
+			exit(1);
+		}
+	}
+	cache_reader_free(r);
+}
+
+static void *
+cleaner(void *arg) {
+	double *secs = arg;
+	struct timespec tick = { 0, 1000000 };
+	while(!__atomic_load_n(&finished, __ATOMIC_ACQUIRE)) {
+		nanosleep(&tick, NULL);
+		time_t now = __atomic_add_fetch(&ticks, 1, __ATOMIC_RELAXED);
+		double t0 = now_sec();
+		if(!cache_clean(cache, now)) die("cache_clean");
+		*secs += now_sec() - t0;
+	}
+	return(NULL);
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	if(argc != 5 || argv[1][0] == '-') usage();
+	if(ssrandom(argv[1]) < 0) usage();
+	size_t T = (size_t)atoi(argv[2]);
+	N = (size_t)atoi(argv[3]);
+	if(T < 1) usage();
+
+	char *fbuf;
+	line = read_lines(argv[4], &lines, &fbuf);
+	// skip names that are too long for the DNS
+	size_t bytes = 0, l;
+	for(size_t i = l = 0; i < lines; i++) {
+		size_t len = strlen(line[i]);
+		if(len > 0 && len < 254) {
+			line[l++] = line[i];
+			bytes += len + 1;
+		}
+	}
+	lines = l;
+	if(lines == 0) usage();
+
+	// about 100 bytes of overhead per entry
+	size_t limit = (lines * (SIZE + 100) + bytes) / 2;
+	cache = cache_create(limit, NULL);
+	if(cache == NULL) die("cache_create");
+
+	check_replace();
+
+	Worker *w = calloc(T, sizeof(*w));
+	if(w == NULL) die("calloc");
+	for(size_t t = 0; t < T; t++)
+		w[t].rng = (uint64_t)random() << 32 | (uint64_t)random() | 1;
+
+	double cleaning = 0;
+	pthread_t ctid;
+	double t0 = now_sec();
+	errno = pthread_create(&ctid, NULL, cleaner, &cleaning);
+	if(errno != 0) die("pthread_create");
+	for(size_t t = 0; t < T; t++) {
+		errno = pthread_create(&w[t].tid, NULL, worker, &w[t]);
+		if(errno != 0) die("pthread_create");
+	}
+	for(size_t t = 0; t < T; t++)
+		pthread_join(w[t].tid, NULL);
+	double secs = now_sec() - t0;
+	__atomic_store_n(&finished, true, __ATOMIC_RELEASE);
+	pthread_join(ctid, NULL);
+
+	size_t hits = 0, misses = 0, fails = 0;
+	for(size_t t = 0; t < T; t++) {
+		printf("thread %zu: %zu hits %zu misses %.3f s %.0f ops/s\n",
+		       t, w[t].hits, w[t].misses, w[t].secs,
+		       (double)N / w[t].secs);
+		hits += w[t].hits;
+		misses += w[t].misses;
+		fails += w[t].fails;
+	}
+	printf("total: %zu threads %.3f s %.0f ops/s %.1f%% hits",
+	       T, secs, (double)(T * N) / secs,
+	       100.0 * (double)hits / (double)(hits + misses));
+	if(fails > 0)
+		printf(" %zu failed puts", fails);
+	printf("\n");
+
+	Cstats cs;
+	cache_stats(cache, &cs);
+	printf("cleaner: %zu cleans %.3f s %zu merged %zu expired"
+	       " %zu evicted\n", cs.cleans, cleaning,
+	       cs.merged, cs.expired, cs.evicted);
+	printf("cache: %zu entries %zu bytes (limit %zu)\n",
+	       cs.entries, cs.memory, limit);
+
+	cache_destroy(cache);
+	free(w);
+	free(line);
+	free(fbuf);
+	return(0);
+}
@@ -0,0 +1,539 @@
+// cache.c: a DNS resolver cache built on a copy-on-write DNS-trie
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Tbl.h"
+#include "cache.h"
+#include "util.h"
+
+extern int
+siphash(uint8_t *out, const uint8_t *in, uint64_t inlen, const uint8_t *k);
+
+// The staging area is divided into this many stripes.
+//
+#define STRIPES 64
+
+// Domain names are limited to 255 bytes in wire format, which is a
+// couple of bytes longer than in presentation format.
+//
+#define MAXNAME 253
+
+typedef struct Centry {
+	char *name;
+	void *data;
+	size_t cost;
+	time_t expires;
+	size_t heap;		// position in the expiry heap
+	bool merged;		// owned by the trie, not the staging area
+	struct Centry *next;	// on a list of retired entries
+} Centry;
+
+typedef struct Stripe {
+	pthread_mutex_t lock;
+	Tbl *tbl;
+	bool staged;		// tbl is not empty, read without locking
+	Centry *retired;	// replaced while in the staging area
+} __attribute__((aligned(LINE))) Stripe;
+
+// A reader's epoch is zero when it is not reading the cache. Otherwise
+// it is the value of the cache's epoch when the reader started, which
+// tells the cleaner which version of the trie the reader might be using.
+//
+struct Creader {
+	uint64_t epoch;
+	Creader *next;
+	Cache *cache;
+} __attribute__((aligned(LINE)));
+
+struct Cache {
+	// read by everyone
+	Tbl *trie;
+	uint64_t epoch;
+	// written by everyone
+	size_t memory __attribute__((aligned(LINE)));
+	// the rest belongs to the cleaner
+	pthread_mutex_t lock __attribute__((aligned(LINE)));
+	Creader *readers;
+	Centry *retired;
+	Centry **heap;
+	size_t heaped, heapmax;
+	size_t limit;
+	void (*release)(void *data);
+	Cstats stats;
+	uint8_t sipkey[16];
+	Stripe stripe[STRIPES];
+};
+
+// aligned_alloc() is C11 but we are gnu99
+//
+static void *
+line_alloc(size_t size) {
+	void *ptr = NULL;
+	errno = posix_memalign(&ptr, LINE, size);
+	return(ptr);
+}
+
+static inline Stripe *
+stripe(Cache *c, const char *name, size_t len) {
+	uint64_t h;
+	siphash((void *)&h, (const void *)name, len, c->sipkey);
+	return(&c->stripe[h % STRIPES]);
+}
+
+static void
+entry_free(Cache *c, Centry *e) {
+	if(c->release != NULL)
+		c->release(e->data);
+	free(e->name);
+	free(e);
+}
+
+// An entry that has left the cache is freed by the cleaner after the
+// next grace period.
+//
+static void
+retire(Cache *c, Centry **list, Centry *e) {
+	__atomic_sub_fetch(&c->memory, e->cost, __ATOMIC_RELAXED);
+	e->next = *list;
+	*list = e;
+}
+
+////////////////////////////////////////////////////////////////////////
+//
+//  ___ _ __  _ __ _  _   __ _ _  _ ___ _  _ ___
+// / -_) '_ \| '_ \ || | / _` | || / -_) || / -_)
+// \___| .__/| .__/\_, | \__, |\_,_\___|\_,_\___|
+//     |_|   |_|   |__/     |_|
+//
+// Entries in the trie are kept in a binary heap ordered by expiry time.
+
+static void
+heap_set(Cache *c, size_t i, Centry *e) {
+	c->heap[i] = e;
+	e->heap = i;
+}
+
+static void
+heap_up(Cache *c, size_t i) {
+	Centry *e = c->heap[i];
+	while(i > 0) {
+		size_t p = (i - 1) / 2;
+		if(c->heap[p]->expires <= e->expires)
+			break;
+		heap_set(c, i, c->heap[p]);
+		i = p;
+	}
+	heap_set(c, i, e);
+}
+
+static void
+heap_down(Cache *c, size_t i) {
+	Centry *e = c->heap[i];
+	for(;;) {
+		size_t k = i * 2 + 1;
+		if(k >= c->heaped)
+			break;
+		if(k + 1 < c->heaped &&
+		   c->heap[k + 1]->expires < c->heap[k]->expires)
+			k++;
+		if(e->expires <= c->heap[k]->expires)
+			break;
+		heap_set(c, i, c->heap[k]);
+		i = k;
+	}
+	heap_set(c, i, e);
+}
+
+// Make room for an entry before adding it to the trie, so that
+// heap_insert() can't fail.
+//
+static bool
+heap_reserve(Cache *c) {
+	if(c->heaped < c->heapmax)
+		return(true);
+	size_t max = c->heapmax * 2 + 64;
+	Centry **heap = realloc(c->heap, sizeof(*heap) * max);
+	if(heap == NULL)
+		return(false);
+	c->heap = heap;
+	c->heapmax = max;
+	return(true);
+}
+
+static void
+heap_insert(Cache *c, Centry *e) {
+	heap_set(c, c->heaped++, e);
+	heap_up(c, e->heap);
+}
+
+static void
+heap_remove(Cache *c, Centry *e) {
+	Centry *last = c->heap[--c->heaped];
+	if(last == e)
+		return;
+	heap_set(c, e->heap, last);
+	heap_down(c, last->heap);
+	heap_up(c, last->heap);
+}
+
+////////////////////////////////////////////////////////////////////////
+//                _
+//  _ _ ___ __ _ __| |___ _ _ ___
+// | '_/ -_) _` / _` / -_) '_(_-<
+// |_| \___\__,_\__,_\___|_| /__/
+//
+
+Creader *
+cache_reader(Cache *c) {
+	Creader *r = line_alloc(sizeof(*r));
+	if(r == NULL)
+		return(NULL);
+	r->epoch = 0;
+	r->cache = c;
+	pthread_mutex_lock(&c->lock);
+	r->next = c->readers;
+	c->readers = r;
+	pthread_mutex_unlock(&c->lock);
+	return(r);
+}
+
+void
+cache_reader_free(Creader *r) {
+	Cache *c = r->cache;
+	pthread_mutex_lock(&c->lock);
+	for(Creader **p = &c->readers; *p != NULL; p = &(*p)->next) {
+		if(*p == r) {
+			*p = r->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&c->lock);
+	free(r);
+}
+
+// The reader's epoch must be visible to the cleaner before the reader
+// loads the trie pointer, hence the sequentially consistent store here
+// and load in cache_get().
+//
+void
+cache_enter(Creader *r) {
+	uint64_t epoch = __atomic_load_n(&r->cache->epoch, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&r->epoch, epoch, __ATOMIC_SEQ_CST);
+}
+
+void
+cache_leave(Creader *r) {
+	__atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+// After a new version of the trie has been published, wait for every
+// reader that might be using an older version to finish.
+//
+static void
+synchronize(Cache *c) {
+	uint64_t epoch = __atomic_add_fetch(&c->epoch, 1, __ATOMIC_SEQ_CST);
+	for(Creader *r = c->readers; r != NULL; r = r->next) {
+		for(;;) {
+			uint64_t e = __atomic_load_n(&r->epoch, __ATOMIC_SEQ_CST);
+			if(e == 0 || e >= epoch)
+				break;
+			sched_yield();
+		}
+	}
+}
+
+static bool
+found(void *val, time_t now, void **pdata) {
+	Centry *e = val;
+	if(e->expires <= now)
+		return(false);
+	*pdata = e->data;
+	return(true);
+}
+
+// A staged entry is newer than any entry for the same name in the trie,
+// so look in the staging area first, unless the stripe is empty. If the
+// name is not staged, any entry that was merged before we looked is in
+// the version of the trie that we load afterwards.
+//
+bool
+cache_get(Creader *r, const char *name, time_t now, void **pdata) {
+	Cache *c = r->cache;
+	size_t len = strlen(name);
+	const char *key = NULL;
+	void *val = NULL;
+	Stripe *s = stripe(c, name, len);
+	if(__atomic_load_n(&s->staged, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&s->lock);
+		bool staged = Tgetkv(s->tbl, name, len, &key, &val);
+		bool ok = staged && found(val, now, pdata);
+		pthread_mutex_unlock(&s->lock);
+		if(staged)
+			return(ok);
+	}
+	Tbl *trie = __atomic_load_n(&c->trie, __ATOMIC_SEQ_CST);
+	return(Tgetkv(trie, name, len, &key, &val) && found(val, now, pdata));
+}
+
+////////////////////////////////////////////////////////////////////////
+//           _ _
+// __ __ ___ _(_) |_ ___ _ _ ___
+// \ V  V / '_| |  _/ -_) '_(_-<
+//  \_/\_/|_| |_|\__\___|_| /__/
+//
+
+bool
+cache_put(Cache *c, const char *name, void *data, size_t size,
+	  time_t expires) {
+	size_t len = strlen(name);
+	if(len > MAXNAME) {
+		errno = EINVAL;
+		return(false);
+	}
+	Centry *e = malloc(sizeof(*e));
+	if(e == NULL)
+		return(false);
+	e->name = malloc(len + 1);
+	if(e->name == NULL) {
+		free(e);
+		return(false);
+	}
+	memcpy(e->name, name, len + 1);
+	e->data = data;
+	e->cost = sizeof(*e) + len + 1 + size;
+	e->expires = expires;
+	e->heap = 0;
+	e->merged = false;
+	e->next = NULL;
+	// Count the entry before it is visible to the cleaner, which
+	// might evict it as soon as we unlock the stripe.
+	__atomic_add_fetch(&c->memory, e->cost, __ATOMIC_RELAXED);
+	Stripe *s = stripe(c, name, len);
+	pthread_mutex_lock(&s->lock);
+	// Remove any old entry first, so that the leaf points to the new
+	// entry's copy of the name. If the old entry has been merged it
+	// belongs to the trie, and it is only waiting to be unstaged.
+	const char *key = NULL;
+	void *old = NULL;
+	s->tbl = Tdelkv(s->tbl, name, len, &key, &old);
+	if(old != NULL && !((Centry *)old)->merged)
+		retire(c, &s->retired, old);
+	Tbl *tbl = Tsetl(s->tbl, e->name, len, e);
+	if(tbl != NULL)
+		s->tbl = tbl;
+	__atomic_store_n(&s->staged, s->tbl != NULL, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&s->lock);
+	if(tbl == NULL) {
+		__atomic_sub_fetch(&c->memory, e->cost, __ATOMIC_RELAXED);
+		free(e->name);
+		free(e);
+		return(false);
+	}
+	return(true);
+}
+
+////////////////////////////////////////////////////////////////////////
+//       _
+//  __| |___ __ _ _ _  ___ _ _
+// / _| / -_) _` | ' \/ -_) '_|
+// \__|_\___\__,_|_||_\___|_|
+//
+
+// Fold the live entries from a stripe of the staging area into the trie.
+//
+static bool
+merge(Cache *c, Ttxn *txn, Stripe *s, time_t now) {
+	const char *name = NULL;
+	size_t len = 0;
+	void *val = NULL;
+	while(Tnextl(s->tbl, &name, &len, &val)) {
+		Centry *e = val;
+		if(e->merged || e->expires <= now)
+			continue;
+		if(!heap_reserve(c))
+			return(false);
+		const char *key = NULL;
+		void *old = NULL;
+		if(!Txdelkv(txn, e->name, len, &key, &old))
+			return(false);
+		if(old != NULL) {
+			heap_remove(c, old);
+			retire(c, &c->retired, old);
+		}
+		if(!Txsetl(txn, e->name, len, e))
+			return(false);
+		heap_insert(c, e);
+		e->merged = true;
+		c->stats.merged++;
+	}
+	return(true);
+}
+
+// Remove an entry from the trie.
+//
+static bool
+evict(Cache *c, Ttxn *txn, Centry *e) {
+	const char *key = NULL;
+	void *val = NULL;
+	if(!Txdelkv(txn, e->name, strlen(e->name), &key, &val))
+		return(false);
+	heap_remove(c, e);
+	retire(c, &c->retired, e);
+	return(true);
+}
+
+// After the trie has been published, remove entries from a stripe of
+// the staging area that have been merged or that have expired, or all
+// of them if the cache is being destroyed. We can only delete a key
+// from the stripe after Tnextl() has moved past it.
+//
+static void
+unstage(Cache *c, Stripe *s, time_t now, bool all) {
+	const char *name = NULL;
+	size_t len = 0;
+	void *val = NULL;
+	Centry *prev = NULL;
+	bool more;
+	do {
+		more = Tnextl(s->tbl, &name, &len, &val);
+		if(prev != NULL) {
+			const char *key = NULL;
+			void *old = NULL;
+			s->tbl = Tdelkv(s->tbl, prev->name,
+					strlen(prev->name), &key, &old);
+			if(!prev->merged)
+				retire(c, &c->retired, prev);
+			prev = NULL;
+		}
+		if(more) {
+			Centry *e = val;
+			if(all || e->merged || e->expires <= now)
+				prev = e;
+		}
+	} while(more);
+	__atomic_store_n(&s->staged, s->tbl != NULL, __ATOMIC_RELEASE);
+	while(s->retired != NULL) {
+		Centry *e = s->retired;
+		s->retired = e->next;
+		e->next = c->retired;
+		c->retired = e;
+	}
+}
+
+bool
+cache_clean(Cache *c, time_t now) {
+	pthread_mutex_lock(&c->lock);
+	Ttxn *txn = Tbegin(c->trie);
+	if(txn == NULL) {
+		pthread_mutex_unlock(&c->lock);
+		return(false);
+	}
+	// If we run out of memory we stop making changes, but the
+	// transaction is still consistent so we commit what we have.
+	bool ok = true;
+	for(size_t i = 0; ok && i < STRIPES; i++) {
+		Stripe *s = &c->stripe[i];
+		pthread_mutex_lock(&s->lock);
+		ok = merge(c, txn, s, now);
+		pthread_mutex_unlock(&s->lock);
+	}
+	while(ok && c->heaped > 0 && c->heap[0]->expires <= now) {
+		ok = evict(c, txn, c->heap[0]);
+		c->stats.expired += ok;
+	}
+	while(ok && c->heaped > 0 &&
+	      __atomic_load_n(&c->memory, __ATOMIC_RELAXED) > c->limit) {
+		ok = evict(c, txn, c->heap[0]);
+		c->stats.evicted += ok;
+	}
+	int err = errno;
+	__atomic_store_n(&c->trie, Tcommit(txn), __ATOMIC_SEQ_CST);
+	for(size_t i = 0; i < STRIPES; i++) {
+		Stripe *s = &c->stripe[i];
+		pthread_mutex_lock(&s->lock);
+		unstage(c, s, now, false);
+		pthread_mutex_unlock(&s->lock);
+	}
+	synchronize(c);
+	Treclaim(txn);
+	while(c->retired != NULL) {
+		Centry *e = c->retired;
+		c->retired = e->next;
+		entry_free(c, e);
+	}
+	c->stats.cleans++;
+	pthread_mutex_unlock(&c->lock);
+	errno = err;
+	return(ok);
+}
+
+void
+cache_stats(Cache *c, Cstats *stats) {
+	pthread_mutex_lock(&c->lock);
+	*stats = c->stats;
+	stats->entries = c->heaped;
+	stats->memory = __atomic_load_n(&c->memory, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&c->lock);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+Cache *
+cache_create(size_t limit, void (*release)(void *data)) {
+	Cache *c = line_alloc(sizeof(*c));
+	if(c == NULL)
+		return(NULL);
+	memset(c, 0, sizeof(*c));
+	if(getentropy(c->sipkey, sizeof(c->sipkey)) < 0) {
+		free(c);
+		return(NULL);
+	}
+	c->epoch = 1;
+	c->limit = limit;
+	c->release = release;
+	pthread_mutex_init(&c->lock, NULL);
+	for(size_t i = 0; i < STRIPES; i++)
+		pthread_mutex_init(&c->stripe[i].lock, NULL);
+	return(c);
+}
+
+// There must be no other threads using the cache.
+//
+void
+cache_destroy(Cache *c) {
+	for(size_t i = 0; i < STRIPES; i++) {
+		unstage(c, &c->stripe[i], 0, true);
+		pthread_mutex_destroy(&c->stripe[i].lock);
+	}
+	while(c->heaped > 0) {
+		Centry *e = c->heap[0];
+		c->trie = Tdel(c->trie, e->name);
+		heap_remove(c, e);
+		retire(c, &c->retired, e);
+	}
+	while(c->retired != NULL) {
+		Centry *e = c->retired;
+		c->retired = e->next;
+		entry_free(c, e);
+	}
+	while(c->readers != NULL) {
+		Creader *r = c->readers;
+		c->readers = r->next;
+		free(r);
+	}
+	pthread_mutex_destroy(&c->lock);
+	free(c->heap);
+	free(c);
+}
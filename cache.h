@@ -0,0 +1,70 @@
+// cache.h: a DNS resolver cache built on a copy-on-write DNS-trie
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This is an experiment with the design in notes-concurrency.md.
+//
+// Most of the cache is a DNS-trie which readers search without locking.
+// New entries are only ever added to a staging area, so resolver
+// threads do not need to wait for the trie. The staging area is a hash
+// table divided into independently locked stripes, each of which is a
+// small DNS-trie. A staged entry can replace one in the trie, so a
+// search checks the staging area first, when its stripe is not empty.
+//
+// A cleaner periodically folds the staging area into the trie using a
+// copy-on-write transaction, and in the same transaction it removes
+// expired entries (in order of expiry time) and evicts entries to keep
+// within the memory limit (those that would expire soonest first). The
+// new version of the trie is published in one go, and the old version
+// and any entries that left the cache are freed after a grace period,
+// when no reader can still be using them.
+//
+// Times can be in any unit, provided the caller is consistent.
+
+typedef struct Cache Cache;
+typedef struct Creader Creader;
+
+// Create a cache with a memory limit in bytes. The release function
+// (which may be NULL) is called for the data of each entry after it
+// has left the cache.
+//
+Cache *cache_create(size_t limit, void (*release)(void *data));
+void cache_destroy(Cache *cache);
+
+// Each reader thread needs its own handle, which the cleaner uses to
+// find out when the reader has finished with old versions of the cache.
+//
+Creader *cache_reader(Cache *cache);
+void cache_reader_free(Creader *reader);
+
+// Searches must be made between cache_enter() and cache_leave(), and
+// data returned by cache_get() remains valid until cache_leave().
+// Returns false if the name is missing or has expired.
+//
+void cache_enter(Creader *reader);
+void cache_leave(Creader *reader);
+bool cache_get(Creader *reader, const char *name, time_t now, void **pdata);
+
+// Add an entry to the cache, replacing any previous entry with the same
+// name. The cache makes a copy of the name. The size is the number of
+// bytes the data costs against the memory limit. Returns false and sets
+// errno if there is an error.
+//
+bool cache_put(Cache *cache, const char *name, void *data, size_t size,
+	       time_t expires);
+
+// Merge the staging area into the trie, then expire and evict entries.
+// Cleaners are serialized, and a cleaner waits for a grace period
+// before it returns. Returns false and sets errno if there is an error.
+//
+bool cache_clean(Cache *cache, time_t now);
+
+typedef struct Cstats {
+	size_t entries;		// in the trie
+	size_t memory;		// bytes, including the staging area
+	size_t cleans, merged, expired, evicted;
+} Cstats;
+
+void cache_stats(Cache *cache, Cstats *stats);
@@ -0,0 +1,182 @@
+#!/usr/bin/perl
+#
+# Written by Tony Finch <dot@dotat.at>
+# You may do anything with this. It has no warranty.
+# <http://creativecommons.org/publicdomain/zero/1.0/>
+
+use warnings;
+use strict;
+
+sub usage {
+	die <<EOF;
+usage: $0 <kind> <count> [<seed>]
+	Print <count> distinct synthetic keys, one per line, for
+	benchmarks that must run without the network. The output
+	depends only on the arguments. Kinds of key:
+	dns	host names in a few organizations' zones, like in-dns
+	top	registered domain names, like top-1m
+	ident	C identifiers and macro names, like in-b9
+	words	a dictionary, like /usr/share/dict/words
+	bin	short strings of arbitrary bytes (except NUL and newline)
+	path	very long file paths that share long prefixes
+EOF
+}
+
+usage unless @ARGV == 2 or @ARGV == 3;
+my $kind = shift;
+my $count = shift;
+my $seed = shift // 1;
+usage unless $count =~ m{^\d+$} and $seed =~ m{^\d+$};
+
+# xorshift32, so the output does not depend on perl's rand()
+my $state = ($seed * 2654435761 + 1) & 0xffffffff || 1;
+sub rnd {
+	$state ^= ($state << 13) & 0xffffffff;
+	$state ^= $state >> 17;
+	$state ^= ($state << 5) & 0xffffffff;
+	return $state % shift;
+}
+
+sub pick {
+	return $_[rnd scalar @_];
+}
+
+# Choose an element of a list with a Zipf-like bias towards the front.
+sub skew {
+	my $n = scalar @_;
+	return $_[int($n ** (rnd(1 << 20) / (1 << 20))) - 1];
+}
+
+# Pronounceable nonsense, so the byte frequencies look like words.
+my @onset = (qw(b c d f g h j k l m n p r s t v w z
+		bl br ch cl cr dr fl fr gr ph pl pr sh sk sl sp st str th tr),
+	     ('') x 4);
+my @vowel = (qw(a e i o u ai ea ee ie oa ou y), qw(a e i o) x 2);
+my @coda = (qw(b ck d ft g l ll m n nd ng nt p r rd rn s ss st t th x),
+	    ('') x 8);
+
+sub syllable {
+	return pick(@onset).pick(@vowel).pick(@coda);
+}
+
+sub word {
+	my $n = 1 + rnd(1 + shift);
+	return join '', map { syllable } 1 .. $n;
+}
+
+# A fixed vocabulary, so that labels and identifier parts repeat
+# with a skewed frequency, as they do in real corpora.
+my @vocab = map { word 2 } 1 .. 2000;
+
+my %done;
+sub emit {
+	my $key = shift;
+	return if $done{$key}++;
+	print "$key\n";
+	$count--;
+}
+
+my %kind;
+
+$kind{dns} = sub {
+	my @tld = qw(uk com org net edu);
+	my @org = map { join '.', word(1), word(1), pick(@tld) } 1 .. 4;
+	my @zone = (@org, map {
+		my $z = $_;
+		map { word(1).".$z" } 1 .. 3;
+	} @org);
+	my @host = qw(www mail smtp ns0 ns1 ns2 dns0 dns1 ftp
+		      vpn gw router switch printer);
+	while ($count > 0) {
+		my $z = skew @zone;
+		my $r = rnd 10;
+		if ($r < 3) {
+			emit pick(@host).".$z";
+		} elsif ($r < 6) {
+			emit skew(@vocab).".$z";
+		} elsif ($r < 8) {
+			emit skew(@vocab).'-'.rnd(100).".$z";
+		} else {
+			emit pick(@host).".".skew(@vocab).".$z";
+		}
+	}
+};
+
+$kind{top} = sub {
+	my @tld = ((qw(com) x 24), (qw(net org ru de) x 3),
+		   qw(jp uk br in it fr pl au ir info cn nl es
+		      co.uk com.br co.jp com.au gr io tv me));
+	while ($count > 0) {
+		my $r = rnd 10;
+		my $name;
+		if ($r < 5) {
+			$name = skew(@vocab).skew(@vocab);
+		} elsif ($r < 7) {
+			$name = word 3;
+		} elsif ($r < 8) {
+			$name = skew(@vocab).'-'.skew(@vocab);
+		} elsif ($r < 9) {
+			$name = skew(@vocab).rnd(1000);
+		} else {
+			$name = join '', map { chr(97 + rnd 26) } 0 .. rnd 5;
+		}
+		$name .= '.'.skew(@tld);
+		$name = pick(qw(www m blog shop mail)).".$name"
+		    if rnd(20) == 0;
+		emit $name;
+	}
+};
+
+$kind{ident} = sub {
+	my @prefix = map { word 0 } 1 .. 30;
+	while ($count > 0) {
+		my $r = rnd 10;
+		my @part = map { skew @vocab } 0 .. rnd 3;
+		if ($r < 5) {
+			emit join '_', skew(@prefix), @part;
+		} elsif ($r < 7) {
+			emit uc join '_', skew(@prefix), @part;
+		} elsif ($r < 8) {
+			emit join '', shift(@part), map { ucfirst } @part;
+		} elsif ($r < 9) {
+			emit rnd(1 << (4 * (1 + rnd 8)));
+		} else {
+			emit join '', @part;
+		}
+	}
+};
+
+$kind{words} = sub {
+	my @w;
+	while (@w < $count) {
+		my $w = rnd(4) ? skew(@vocab) : word 3;
+		$w .= pick(qw(s s ed ing er 's ly ness)) if rnd(3) == 0;
+		$w = ucfirst $w if rnd(8) == 0;
+		next if $done{$w}++;
+		push @w, $w;
+	}
+	print "$_\n" for sort @w;
+	$count = 0;
+};
+
+$kind{bin} = sub {
+	while ($count > 0) {
+		emit join '', map {
+			my $c = 1 + rnd 255;
+			$c == 10 ? "\x0b" : chr $c;
+		} 0 .. 3 + rnd 28;
+	}
+};
+
+$kind{path} = sub {
+	my @top = map { '/'.join '/', map { skew @vocab } 1 .. 8 } 1 .. 10;
+	while ($count > 0) {
+		my $p = skew @top;
+		$p .= '/'.skew(@vocab) for 0 .. 5 + rnd 20;
+		$p .= pick(qw(.c .h .o .txt .html));
+		emit $p;
+	}
+};
+
+usage unless $kind{$kind};
+$kind{$kind}->();
@@ -0,0 +1 @@
+dns-debug.c
\ No newline at end of file
@@ -116,6 +116,7 @@ static const Shift byte_to_bit[256] = {
 
 // Same again, but case-sensitive.
 //
+#ifndef WITH_CASE_FOLDING
 static const Shift case_byte_to_bit[256] = {
 	SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0,
 	SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0, SHIFT_0,
@@ -150,6 +151,7 @@ static const Shift case_byte_to_bit[256] = {
 	SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7,
 	SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7, SHIFT_7,
 };
+#endif
 
 #undef DD
 #undef LL
@@ -307,6 +309,191 @@ wire_eq(const byte *n, const byte *m) {
 	}
 }
 
+////////////////////////////////////////////////////////////////////////
+//       _          _
+//   ___(_)_ __  __| |
+//  (_-<| | '  \/ _` |
+//  /__/|_|_|_|_\__,_|
+//
+
+// Most names consist entirely of hostname characters, which map one byte
+// to one bit number without any splitting. The common characters are in
+// three contiguous runs of byte values, and within each run the bit
+// numbers are consecutive, so the mapping is just an addition. This lets
+// us classify and convert a whole vector of bytes at once, and fall back
+// to the tables above when we hit a byte that needs splitting (or a NUL
+// terminator, or a backslash escape).
+//
+// The runs are hyphen, dot, slash, and digits; underscore, backquote,
+// and lower case letters; and upper case letters when we are folding
+// case.
+
+#define DD(byte) (SHIFT_DIGIT  + byte - '0')
+#define LL(byte) (SHIFT_LETTER + byte - 'a')
+
+typedef char static_assert_hyphen_to_nine_is_contiguous
+	[SHYPHEN == DD('-') && SHIFDOT == DD('.') && SHSLASH == DD('/')
+	 ? 1 : -1];
+
+typedef char static_assert_underbar_to_z_is_contiguous
+	[UNDERBAR == LL('_') && BACKQUO == LL('`') ? 1 : -1];
+
+#if defined(__AVX2__) && !defined(WITHOUT_SIMD)
+
+#include <immintrin.h>
+
+#define SIMD_WIDTH 32
+typedef __m256i simd;
+#define simd_load(p)	_mm256_loadu_si256((const simd *)(p))
+#define simd_store(p,v)	_mm256_storeu_si256((simd *)(p), (v))
+#define simd_splat(b)	_mm256_set1_epi8((char)(b))
+#define simd_add	_mm256_add_epi8
+#define simd_min	_mm256_min_epu8
+#define simd_eq		_mm256_cmpeq_epi8
+#define simd_and	_mm256_and_si256
+#define simd_or		_mm256_or_si256
+#define simd_mask(v)	((uint32_t)_mm256_movemask_epi8(v))
+
+#elif defined(__SSE2__) && !defined(WITHOUT_SIMD)
+
+#include <emmintrin.h>
+
+#define SIMD_WIDTH 16
+typedef __m128i simd;
+#define simd_load(p)	_mm_loadu_si128((const simd *)(p))
+#define simd_store(p,v)	_mm_storeu_si128((simd *)(p), (v))
+#define simd_splat(b)	_mm_set1_epi8((char)(b))
+#define simd_add	_mm_add_epi8
+#define simd_min	_mm_min_epu8
+#define simd_eq		_mm_cmpeq_epi8
+#define simd_and	_mm_and_si128
+#define simd_or		_mm_or_si128
+#define simd_mask(v)	((uint32_t)_mm_movemask_epi8(v))
+
+#endif
+
+#ifdef SIMD_WIDTH
+
+// Set each byte to 0xFF if it is in the range lo..hi, or zero otherwise.
+//
+static inline simd
+simd_range(simd v, byte lo, byte hi) {
+	simd d = simd_add(v, simd_splat(-lo));
+	return(simd_eq(simd_min(d, simd_splat(hi - lo)), d));
+}
+
+// Can we load a whole vector from the name and store a whole vector into
+// the key? The name can end anywhere, so we must not let the load cross
+// into a page that might not be mapped.
+//
+static inline bool
+simd_ok(const byte *name, size_t off) {
+	return(off + SIMD_WIDTH <= sizeof(Key) &&
+	       (uintptr_t)name % 4096 <= 4096 - SIMD_WIDTH);
+}
+
+// Convert a run of up to len common characters at the start of the name.
+// Returns the number of bytes converted, which is also the number of
+// bit numbers added to the key. Bit numbers are stored after that
+// point, but they are junk.
+//
+static inline size_t
+simd_to_key(const byte *name, size_t len, Shift *key, bool fold) {
+	simd v = simd_load(name);
+	simd m1 = simd_range(v, '-', '9');
+	simd m2 = simd_range(v, '_', 'z');
+	simd k = simd_or(simd_and(m1, simd_add(v, simd_splat(DD(0)))),
+			 simd_and(m2, simd_add(v, simd_splat(LL(0)))));
+	simd m = simd_or(m1, m2);
+	if(fold) {
+		simd m3 = simd_range(v, 'A', 'Z');
+		k = simd_or(k, simd_and(m3, simd_add(v,
+			simd_splat(LL(0) + 'a' - 'A'))));
+		m = simd_or(m, m3);
+	}
+	simd_store(key, k);
+	// the mask is zero-extended, which stops the count at the end
+	size_t n = (size_t)__builtin_ctzll(~(uint64_t)simd_mask(m));
+	return(n < len ? n : len);
+}
+
+#else
+
+#define SIMD_WIDTH 0
+
+static inline bool
+simd_ok(const byte *name, size_t off) {
+	(void)name, (void)off;
+	return(false);
+}
+
+static inline size_t
+simd_to_key(const byte *name, size_t len, Shift *key, bool fold) {
+	(void)name, (void)len, (void)key, (void)fold;
+	return(0);
+}
+
+#endif
+
+#undef DD
+#undef LL
+
+// Are two presentation format domain names equal?
+//
+// With case folding, the trie treats names that differ only in the case
+// of ASCII letters as the same key, like wire_eq(), and each leaf keeps
+// the spelling of the name that was first inserted. So that 0x20 mixed
+// case queries are no slower, we compare a vector at a time when we can.
+//
+#ifdef WITH_CASE_FOLDING
+
+static inline bool
+text_eq(const char *n, const char *m) {
+#if SIMD_WIDTH > 0
+	while((uintptr_t)n % 4096 <= 4096 - SIMD_WIDTH &&
+	      (uintptr_t)m % 4096 <= 4096 - SIMD_WIDTH) {
+		simd a = simd_load(n);
+		simd b = simd_load(m);
+		simd lower = simd_splat('a' - 'A');
+		a = simd_or(a, simd_and(simd_range(a, 'A', 'Z'), lower));
+		b = simd_or(b, simd_and(simd_range(b, 'A', 'Z'), lower));
+		uint64_t ne = simd_mask(simd_eq(a, b)) ^
+			((UINT64_C(1) << SIMD_WIDTH) - 1);
+		uint64_t nul = simd_mask(simd_eq(a, simd_splat(0)));
+		if(ne | nul)
+			return(!(ne >> __builtin_ctzll(ne | nul) & 1));
+		n += SIMD_WIDTH;
+		m += SIMD_WIDTH;
+	}
+#endif
+	for(;; n++, m++) {
+		byte nc = (byte)*n;
+		byte mc = (byte)*m;
+		if(nc != mc) {
+			if('A' <= nc && nc <= 'Z') nc += 'a' - 'A';
+			if('A' <= mc && mc <= 'Z') mc += 'a' - 'A';
+			if(nc != mc) return(false);
+		} else if(nc == '\0') {
+			return(true);
+		}
+	}
+}
+
+#define TEXT_FOLD true
+#define text_byte_to_bit byte_to_bit
+
+#else
+
+static inline bool
+text_eq(const char *n, const char *m) {
+	return(strcmp(n, m) == 0);
+}
+
+#define TEXT_FOLD false
+#define text_byte_to_bit case_byte_to_bit
+
+#endif
+
 #define ISDIGIT(c) ('0' <= (c) && (c) <= '9')
 
 // Convert a presentation format domain name into a trie lookup key
@@ -316,7 +503,7 @@ wire_eq(const byte *n, const byte *m) {
 // existing test and benchmark harness, and get a reasonable idea of how
 // well this works...
 //
-static size_t
+size_t
 stdtext_to_key(const byte *name, Key key) {
 	uint16_t lpos[128];
 	uint16_t lend[128];
@@ -348,6 +535,14 @@ stdtext_to_key(const byte *name, Key key) {
 		i = lpos[label];
 		j = lend[label];
 		while(i < j) {
+			if(simd_ok(name + i, off)) {
+				size_t n = simd_to_key(name + i, j - i,
+						       key + off, true);
+				i += n;
+				off += n;
+				if(n == SIMD_WIDTH || i == j)
+					continue;
+			}
 			byte ch;
 			if(name[i] != '\\') {
 				ch = name[i++];
@@ -374,27 +569,96 @@ stdtext_to_key(const byte *name, Key key) {
 	return(off);
 }
 
-// Convert a presentation format domain name into a trie lookup key
-// (in non-standard case-sensitive left-to-right order).
+// Convert part of a presentation format domain name into a trie lookup
+// key (in non-standard left-to-right order, case-sensitive unless we are
+// folding case), starting at
+// offset off in the key. We stop after a vector of common characters or
+// a run of split bytes. Returns the new length of the key, and advances
+// *pname past the bytes that were converted.
 //
-// This should produce exactly equal output to other trie implementations.
-//
-static size_t
-text_to_key(const byte *name, Key key) {
-	size_t off = 0;
-	while(*name != '\0') {
+static inline size_t
+text_to_key_step(const byte **pname, Key key, size_t off) {
+	const byte *name = *pname;
+	if(simd_ok(name, off)) {
+		size_t n = simd_to_key(name, SIMD_WIDTH, key + off, TEXT_FOLD);
+		name += n;
+		off += n;
+		if(n == SIMD_WIDTH || *name == '\0') {
+			*pname = name;
+			return(off);
+		}
+	}
+	// Stay on the slow path for a run of split bytes, so that we
+	// don't try a vector for every one of them.
+	byte bit;
+	do {
 		byte ch = *name++;
-		byte bit = case_byte_to_bit[ch];
+		bit = text_byte_to_bit[ch];
 		assert(off < sizeof(Key));
 		key[off++] = bit;
 		if(byte_is_split(bit))
 			key[off++] = split_to_bit(ch);
-	}
+	} while(byte_is_split(bit) && *name != '\0');
+	*pname = name;
+	return(off);
+}
+
+// Convert a presentation format domain name into a trie lookup key
+// (in non-standard left-to-right order).
+//
+// Unless we are folding case, this should produce exactly equal output
+// to other trie implementations.
+//
+size_t
+text_to_key(const byte *name, Key key) {
+	size_t off = 0;
+	while(*name != '\0')
+		off = text_to_key_step(&name, key, off);
 	// terminator
 	key[off] = SHIFT_NOBYTE;
 	return(off);
 }
 
+// A lazily converted lookup key.
+//
+// A successful search only looks at the parts of the key at the offsets
+// of the branches it passes through, and the rest of the name is checked
+// by comparing it with the leaf. So we convert the name a step at a time
+// as the search reaches deeper offsets, and if there is a second descent
+// it re-uses what was converted during the first.
+//
+typedef struct Lazy {
+	const byte *name;	// the rest of the name to be converted
+	size_t len;		// length of the key converted so far
+	Key key;
+} Lazy;
+
+static inline void
+lazy_init(Lazy *k, const void *name) {
+	k->name = name;
+	k->len = 0;
+#ifdef WITHOUT_LAZY_KEYS
+	k->len = text_to_key(k->name, k->key);
+	k->name += strlen(name);
+#endif
+}
+
+// Get the bit number at an offset in the key, converting more of the
+// name if necessary. Past the end of the key there is no byte.
+//
+static inline Shift
+lazy_at(Lazy *k, size_t off) {
+	while(off >= k->len && *k->name != '\0')
+		k->len = text_to_key_step(&k->name, k->key, k->len);
+	if(off < k->len) return(k->key[off]);
+	else return(SHIFT_NOBYTE);
+}
+
+static inline Shift
+lazybit(Node *n, Lazy *k) {
+	return(lazy_at(k, keyoff(n)));
+}
+
 ////////////////////////////////////////////////////////////////////////
 //   _        _    _         _   ___ ___
 //  | |_ __ _| |__| |___    /_\ | _ \_ _|
@@ -406,46 +670,326 @@ extern bool
 Tgetkv(Tbl *tbl, const char *name, size_t len, const char **pname, void **pval) {
 	if(tbl == NULL)
 		return(false);
+	(void)len; // we use the NUL terminator instead
 	Node *n = &tbl->root;
-	Key key;
-	len = text_to_key((const byte *)name, key);
+	Lazy key;
+	lazy_init(&key, name);
 	while(isbranch(n)) {
 		__builtin_prefetch(n->ptr);
-		Shift bit = twigbit(n, key, len);
+		Shift bit = lazybit(n, &key);
 		if(!hastwig(n, bit))
 			return(false);
 		n = twig(n, twigoff(n, bit));
 	}
-	if(strcmp(name, n->ptr) != 0) /////
+	if(!text_eq(name, n->ptr))
 		return(false);
 	*pname = n->ptr;
 	*pval = (void *)n->index;
 	return(true);
 }
 
+// All the keys in a subtrie are the same up to the branch's offset, so
+// a leaf hanging off a branch's NOBYTE twig is a prefix of the name if
+// the name matches the leaf at the end of the search up to that offset.
+// We note these candidates on the way down, then choose the deepest one
+// that is short enough.
+//
+extern bool
+Tgetprefix(Tbl *tbl, const char *name, size_t len,
+	   const char **pname, void **pval) {
+	if(tbl == NULL)
+		return(false);
+	(void)len; // we use the NUL terminator instead
+	Node *cand[sizeof(Key)];	// branches with NOBYTE twigs
+	size_t cands = 0;
+	Node *n = &tbl->root;
+	Lazy key;
+	lazy_init(&key, name);
+	while(isbranch(n)) {
+		__builtin_prefetch(n->ptr);
+		if(hastwig(n, SHIFT_NOBYTE))
+			cand[cands++] = n;
+		n = twig(n, neartwig(n, lazybit(n, &key)));
+	}
+	Lazy leaf;
+	lazy_init(&leaf, n->ptr);
+	size_t off;
+	Shift bit;
+	for(off = 0;; off++) {
+		bit = lazy_at(&leaf, off);
+		if(bit != lazy_at(&key, off) || bit == SHIFT_NOBYTE)
+			break;
+	}
+	// Is the leaf itself a prefix?
+	if(bit == SHIFT_NOBYTE) {
+		*pname = n->ptr;
+		*pval = (void *)n->index;
+		return(true);
+	}
+	// A candidate's key ends at the offset of its parent branch.
+	while(cands > 0) {
+		n = cand[--cands];
+		if(keyoff(n) <= off) {
+			n = twig(n, 0);
+			*pname = n->ptr;
+			*pval = (void *)n->index;
+			return(true);
+		}
+	}
+	return(false);
+}
+
+// Copy-on-write transactions.
+//
+// A transaction has a private copy of the root node. The first time
+// that a branch on the path to a change is touched, its twigs are
+// copied, and the branch is marked with the COW bit to say that its
+// twigs are now private and can be modified in place. The superseded
+// twigs are kept on a garbage list, because readers of the original
+// table can still be using them. Private twigs are only reachable via
+// marked branches, so we can find them again when the transaction is
+// committed (to clear the marks) or aborted (to free them).
+//
+// When there is no transaction (txn == NULL) the table is modified in
+// place.
+//
+// With -DWITH_SNAPSHOTS, twig arrays can instead be shared between
+// snapshots of the table, and have reference counts in a header word
+// in front of them, in the same way as qp.c. Every change copies the
+// shared twigs on its path, so the COW marks are not used.
+//
+struct Ttxn {
+	Tbl *tbl;
+	size_t count, max;
+	void **garbage;
+};
+
+static inline bool
+iscow(Node *n) {
+	return(n->index & W1 << SHIFT_COW);
+}
+
+static bool
+cow_garbage(Ttxn *txn, void *ptr) {
+	if(txn->count == txn->max) {
+		size_t max = txn->max * 2 + 16;
+		void **garbage = realloc(txn->garbage, sizeof(void *) * max);
+		if(garbage == NULL) return(false);
+		txn->garbage = garbage;
+		txn->max = max;
+	}
+	txn->garbage[txn->count++] = ptr;
+	return(true);
+}
+
+#ifdef WITH_SNAPSHOTS
+
+static inline uint64_t *
+twigrefs(Node *twigs) {
+	return((uint64_t *)twigs - 1);
+}
+
+static Node *
+twigalloc(Weight m) {
+	uint64_t *refs = malloc(sizeof(*refs) + sizeof(Node) * m);
+	if(refs == NULL)
+		return(NULL);
+	*refs = 1;
+	return((Node *)(refs + 1));
+}
+
+static Node *
+twigrealloc(Node *twigs, Weight m) {
+	uint64_t *refs = realloc(twigrefs(twigs), sizeof(*refs) + sizeof(Node) * m);
+	return(refs == NULL ? NULL : (Node *)(refs + 1));
+}
+
+static void
+twigfree(Node *twigs) {
+	if(twigs != NULL)
+		free(twigrefs(twigs));
+}
+
+static void
+incref(Node *n) {
+	if(isbranch(n))
+		__atomic_add_fetch(twigrefs(n->ptr), 1, __ATOMIC_RELAXED);
+}
+
+static void
+decref(Node *n) {
+	if(!isbranch(n))
+		return;
+	Node *twigs = n->ptr;
+	if(__atomic_sub_fetch(twigrefs(twigs), 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	Weight m = twigmax(n);
+	for(Weight i = 0; i < m; i++)
+		decref(&twigs[i]);
+	twigfree(twigs);
+}
+
+// Do changes outside a transaction need to copy twigs?
+//
+static inline bool
+cowing(Ttxn *txn) {
+	(void)txn;
+	return(true);
+}
+
+// Ensure a branch's twigs can be modified in place.
+//
+static bool
+cow_twigs(Ttxn *txn, Node *n) {
+	(void)txn;
+	if(__atomic_load_n(twigrefs(n->ptr), __ATOMIC_ACQUIRE) == 1)
+		return(true);
+	Weight m = twigmax(n);
+	Node *twigs = twigalloc(m);
+	if(twigs == NULL) return(false);
+	memcpy(twigs, n->ptr, sizeof(Node) * m);
+	for(Weight i = 0; i < m; i++)
+		incref(&twigs[i]);
+	decref(n);
+	n->ptr = twigs;
+	return(true);
+}
+
 Tbl *
-Tdelkv(Tbl *tbl, const char *name, size_t len, const char **pname, void **pval) {
+Tsnapshot(Tbl *tbl) {
 	if(tbl == NULL)
 		return(NULL);
+	Tbl *snap = malloc(sizeof(*snap));
+	if(snap == NULL)
+		return(NULL);
+	*snap = *tbl;
+	incref(&snap->root);
+	return(snap);
+}
+
+void
+Trelease(Tbl *tbl) {
+	if(tbl == NULL)
+		return;
+	decref(&tbl->root);
+	free(tbl);
+}
+
+#else
+
+static inline Node *
+twigalloc(Weight m) {
+	return(malloc(sizeof(Node) * m));
+}
+
+static inline Node *
+twigrealloc(Node *twigs, Weight m) {
+	return(realloc(twigs, sizeof(Node) * m));
+}
+
+static inline void
+twigfree(Node *twigs) {
+	free(twigs);
+}
+
+static inline bool
+cowing(Ttxn *txn) {
+	return(txn != NULL);
+}
+
+// Ensure a branch's twigs can be modified in place.
+//
+static bool
+cow_twigs(Ttxn *txn, Node *n) {
+	if(txn == NULL || iscow(n))
+		return(true);
+	Weight m = twigmax(n);
+	Node *twigs = twigalloc(m);
+	if(twigs == NULL) return(false);
+	if(!cow_garbage(txn, n->ptr)) {
+		twigfree(twigs);
+		return(false);
+	}
+	memcpy(twigs, n->ptr, sizeof(Node) * m);
+	n->ptr = twigs;
+	n->index |= W1 << SHIFT_COW;
+	return(true);
+}
+
+#endif
+
+// Walk down to the key's leaf, making the path to it private. Returns
+// the leaf and sets *pp to its parent, or returns NULL if we ran out of
+// memory. The key must be in the table.
+//
+static Node *
+cow_path(Ttxn *txn, Tbl *tbl, Lazy *key, Node **pp) {
 	Node *n = &tbl->root, *p = NULL;
-	Key key;
-	len = text_to_key((const byte *)name, key);
+	while(isbranch(n)) {
+		if(!cow_twigs(txn, n))
+			return(NULL);
+		p = n; n = twig(n, twigoff(n, lazybit(n, key)));
+	}
+	*pp = p;
+	return(n);
+}
+
+#ifndef WITH_SNAPSHOTS
+
+// Clear the COW marks when committing a transaction.
+//
+static void
+cow_clear(Node *n) {
+	if(!isbranch(n) || !iscow(n))
+		return;
+	n->index &= ~(W1 << SHIFT_COW);
+	Weight m = twigmax(n);
+	for(Weight i = 0; i < m; i++)
+		cow_clear(twig(n, i));
+}
+
+// Free the private twigs when aborting a transaction.
+//
+static void
+cow_free(Node *n) {
+	if(!isbranch(n) || !iscow(n))
+		return;
+	Weight m = twigmax(n);
+	for(Weight i = 0; i < m; i++)
+		cow_free(twig(n, i));
+	free(n->ptr);
+}
+
+#endif
+
+static Tbl *
+delkv(Ttxn *txn, Tbl *tbl, const char *name, const char **pname, void **pval) {
+	if(tbl == NULL)
+		return(NULL);
+	Node *n = &tbl->root, *p = NULL;
+	Lazy key;
+	lazy_init(&key, name);
 	Shift bit = 0;
 	while(isbranch(n)) {
 		__builtin_prefetch(n->ptr);
-		bit = twigbit(n, key, len);
+		bit = lazybit(n, &key);
 		if(!hastwig(n, bit))
 			return(tbl);
 		p = n; n = twig(n, twigoff(n, bit));
 	}
-	if(strcmp(name, n->ptr) != 0) /////
+	if(!text_eq(name, n->ptr))
 		return(tbl);
-	*pname = n->ptr;
-	*pval = (void *)n->index;
 	if(p == NULL) {
+		*pname = n->ptr;
+		*pval = (void *)n->index;
 		free(tbl);
 		return(NULL);
 	}
+	// The key is present, so now we can copy the path to it.
+	if(cowing(txn) && cow_path(txn, tbl, &key, &p) == NULL)
+		return(NULL);
+	*pname = n->ptr;
+	*pval = (void *)n->index;
 	n = p; p = NULL; // Because n is the usual name
 	assert(bit != 0);
 	Weight s = twigoff(n, bit);
@@ -454,7 +998,7 @@ Tdelkv(Tbl *tbl, const char *name, size_t len, const char **pname, void **pval)
 	if(m == 2) {
 		// Move the other twig to the parent branch.
 		*n = *twig(n, !s);
-		free(twigs);
+		twigfree(twigs);
 		return(tbl);
 	}
 	memmove(twigs+s, twigs+s+1, sizeof(Node) * (m - s - 1));
@@ -462,20 +1006,13 @@ Tdelkv(Tbl *tbl, const char *name, size_t len, const char **pname, void **pval)
 	// We have now correctly removed the twig from the trie, so if
 	// realloc() fails we can ignore it and continue to use the
 	// slightly oversized twig array.
-	twigs = realloc(twigs, sizeof(Node) * (m - 1));
+	twigs = twigrealloc(twigs, m - 1);
 	if(twigs != NULL) n->ptr = twigs;
 	return(tbl);
 }
 
-Tbl *
-Tsetl(Tbl *tbl, const char *name, size_t len, void *val) {
-	// Ensure flag bits are zero.
-	if(((word)val & MASK_FLAGS) != 0) {
-		errno = EINVAL;
-		return(NULL);
-	}
-	if(val == NULL)
-		return(Tdell(tbl, name, len));
+static Tbl *
+setl(Ttxn *txn, Tbl *tbl, const char *name, void *val) {
 	Node newn = { .ptr = (void *)(word)name, .index = (word)val };
 	// First leaf in an empty tbl?
 	if(tbl == NULL) {
@@ -485,25 +1022,34 @@ Tsetl(Tbl *tbl, const char *name, size_t len, void *val) {
 		return(tbl);
 	}
 	Node *n = &tbl->root;
-	Key newk;
-	size_t newl = text_to_key((const byte *)name, newk);
+	Lazy newk;
+	lazy_init(&newk, name);
 	// Find a nearby leaf node in the trie.
 	while(isbranch(n)) {
 		__builtin_prefetch(n->ptr);
-		n = twig(n, neartwig(n, twigbit(n, newk, newl)));
+		n = twig(n, neartwig(n, lazybit(n, &newk)));
 	}
 	// Do the keys differ, and if so, where?
-	Key oldk;
-	text_to_key(n->ptr, oldk);
+	Lazy oldk;
+	lazy_init(&oldk, n->ptr);
 	size_t off;
-	for(off = 0; off <= newl; off++) {
-		if(newk[off] != oldk[off])
+	Shift newb, oldb;
+	for(off = 0;; off++) {
+		newb = lazy_at(&newk, off);
+		oldb = lazy_at(&oldk, off);
+		if(newb != oldb)
 			goto newkey;
+		if(newb == SHIFT_NOBYTE)
+			break;
+	}
+	if(cowing(txn)) {
+		Node *p;
+		n = cow_path(txn, tbl, &newk, &p);
+		if(n == NULL) return(NULL);
 	}
 	n->index = (word)val;
 	return(tbl);
 newkey:;
-	Shift newb = newk[off], oldb = oldk[off];
 	// Find where to insert a branch or grow an existing branch.
 	n = &tbl->root;
 	while(isbranch(n)) {
@@ -512,18 +1058,22 @@ newkey:;
 			goto growbranch;
 		if(off < keyoff(n))
 			goto newbranch;
-		Shift bit = twigbit(n, newk, newl);
+		Shift bit = lazybit(n, &newk);
 		assert(hastwig(n, bit));
+		if(!cow_twigs(txn, n))
+			return(NULL);
 		n = twig(n, twigoff(n, bit));
 	}
 newbranch:;
-	Node *twigs = malloc(sizeof(Node) * 2);
+	Node *twigs = twigalloc(2);
 	if(twigs == NULL) return(NULL);
 	Node oldn = *n; // Save before overwriting.
 	n->index = (W1 << SHIFT_BRANCH)
 		 | (W1 << newb)
 		 | (W1 << oldb)
 		 | (off << SHIFT_OFFSET);
+	if(txn != NULL)
+		n->index |= W1 << SHIFT_COW;
 	n->ptr = twigs;
 	twigs[twigoff(n, newb)] = newn;
 	twigs[twigoff(n, oldb)] = oldn;
@@ -532,15 +1082,138 @@ growbranch:;
 	assert(!hastwig(n, newb));
 	Weight s = twigoff(n, newb);
 	Weight m = twigmax(n);
-	twigs = realloc(n->ptr, sizeof(Node) * (m + 1));
-	if(twigs == NULL) return(NULL);
-	memmove(twigs+s+1, twigs+s, sizeof(Node) * (m - s));
+	// Without a transaction, this only copies twigs shared with a
+	// snapshot.
+	if(txn == NULL && !cow_twigs(txn, n))
+		return(NULL);
+	if(txn == NULL || iscow(n)) {
+		twigs = twigrealloc(n->ptr, m + 1);
+		if(twigs == NULL) return(NULL);
+		memmove(twigs+s+1, twigs+s, sizeof(Node) * (m - s));
+	} else {
+		twigs = twigalloc(m + 1);
+		if(twigs == NULL) return(NULL);
+		if(!cow_garbage(txn, n->ptr)) {
+			twigfree(twigs);
+			return(NULL);
+		}
+		memcpy(twigs, n->ptr, sizeof(Node) * s);
+		memcpy(twigs+s+1, twig(n, s), sizeof(Node) * (m - s));
+		n->index |= W1 << SHIFT_COW;
+	}
 	twigs[s] = newn;
 	n->ptr = twigs;
 	n->index |= W1 << newb;
 	return(tbl);
 }
 
+Tbl *
+Tdelkv(Tbl *tbl, const char *name, size_t len, const char **pname, void **pval) {
+	(void)len; // we use the NUL terminator instead
+	return(delkv(NULL, tbl, name, pname, pval));
+}
+
+Tbl *
+Tsetl(Tbl *tbl, const char *name, size_t len, void *val) {
+	// Ensure flag bits are zero.
+	if(((word)val & MASK_FLAGS) != 0) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if(val == NULL)
+		return(Tdell(tbl, name, len));
+	return(setl(NULL, tbl, name, val));
+}
+
+// With snapshots, transactions are made on snapshots by txn.c.
+//
+#ifndef WITH_SNAPSHOTS
+
+Ttxn *
+Tbegin(Tbl *tbl) {
+	Ttxn *txn = calloc(1, sizeof(*txn));
+	if(txn == NULL) return(NULL);
+	if(tbl == NULL)
+		return(txn);
+	// The old root is garbage after a commit.
+	txn->tbl = malloc(sizeof(*tbl));
+	if(txn->tbl == NULL || !cow_garbage(txn, tbl)) {
+		free(txn->tbl);
+		free(txn);
+		return(NULL);
+	}
+	*txn->tbl = *tbl;
+	return(txn);
+}
+
+bool
+Txgetkv(Ttxn *txn, const char *name, size_t len, const char **pname, void **pval) {
+	return(Tgetkv(txn->tbl, name, len, pname, pval));
+}
+
+bool
+Txdelkv(Ttxn *txn, const char *name, size_t len, const char **pname, void **pval) {
+	(void)len; // we use the NUL terminator instead
+	const char *rname = NULL;
+	void *rval = NULL;
+	Tbl *tbl = delkv(txn, txn->tbl, name, &rname, &rval);
+	// Did we fail to copy the path to the leaf?
+	if(tbl == NULL && rname == NULL && txn->tbl != NULL)
+		return(false);
+	txn->tbl = tbl;
+	if(rname != NULL) {
+		*pname = rname;
+		*pval = rval;
+	}
+	return(true);
+}
+
+bool
+Txsetl(Ttxn *txn, const char *name, size_t len, void *val) {
+	// Ensure flag bits are zero.
+	if(((word)val & MASK_FLAGS) != 0) {
+		errno = EINVAL;
+		return(false);
+	}
+	if(val == NULL) {
+		const char *rname = NULL;
+		void *rval = NULL;
+		return(Txdelkv(txn, name, len, &rname, &rval));
+	}
+	Tbl *tbl = setl(txn, txn->tbl, name, val);
+	if(tbl == NULL)
+		return(false);
+	txn->tbl = tbl;
+	return(true);
+}
+
+Tbl *
+Tcommit(Ttxn *txn) {
+	if(txn->tbl != NULL)
+		cow_clear(&txn->tbl->root);
+	return(txn->tbl);
+}
+
+void
+Tabort(Ttxn *txn) {
+	if(txn->tbl != NULL) {
+		cow_free(&txn->tbl->root);
+		free(txn->tbl);
+	}
+	free(txn->garbage);
+	free(txn);
+}
+
+void
+Treclaim(Ttxn *txn) {
+	for(size_t i = 0; i < txn->count; i++)
+		free(txn->garbage[i]);
+	free(txn->garbage);
+	free(txn);
+}
+
+#endif
+
 bool
 Tnextl(Tbl *tbl, const char **pname, size_t *plen, void **pval) {
 	if(tbl == NULL) {
@@ -549,24 +1222,29 @@ Tnextl(Tbl *tbl, const char **pname, size_t *plen, void **pval) {
 		return(false);
 	}
 	Node *n = &tbl->root;
-	Key newk;
-	size_t newl;
+	Lazy newk;
 	if(*pname == NULL)
-		newl = text_to_key((const byte *)"", newk);
+		lazy_init(&newk, "");
 	else
-		newl = text_to_key((const byte *)*pname, newk);
+		lazy_init(&newk, *pname);
 	// Find a nearby leaf node in the trie.
 	while(isbranch(n)) {
 		__builtin_prefetch(n->ptr);
-		n = twig(n, neartwig(n, twigbit(n, newk, newl)));
+		n = twig(n, neartwig(n, lazybit(n, &newk)));
 	}
 	// Do the keys differ, and if so, where?
-	Key oldk;
-	text_to_key(n->ptr, oldk);
+	Lazy oldk;
+	lazy_init(&oldk, n->ptr);
 	size_t off;
-	for(off = 0; off <= newl; off++) {
-		if(newk[off] != oldk[off])
+	for(off = 0;; off++) {
+		Shift newb = lazy_at(&newk, off);
+		if(newb != lazy_at(&oldk, off))
+			break;
+		// Equal keys are treated as differing after the end.
+		if(newb == SHIFT_NOBYTE) {
+			off++;
 			break;
+		}
 	}
 	// Walk down again and this time keep track of adjacent nodes
 	n = &tbl->root;
@@ -579,7 +1257,7 @@ Tnextl(Tbl *tbl, const char **pname, size_t *plen, void **pval) {
 		__builtin_prefetch(n->ptr);
 		if(off <= keyoff(n))
 			break;
-		Shift newb = twigbit(n, newk, newl);
+		Shift newb = lazybit(n, &newk);
 		assert(hastwig(n, newb));
 		Weight s = twigoff(n, newb);
 		Weight m = twigmax(n) - 1;
@@ -608,4 +1286,99 @@ Tnextl(Tbl *tbl, const char **pname, size_t *plen, void **pval) {
 	}
 }
 
+// Structural statistics.
+//
+// The walk is a pre-order traversal, so when it resumes, the branches
+// on the path to the cursor have already been counted, and so have the
+// leaves before it. It only stops at a leaf, so that it does not count
+// a branch twice. Names are compared in trie order, not strcmp() order.
+
+static inline size_t
+stat_bucket(size_t i, size_t n) {
+	return(i < n ? i : n - 1);
+}
+
+static int
+stat_cmp(const char *a, const char *b) {
+	Lazy ka, kb;
+	lazy_init(&ka, a);
+	lazy_init(&kb, b);
+	for(size_t off = 0;; off++) {
+		Shift ba = lazy_at(&ka, off), bb = lazy_at(&kb, off);
+		if(ba != bb || ba == SHIFT_NOBYTE)
+			return(ba - bb);
+	}
+}
+
+static bool
+stat_cursor(Tstats *st, const char *name) {
+	size_t len = strlen(name);
+	char *cursor = realloc(st->cursor, len + 1);
+	if(cursor == NULL) {
+		free(st->cursor);
+		st->cursor = NULL;
+		return(false);
+	}
+	st->cursor = memcpy(cursor, name, len + 1);
+	st->cursorlen = len;
+	return(true);
+}
+
+// Returns false to stop the walk.
+//
+static bool
+stat_rec(Node *n, size_t d, Tstats *st, size_t *budget, Lazy *key) {
+	if(*budget > 0)
+		*budget -= 1;
+	if(!isbranch(n)) {
+		if(key != NULL && stat_cmp(n->ptr, st->cursor) <= 0)
+			return(true);
+		st->leaves += 1;
+		st->depth[stat_bucket(d, TSTAT_DEPTH)] += 1;
+		if(*budget == 0) {
+			stat_cursor(st, n->ptr);
+			return(false);
+		}
+		return(true);
+	}
+	Weight s = 0, m = twigmax(n);
+	if(key != NULL) {
+		Shift bit = lazybit(n, key);
+		s = twigoff(n, bit);
+		if(hastwig(n, bit) && !stat_rec(twig(n, s++), d+1, st, budget, key))
+			return(false);
+	} else {
+		size_t pos = stat_bucket(keyoff(n), TSTAT_POSITION);
+		st->branches += 1;
+		st->twigs += m;
+		st->fanout[stat_bucket(m, TSTAT_FANOUT)] += 1;
+		st->position[pos] += 1;
+		st->postwigs[pos] += m;
+	}
+	for(; s < m; s++)
+		if(!stat_rec(twig(n, s), d+1, st, budget, NULL))
+			return(false);
+	return(true);
+}
+
+bool
+Tstat(Tbl *tbl, Tstats *st, size_t budget) {
+	st->type = "dns";
+	if(budget == 0)
+		budget = 1;
+	Lazy key, *resume = NULL;
+	if(st->cursor != NULL) {
+		lazy_init(&key, st->cursor);
+		resume = &key;
+	}
+	if(tbl != NULL && resume == NULL)
+		st->roots = 1;
+	if(tbl != NULL && !stat_rec(&tbl->root, 0, st, &budget, resume))
+		return(st->cursor != NULL);
+	free(st->cursor);
+	st->cursor = NULL;
+	st->complete = true;
+	return(false);
+}
+
 ////////////////////////////////////////////////////////////////////////
@@ -128,8 +128,9 @@
 // At the moment this code is bodged so that it matches the behaviour of
 // the non-DNS trie implementations, which means we are examining
 // strings left-to-right (instead of labels right-to-left and characters
-// left-to-right) and we are case sensitive (instead of insensitive) and
-// we're treating '.' as a common character instead of a label separator.
+// left-to-right) and we are case sensitive (instead of insensitive,
+// unless compiled WITH_CASE_FOLDING) and we're treating '.' as a common
+// character instead of a label separator.
 
 ////////////////////////////////////////////////////////////////////////
 //                _       _
@@ -384,4 +385,13 @@ twig(Node *n, Weight i) {
 	return((Node *)n->ptr + i);
 }
 
+// Convert a presentation format domain name into a trie lookup key,
+// in left-to-right order (case-sensitive unless WITH_CASE_FOLDING) or
+// in standard lexical order.
+// Returns the length of the key. These are exported from dns.c for the
+// key conversion microbenchmark in keys.c.
+//
+size_t text_to_key(const byte *name, Key key);
+size_t stdtext_to_key(const byte *name, Key key);
+
 ////////////////////////////////////////////////////////////////////////
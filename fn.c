@@ -13,19 +13,163 @@
 
 #include "Tbl.h"
 #include "fn.h"
+#include "trace.h"
+
+#ifdef WITH_SNAPSHOTS
+
+// Snapshots share twig arrays, which have reference counts in a header
+// word in front of them, and changes copy the shared arrays on the path
+// they touch, in the same way as qp.c.
+
+static inline uint64_t *
+twigrefs(Trie *twigs) {
+	return((uint64_t *)twigs - 1);
+}
+
+static Trie *
+twigalloc(size_t m) {
+	uint64_t *refs = malloc(sizeof(*refs) + sizeof(Trie) * m);
+	if(refs == NULL)
+		return(NULL);
+	*refs = 1;
+	return((Trie *)(refs + 1));
+}
+
+static Trie *
+twigrealloc(Trie *twigs, size_t m) {
+	uint64_t *refs = realloc(twigrefs(twigs), sizeof(*refs) + sizeof(Trie) * m);
+	return(refs == NULL ? NULL : (Trie *)(refs + 1));
+}
+
+static void
+twigfree(Trie *twigs) {
+	if(twigs != NULL)
+		free(twigrefs(twigs));
+}
+
+static void
+incref(Trie *t) {
+	if(isbranch(t))
+		__atomic_add_fetch(twigrefs(Tbranch_twigs(t)), 1, __ATOMIC_RELAXED);
+}
+
+static void
+decref(Trie *t) {
+	if(!isbranch(t))
+		return;
+	Trie *twigs = Tbranch_twigs(t);
+	if(__atomic_sub_fetch(twigrefs(twigs), 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	for(uint s = 0, m = popcount(Tindex_bitmap(t->index)); s < m; s++)
+		decref(&twigs[s]);
+	twigfree(twigs);
+}
+
+static bool
+cowtwigs(Trie *t) {
+	Trie *twigs = Tbranch_twigs(t);
+	if(__atomic_load_n(twigrefs(twigs), __ATOMIC_ACQUIRE) == 1)
+		return(true);
+	uint m = popcount(Tindex_bitmap(t->index));
+	Trie *copy = twigalloc(m);
+	if(copy == NULL)
+		return(false);
+	memcpy(copy, twigs, sizeof(Trie) * m);
+	for(uint s = 0; s < m; s++)
+		incref(&copy[s]);
+	decref(t);
+	Tset_twigs(t, copy);
+	return(true);
+}
+
+// Walk down to the key's leaf, making the path to it private. Sets *pt
+// to the leaf and *pp (if not NULL) to its parent. The key must be in
+// the table.
+//
+static bool
+cowpath(Tbl *tbl, const char *key, size_t len, Trie **pt, Trie **pp) {
+	Trie *t = tbl, *p = NULL;
+	while(isbranch(t)) {
+		if(!cowtwigs(t))
+			return(false);
+		Tindex i = t->index;
+		p = t; t = Tbranch_twigs(t) + twigoff(i, twigbit(i, key, len));
+	}
+	*pt = t;
+	if(pp != NULL)
+		*pp = p;
+	return(true);
+}
+
+Tbl *
+Tsnapshot(Tbl *tbl) {
+	if(tbl == NULL)
+		return(NULL);
+	Tbl *snap = malloc(sizeof(*snap));
+	if(snap == NULL)
+		return(NULL);
+	*snap = *tbl;
+	incref(snap);
+	return(snap);
+}
+
+void
+Trelease(Tbl *tbl) {
+	if(tbl == NULL)
+		return;
+	decref(tbl);
+	free(tbl);
+}
+
+#else
+
+static inline Trie *
+twigalloc(size_t m) {
+	return(malloc(sizeof(Trie) * m));
+}
+
+static inline Trie *
+twigrealloc(Trie *twigs, size_t m) {
+	return(realloc(twigs, sizeof(Trie) * m));
+}
+
+static inline void
+twigfree(Trie *twigs) {
+	free(twigs);
+}
+
+static inline bool
+cowtwigs(Trie *t) {
+	(void)t;
+	return(true);
+}
+
+static inline bool
+cowpath(Tbl *tbl, const char *key, size_t len, Trie **pt, Trie **pp) {
+	(void)tbl; (void)key; (void)len; (void)pt; (void)pp;
+	return(true);
+}
+
+#endif
 
 bool
 Tgetkv(Tbl *t, const char *key, size_t len, const char **pkey, void **pval) {
 	if(t == NULL)
 		return(false);
 	while(isbranch(t)) {
+		TRACE(TRACE_BRANCH, t, sizeof(*t));
 		__builtin_prefetch(t->ptr);
 		Tindex i = t->index;
+		// knybble() reads two bytes of the key
+		if(Tindex_offset(i) < len)
+			TRACE(TRACE_SEARCH, key + Tindex_offset(i), 2);
 		Tbitmap b = twigbit(i, key, len);
 		if(!hastwig(i, b))
 			return(false);
 		t = Tbranch_twigs(t) + twigoff(i, b);
 	}
+	TRACE(TRACE_LEAF, t, sizeof(*t));
+	TRACE_STRCMP(key, Tleaf_key(t));
 	if(strcmp(key, Tleaf_key(t)) != 0)
 		return(false);
 	*pkey = Tleaf_key(t);
@@ -90,6 +234,9 @@ Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 	}
 	if(strcmp(key, Tleaf_key(t)) != 0)
 		return(tbl);
+	// The key is present, so now we can copy the path to it.
+	if(!cowpath(tbl, key, len, &t, &p))
+		return(NULL);
 	*pkey = Tleaf_key(t);
 	*pval = Tleaf_val(t);
 	if(p == NULL) {
@@ -102,7 +249,7 @@ Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 	if(m == 2) {
 		// Move the other twig to the parent branch.
 		*p = twigs[twigs == t];
-		free(twigs);
+		twigfree(twigs);
 		return(tbl);
 	}
 	memmove(t, t+1, ((twigs + m) - (t + 1)) * sizeof(Trie));
@@ -110,7 +257,7 @@ Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 	// We have now correctly removed the twig from the trie, so if
 	// realloc() fails we can ignore it and continue to use the
 	// slightly oversized twig array.
-	twigs = realloc(twigs, sizeof(Trie) * (m - 1));
+	twigs = twigrealloc(twigs, m - 1);
 	if(twigs != NULL) Tset_twigs(p, twigs);
 	return(tbl);
 }
@@ -155,6 +302,8 @@ Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
 		xor = (byte)key[off] ^ (byte)tkey[off];
 		if(xor != 0) goto newkey;
 	}
+	if(!cowpath(tbl, key, len, &t, NULL))
+		return(NULL);
 	Tset_val(t, val);
 	return(tbl);
 newkey:; // We have the branch's byte index; what is its chunk index?
@@ -183,10 +332,11 @@ newkey:; // We have the branch's byte index; what is its chunk index?
 			goto newbranch;
 		Tbitmap b = twigbit(i, key, len);
 		assert(hastwig(i, b));
+		if(!cowtwigs(t)) return(NULL);
 		t = Tbranch_twigs(t) + twigoff(i, b);
 	}
 newbranch:;
-	Trie *twigs = malloc(sizeof(Trie) * 2);
+	Trie *twigs = twigalloc(2);
 	if(twigs == NULL) return(NULL);
 	i = Tindex_new(shf, off, nb | tb);
 	twigs[twigoff(i, nb)] = nt;
@@ -196,8 +346,9 @@ newbranch:;
 	return(tbl);
 growbranch:;
 	assert(!hastwig(i, nb));
+	if(!cowtwigs(t)) return(NULL);
 	uint s, m; TWIGOFFMAX(s, m, i, nb);
-	twigs = realloc(Tbranch_twigs(t), sizeof(Trie) * (m + 1));
+	twigs = twigrealloc(Tbranch_twigs(t), m + 1);
 	if(twigs == NULL) return(NULL);
 	memmove(twigs+s+1, twigs+s, sizeof(Trie) * (m - s));
 	memmove(twigs+s, &nt, sizeof(Trie));
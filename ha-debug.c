@@ -0,0 +1,99 @@
+// ha-debug.c: HAT-trie debug support
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "ha.h"
+
+static void
+dump_rec(void *p, size_t depth) {
+	if(isbucket(p)) {
+		Bucket *b = bucket(p);
+		printf("Tdump%*s bucket %p count %u size %u\n",
+		       (int)depth, "", b, b->count, b->mask + 1);
+		uint count = 0;
+		for(size_t i = 0; i <= b->mask; i++) {
+			Slot *s = &b->slot[i];
+			if(s->key == NULL)
+				continue;
+			count++;
+			printf("Tdump%*s slot %zu home %zu\n", (int)depth, "",
+			       i, (size_t)hash(s->key + depth) & b->mask);
+			printf("Tdump%*s slot key %p %s\n", (int)depth, "",
+			       s->key, s->key);
+			printf("Tdump%*s slot val %p\n", (int)depth, "", s->val);
+			assert(strlen(s->key) >= depth);
+		}
+		assert(count == b->count);
+		assert(count > 0 && count <= BURST);
+		return;
+	}
+	Node *n = p;
+	printf("Tdump%*s node %p count %u\n", (int)depth, "", n, n->count);
+	uint count = 0;
+	if(n->leaf.key != NULL) {
+		count++;
+		printf("Tdump%*s leaf key %p %s\n", (int)depth, "",
+		       n->leaf.key, n->leaf.key);
+		printf("Tdump%*s leaf val %p\n", (int)depth, "", n->leaf.val);
+		assert(strlen(n->leaf.key) == depth);
+	}
+	for(uint c = 0; c < 256; c++) {
+		if(n->child[c] == NULL)
+			continue;
+		count++;
+		printf("Tdump%*s child %02x\n", (int)depth, "", c);
+		dump_rec(n->child[c], depth + 1);
+	}
+	assert(count == n->count);
+}
+
+void
+Tdump(Tbl *tbl) {
+	printf("Tdump root %p\n", tbl);
+	if(tbl != NULL)
+		dump_rec(tbl->root, 0);
+}
+
+static void
+size_rec(void *p, size_t depth, size_t *rsize,
+	 size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	if(isbucket(p)) {
+		Bucket *b = bucket(p);
+		*rsize += sizeof(*b) + sizeof(Slot) * (b->mask + 1);
+		*rdepth += depth * b->count;
+		*rleaves += b->count;
+		return;
+	}
+	Node *n = p;
+	*rsize += sizeof(*n);
+	*rbranches += 1;
+	if(n->leaf.key != NULL) {
+		*rdepth += depth;
+		*rleaves += 1;
+	}
+	for(uint c = 0; c < 256; c++)
+		if(n->child[c] != NULL)
+			size_rec(n->child[c], depth + 1,
+				 rsize, rdepth, rbranches, rleaves);
+}
+
+void
+Tsize(Tbl *tbl, const char **rtype,
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	*rtype = "ha";
+	*rsize = *rdepth = *rbranches = *rleaves = 0;
+	if(tbl == NULL)
+		return;
+	*rsize = sizeof(*tbl);
+	size_rec(tbl->root, 0, rsize, rdepth, rbranches, rleaves);
+}
@@ -0,0 +1,334 @@
+// ha.c: tables implemented with HAT-tries.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "ha.h"
+
+// Returns the slot containing the key, or the empty slot where it
+// should be inserted. All the keys in a bucket have the same prefix, so
+// we only need to hash and compare the suffixes.
+//
+static Slot *
+probe(Bucket *b, const char *key, size_t depth) {
+	size_t i = (size_t)hash(key + depth) & b->mask;
+	while(b->slot[i].key != NULL &&
+	      strcmp(key + depth, b->slot[i].key + depth) != 0)
+		i = (i + 1) & b->mask;
+	return(&b->slot[i]);
+}
+
+static Bucket *
+newbucket(size_t size) {
+	Bucket *b = calloc(1, sizeof(*b) + sizeof(Slot) * size);
+	if(b != NULL)
+		b->mask = (uint)(size - 1);
+	return(b);
+}
+
+// Move the entries into a new bucket of the given size. If that fails
+// when shrinking we can keep using the bigger bucket.
+//
+static Bucket *
+resize(Bucket *b, size_t depth, size_t size) {
+	Bucket *new = newbucket(size);
+	if(new == NULL)
+		return(NULL);
+	new->count = b->count;
+	for(size_t i = 0; i <= b->mask; i++)
+		if(b->slot[i].key != NULL)
+			*probe(new, b->slot[i].key, depth) = b->slot[i];
+	free(b);
+	return(new);
+}
+
+// Add a key that is not already present, returning the bucket, which
+// might have moved, or NULL if we ran out of memory.
+//
+static Bucket *
+add(Bucket *b, size_t depth, const char *key, void *val) {
+	if((b->count + 1) * 4 > (b->mask + 1) * 3) {
+		Bucket *new = resize(b, depth, (b->mask + 1) * 2);
+		if(new == NULL)
+			return(NULL);
+		b = new;
+	}
+	Slot *s = probe(b, key, depth);
+	s->key = key;
+	s->val = val;
+	b->count += 1;
+	return(b);
+}
+
+bool
+Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(false);
+	void *p = tbl->root;
+	size_t depth = 0;
+	while(!isbucket(p)) {
+		Node *n = p;
+		if(depth == len) {
+			if(n->leaf.key == NULL)
+				return(false);
+			*pkey = n->leaf.key;
+			*pval = n->leaf.val;
+			return(true);
+		}
+		p = n->child[(byte)key[depth++]];
+		if(p == NULL)
+			return(false);
+	}
+	Slot *s = probe(bucket(p), key, depth);
+	if(s->key == NULL)
+		return(false);
+	*pkey = s->key;
+	*pval = s->val;
+	return(true);
+}
+
+static bool
+next_rec(void *p, size_t depth, const char **pkey, size_t *plen, void **pval) {
+	if(isbucket(p)) {
+		// Find the smallest key in the bucket that follows this one.
+		Bucket *b = bucket(p);
+		Slot *next = NULL;
+		for(size_t i = 0; i <= b->mask; i++) {
+			Slot *s = &b->slot[i];
+			if(s->key == NULL)
+				continue;
+			if(*pkey != NULL && strcmp(s->key + depth, *pkey + depth) <= 0)
+				continue;
+			if(next == NULL || strcmp(s->key + depth, next->key + depth) < 0)
+				next = s;
+		}
+		if(next == NULL) {
+			*pkey = NULL;
+			*plen = 0;
+			return(false);
+		}
+		*pkey = next->key;
+		*plen = strlen(next->key);
+		*pval = next->val;
+		return(true);
+	}
+	Node *n = p;
+	uint c = 0;
+	if(*pkey == NULL || *plen == depth) {
+		// The leaf comes before the children.
+		if(*pkey == NULL && n->leaf.key != NULL) {
+			*pkey = n->leaf.key;
+			*plen = depth;
+			*pval = n->leaf.val;
+			return(true);
+		}
+		*pkey = NULL;
+		*plen = 0;
+	} else {
+		c = (byte)(*pkey)[depth];
+		if(n->child[c] == NULL) {
+			*pkey = NULL;
+			*plen = 0;
+		}
+	}
+	for(; c < 256; c++)
+		if(n->child[c] != NULL &&
+		   next_rec(n->child[c], depth + 1, pkey, plen, pval))
+			return(true);
+	return(false);
+}
+
+bool
+Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
+	if(tbl != NULL && next_rec(tbl->root, 0, pkey, plen, pval))
+		return(true);
+	*pkey = NULL;
+	*plen = 0;
+	return(false);
+}
+
+static bool
+del_rec(void **ref, const char *key, size_t len, size_t depth,
+	const char **pkey, void **pval) {
+	if(isbucket(*ref)) {
+		Bucket *b = bucket(*ref);
+		Slot *s = probe(b, key, depth);
+		if(s->key == NULL)
+			return(false);
+		*pkey = s->key;
+		*pval = s->val;
+		if(--b->count == 0) {
+			free(b);
+			*ref = NULL;
+			return(true);
+		}
+		// Fill the gap with a later entry whose home slot is not
+		// between the gap and the entry, like oa.c.
+		size_t mask = b->mask;
+		size_t i = (size_t)(s - b->slot);
+		for(size_t j = (i + 1) & mask; b->slot[j].key != NULL;
+		    j = (j + 1) & mask) {
+			size_t h = (size_t)hash(b->slot[j].key + depth) & mask;
+			if(((j - h) & mask) >= ((j - i) & mask)) {
+				b->slot[i] = b->slot[j];
+				i = j;
+			}
+		}
+		b->slot[i].key = NULL;
+		b->slot[i].val = NULL;
+		if(mask + 1 > MINSIZE && b->count < (mask + 1) / 8) {
+			Bucket *new = resize(b, depth, (mask + 1) / 2);
+			if(new != NULL)
+				*ref = tagbucket(new);
+		}
+		return(true);
+	}
+	Node *n = *ref;
+	if(depth == len) {
+		if(n->leaf.key == NULL)
+			return(false);
+		*pkey = n->leaf.key;
+		*pval = n->leaf.val;
+		n->leaf.key = NULL;
+		n->leaf.val = NULL;
+		n->count--;
+	} else {
+		void **child = &n->child[(byte)key[depth]];
+		if(*child == NULL)
+			return(false);
+		if(!del_rec(child, key, len, depth + 1, pkey, pval))
+			return(false);
+		if(*child == NULL)
+			n->count--;
+	}
+	// Prune empty nodes. We do not merge sparse nodes back into a
+	// bucket, which the paper does not do either.
+	if(n->count == 0) {
+		free(n);
+		*ref = NULL;
+	}
+	return(true);
+}
+
+Tbl *
+Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(NULL);
+	del_rec(&tbl->root, key, len, 0, pkey, pval);
+	if(tbl->root != NULL)
+		return(tbl);
+	free(tbl);
+	return(NULL);
+}
+
+// Replace a full bucket with a trie node whose children are new buckets.
+//
+static bool
+burst(void **ref, size_t depth) {
+	Bucket *b = bucket(*ref);
+	Node *n = calloc(1, sizeof(*n));
+	if(n == NULL)
+		return(false);
+	for(size_t i = 0; i <= b->mask; i++) {
+		Slot *s = &b->slot[i];
+		if(s->key == NULL)
+			continue;
+		byte c = (byte)s->key[depth];
+		if(c == '\0') {
+			n->leaf = *s;
+			n->count++;
+			continue;
+		}
+		Bucket *cb = n->child[c] == NULL
+			? newbucket(MINSIZE) : bucket(n->child[c]);
+		Bucket *new = cb == NULL ? NULL : add(cb, depth + 1, s->key, s->val);
+		if(new == NULL) {
+			if(n->child[c] == NULL)
+				free(cb);
+			for(uint i = 0; i < 256; i++)
+				if(n->child[i] != NULL)
+					free(bucket(n->child[i]));
+			free(n);
+			return(false);
+		}
+		if(n->child[c] == NULL)
+			n->count++;
+		n->child[c] = tagbucket(new);
+	}
+	free(b);
+	*ref = n;
+	return(true);
+}
+
+Tbl *
+Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
+	// Ensure values are word-aligned, like the tries.
+	if(((uint64_t)val & 3) != 0) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if(val == NULL)
+		return(Tdell(tbl, key, len));
+	// First leaf in an empty tbl?
+	if(tbl == NULL) {
+		tbl = malloc(sizeof(*tbl));
+		if(tbl == NULL)
+			return(NULL);
+		Bucket *b = newbucket(MINSIZE);
+		if(b == NULL) {
+			free(tbl);
+			return(NULL);
+		}
+		tbl->root = tagbucket(add(b, 0, key, val));
+		return(tbl);
+	}
+	void **ref = &tbl->root;
+	size_t depth = 0;
+	for(;;) {
+		if(!isbucket(*ref)) {
+			Node *n = *ref;
+			if(depth == len) {
+				if(n->leaf.key == NULL) {
+					n->leaf.key = key;
+					n->count++;
+				}
+				n->leaf.val = val;
+				return(tbl);
+			}
+			ref = &n->child[(byte)key[depth++]];
+			if(*ref == NULL) {
+				Bucket *b = newbucket(MINSIZE);
+				if(b == NULL)
+					return(NULL);
+				*ref = tagbucket(add(b, depth, key, val));
+				n->count++;
+				return(tbl);
+			}
+			continue;
+		}
+		Bucket *b = bucket(*ref);
+		Slot *s = probe(b, key, depth);
+		if(s->key != NULL) {
+			s->val = val;
+			return(tbl);
+		}
+		if(b->count < BURST) {
+			b = add(b, depth, key, val);
+			if(b == NULL)
+				return(NULL);
+			*ref = tagbucket(b);
+			return(tbl);
+		}
+		if(!burst(ref, depth))
+			return(NULL);
+	}
+}
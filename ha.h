@@ -0,0 +1,86 @@
+// ha.h: tables implemented with HAT-tries.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This is a comparison baseline: the HAT-trie from Nikolas Askitis and
+// Ranjan Sinha, "HAT-trie: a cache-conscious trie-based data structure
+// for strings", ACSC 2007.
+//
+// A HAT-trie is a burst trie: the top levels are an ordinary 256-way
+// trie, and the keys below each trie node are kept in unordered
+// containers, which are hash tables keyed on the suffix after the node's
+// prefix. When a container has more than BURST entries it is burst into
+// a trie node whose children are new containers, one for each possible
+// next byte. A key that ends exactly at a trie node is stored in the
+// node itself.
+//
+// The paper's containers are "array hashes": each bucket is a
+// contiguous array of length-prefixed strings. Our API does not let us
+// copy the keys, so instead each container is a small open-addressing
+// hash table of key and value pointers, like oa.h, which keeps the
+// property that a lookup touches one or two contiguous cache lines
+// before the final strcmp().
+//
+// Containers are unordered, so Tnextl() scans the container holding
+// the previous key for the smallest key that follows it.
+//
+// Pointers to containers are tagged with their least significant bit.
+
+typedef unsigned char byte;
+typedef unsigned int uint;
+
+#define BURST 1024
+#define MINSIZE 4
+
+typedef struct Slot {
+	const char *key;
+	void *val;
+} Slot;
+
+typedef struct Bucket {
+	uint count, mask;
+	Slot slot[];
+} Bucket;
+
+// count is the number of non-NULL children, plus one for a leaf
+typedef struct Node {
+	uint count;
+	Slot leaf;
+	void *child[256];
+} Node;
+
+struct Tbl {
+	void *root;
+};
+
+static inline bool
+isbucket(void *p) {
+	return((uintptr_t)p & 1);
+}
+
+static inline Bucket *
+bucket(void *p) {
+	return((Bucket *)((uintptr_t)p - 1));
+}
+
+static inline void *
+tagbucket(Bucket *b) {
+	return((void *)((uintptr_t)b + 1));
+}
+
+// The hash of the suffix of a key after a container's prefix.
+//
+static inline uint64_t
+hash(const char *key) {
+	uint64_t h = 0xcbf29ce484222325;
+	for(const byte *p = (const void *)key; *p != '\0'; p++)
+		h = (h ^ *p) * 0x100000001b3;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 33;
+	return(h);
+}
@@ -0,0 +1,81 @@
+// hc-debug.c: concurrent HAMT debug support
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "hc.h"
+
+static void
+dump_rec(Tnode *n, int d, bool root) {
+	Twigs *c = n->twigs;
+	printf("Tdump%*s branch %p twigs %p\n", d, "", n, c);
+	// A one-twig branch must lead to another branch.
+	assert(root || twigmax(c) > 1 || isbranch(&c->twig[0]));
+	for(uint i = 0; i < lgN; i++) {
+		uint64_t b = twigbit(i);
+		if(!hastwig(c, b))
+			continue;
+		printf("Tdump%*s twig %d\n", d, "", i);
+		Trie *t = &c->twig[twigoff(c, b)];
+		if(isbranch(t)) {
+			dump_rec(t->branch.node, d+1, false);
+			continue;
+		}
+		printf("Tdump%*s leaf %p\n", d+1, "", t);
+		printf("Tdump%*s leaf key %p %s\n", d+1, "",
+		       t->leaf.key, t->leaf.key);
+		printf("Tdump%*s leaf val %p fp %zu\n", d+1, "",
+		       leafval(t), (size_t)t->leaf.val & FPMASK);
+		Hpos hp; hstart(&hp, t->leaf.key, strlen(t->leaf.key));
+		assert(!leafmiss(t, hp.fp));
+	}
+}
+
+void
+Tdump(Tbl *tbl) {
+	printf("Tdump root %p\n", tbl);
+	if(tbl == NULL)
+		return;
+	size_t garbage = 0;
+	for(Twigs *c = tbl->garbage; c != NULL; c = c->retired)
+		garbage++;
+	printf("Tdump garbage %zu\n", garbage);
+	dump_rec(&tbl->root, 0, true);
+}
+
+static void
+size_rec(Tnode *n, uint d, size_t *rsize,
+	 size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	Twigs *c = n->twigs;
+	*rsize += sizeof(*n) + sizeof(*c);
+	*rbranches += 1;
+	for(uint s = 0, m = twigmax(c); s < m; s++) {
+		Trie *t = &c->twig[s];
+		*rsize += sizeof(*t);
+		if(isbranch(t)) {
+			size_rec(t->branch.node, d+1,
+				 rsize, rdepth, rbranches, rleaves);
+		} else {
+			*rdepth += d + 1;
+			*rleaves += 1;
+		}
+	}
+}
+
+void
+Tsize(Tbl *tbl, const char **rtype,
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	*rtype = "hc";
+	*rsize = *rdepth = *rbranches = *rleaves = 0;
+	if(tbl != NULL)
+		size_rec(&tbl->root, 0, rsize, rdepth, rbranches, rleaves);
+}
@@ -0,0 +1,309 @@
+// hc.c: tables implemented with concurrent hash array mapped tries
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/random.h>
+
+#include "Tbl.h"
+#include "hc.h"
+
+uint64_t siphash_key[2];
+
+// If there is no entropy the key stays zero, which still works but
+// is predictable.
+//
+static void __attribute__((constructor))
+siphash_init(void) {
+	(void)getentropy(siphash_key, sizeof(siphash_key));
+}
+
+static Twigs *
+twigalloc(uintptr_t map) {
+	Twigs *c = malloc(sizeof(Twigs) + sizeof(Trie) * popcount(map));
+	if(c != NULL) {
+		c->map = map;
+		c->retired = NULL;
+	}
+	return(c);
+}
+
+static void
+freetrie(Tnode *n) {
+	Twigs *c = n->twigs;
+	for(uint s = 0, m = twigmax(c); s < m; s++)
+		if(isbranch(&c->twig[s]))
+			freetrie(c->twig[s].branch.node);
+	free(c);
+	free(n);
+}
+
+// Replace a node's twigs if nobody else has, and keep the old ones
+// until it is safe to free them.
+//
+static bool
+publish(Tbl *tbl, Tnode *n, Twigs *old, Twigs *new) {
+	if(!__atomic_compare_exchange_n(&n->twigs, &old, new, false,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return(false);
+	Twigs *g = __atomic_load_n(&tbl->garbage, __ATOMIC_RELAXED);
+	do old->retired = g;
+	while(!__atomic_compare_exchange_n(&tbl->garbage, &g, old, true,
+					   __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return(true);
+}
+
+void
+Tcollect(Tbl *tbl) {
+	if(tbl == NULL)
+		return;
+	Twigs *c = tbl->garbage;
+	tbl->garbage = NULL;
+	while(c != NULL) {
+		Twigs *next = c->retired;
+		free(c);
+		c = next;
+	}
+}
+
+bool
+Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(false);
+	Tnode *n = &tbl->root;
+	Hpos hp; hstart(&hp, key, len);
+	for(;;) {
+		Twigs *c = twigs(n);
+		uintptr_t b = twigbit(hp.h);
+		if(!hastwig(c, b))
+			return(false);
+		Trie *t = &c->twig[twigoff(c, b)];
+		if(!isbranch(t)) {
+			if(leafmiss(t, hp.fp) || strcmp(key, t->leaf.key) != 0)
+				return(false);
+			*pkey = t->leaf.key;
+			*pval = leafval(t);
+			return(true);
+		}
+		n = t->branch.node;
+		hnext(&hp);
+	}
+}
+
+// Find the smallest key that is greater than prev.
+//
+static void
+next_rec(Tnode *n, const char *prev, Trie **next) {
+	Twigs *c = twigs(n);
+	for(uint s = 0, m = twigmax(c); s < m; s++) {
+		Trie *t = &c->twig[s];
+		if(isbranch(t)) {
+			next_rec(t->branch.node, prev, next);
+			continue;
+		}
+		if(prev != NULL && strcmp(t->leaf.key, prev) <= 0)
+			continue;
+		if(*next == NULL || strcmp(t->leaf.key, (*next)->leaf.key) < 0)
+			*next = t;
+	}
+}
+
+bool
+Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
+	Trie *next = NULL;
+	if(tbl != NULL)
+		next_rec(&tbl->root, *pkey, &next);
+	if(next == NULL) {
+		*pkey = NULL;
+		*plen = 0;
+		return(false);
+	}
+	*pkey = next->leaf.key;
+	*plen = strlen(*pkey);
+	*pval = leafval(next);
+	return(true);
+}
+
+// Deletion is single-threaded, so it changes the trie in place.
+//
+Tbl *
+Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(NULL);
+	Tcollect(tbl);
+	// slot is the twig that points to n, and top is the highest of
+	// a chain of one-twig branches above n
+	Tnode *n = &tbl->root;
+	Trie *slot = NULL, *top = NULL, *t;
+	Twigs *c;
+	uintptr_t b;
+	Hpos hp; hstart(&hp, key, len);
+	for(;;) {
+		c = n->twigs;
+		b = twigbit(hp.h);
+		if(!hastwig(c, b))
+			return(tbl);
+		t = &c->twig[twigoff(c, b)];
+		if(!isbranch(t))
+			break;
+		if(slot != NULL && twigmax(c) == 1) {
+			if(top == NULL)
+				top = slot;
+		} else {
+			top = NULL;
+		}
+		slot = t; n = t->branch.node;
+		hnext(&hp);
+	}
+	if(leafmiss(t, hp.fp) || strcmp(key, t->leaf.key) != 0)
+		return(tbl);
+	*pkey = t->leaf.key;
+	*pval = leafval(t);
+	uint s = twigoff(c, b), m = twigmax(c);
+	if(m == 1) {
+		// Only the root can have a single leaf.
+		assert(slot == NULL);
+		free(c);
+		free(tbl);
+		return(NULL);
+	}
+	if(slot != NULL && m == 2 && !isbranch(&c->twig[!s])) {
+		// Move the other leaf up to the top of the chain of
+		// one-twig branches (if any) above this branch, and
+		// free the chain.
+		Trie leaf = c->twig[!s];
+		Trie *up = top != NULL ? top : slot;
+		freetrie(up->branch.node);
+		*up = leaf;
+		return(tbl);
+	}
+	memmove(c->twig + s, c->twig + s + 1, sizeof(Trie) * (m - s - 1));
+	c->map &= ~b;
+	// We have now correctly removed the twig from the trie, so if
+	// realloc() fails we can ignore it and continue to use the
+	// slightly oversized twig array.
+	c = realloc(c, sizeof(Twigs) + sizeof(Trie) * (m - 1));
+	if(c != NULL) n->twigs = c;
+	return(tbl);
+}
+
+// Make a chain of new branches in *t that separates two leaves whose
+// hashes match as far as hp.
+//
+static bool
+newchain(Trie *t, Hpos hp, Trie t1, Trie t2) {
+	Hpos h2; hstart(&h2, t2.leaf.key, strlen(t2.leaf.key));
+	while(h2.d1 < hp.d1 || h2.d2 < hp.d2)
+		hnext(&h2);
+	Tnode *top = NULL;
+	for(;;) {
+		uintptr_t b1 = twigbit(hp.h), b2 = twigbit(h2.h);
+		Tnode *n = malloc(sizeof(*n));
+		Twigs *c = twigalloc(b1 | b2);
+		if(n == NULL || c == NULL) {
+			free(n);
+			free(c);
+			if(top != NULL)
+				freetrie(top);
+			return(false);
+		}
+		n->twigs = c;
+		branchset(t, n);
+		if(top == NULL)
+			top = n;
+		if(b1 != b2) {
+			c->twig[twigoff(c, b1)] = t1;
+			c->twig[twigoff(c, b2)] = t2;
+			return(true);
+		}
+		// a placeholder, so the chain is valid if we have to free it
+		t = &c->twig[0];
+		*t = t1;
+		hnext(&hp);
+		hnext(&h2);
+	}
+}
+
+Tbl *
+Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
+	// Ensure flag and fingerprint bits are zero.
+	if(((uintptr_t)val & (FPMASK | 1)) != 0) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if(val == NULL)
+		return(Tdell(tbl, key, len));
+	Hpos hp; hstart(&hp, key, len);
+	Trie t1 = { .leaf = { .key = key } };
+	leafset(&t1, val, hp.fp);
+	// First leaf in an empty tbl?
+	if(tbl == NULL) {
+		tbl = malloc(sizeof(*tbl));
+		Twigs *c = twigalloc(twigbit(hp.h));
+		if(tbl == NULL || c == NULL) {
+			free(tbl);
+			free(c);
+			return(NULL);
+		}
+		c->twig[0] = t1;
+		tbl->root.twigs = c;
+		tbl->garbage = NULL;
+		return(tbl);
+	}
+	// Each time round the loop either descends one level, or makes
+	// a new version of n's twigs, and tries again if another thread
+	// changed them first.
+	Tnode *n = &tbl->root;
+	for(;;) {
+		Twigs *c = twigs(n), *nc;
+		uintptr_t b = twigbit(hp.h);
+		uint s = twigoff(c, b), m = twigmax(c);
+		if(!hastwig(c, b)) {
+			nc = twigalloc(c->map | b);
+			if(nc == NULL) return(NULL);
+			memcpy(nc->twig, c->twig, sizeof(Trie) * s);
+			nc->twig[s] = t1;
+			memcpy(nc->twig + s + 1, c->twig + s,
+			       sizeof(Trie) * (m - s));
+			if(publish(tbl, n, c, nc))
+				return(tbl);
+			free(nc);
+			continue;
+		}
+		Trie *t = &c->twig[s];
+		if(isbranch(t)) {
+			n = t->branch.node;
+			hnext(&hp);
+			continue;
+		}
+		// Replacing a value keeps the table's existing key.
+		Trie nt = *t;
+		if(leafmiss(t, hp.fp) || strcmp(key, t->leaf.key) != 0) {
+			Hpos x = hp; hnext(&x);
+			if(!newchain(&nt, x, t1, *t))
+				return(NULL);
+		} else {
+			leafset(&nt, val, hp.fp);
+		}
+		nc = twigalloc(c->map);
+		if(nc != NULL) {
+			memcpy(nc->twig, c->twig, sizeof(Trie) * m);
+			nc->twig[s] = nt;
+			if(publish(tbl, n, c, nc))
+				return(tbl);
+			free(nc);
+		}
+		if(isbranch(&nt))
+			freetrie(nt.branch.node);
+		if(nc == NULL)
+			return(NULL);
+	}
+}
@@ -0,0 +1,201 @@
+// hc.h: hash array mapped tries with lock-free concurrent inserts
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This is a clone-and-hack of ht.h rearranged along the lines of
+// Prokopec's Ctrie, so that Tsetl() and Tgetkv() can be called from
+// many threads at once without locks.
+//
+// A twig array is never changed after it is published. A branch twig
+// points to an indirection node which never moves, and which points to
+// the branch's current twig array. The bitmap lives with the twigs, so
+// a writer changes a branch by making a modified copy of its twig array
+// and swinging the indirection node's pointer with one compare-and-swap.
+// If another writer got there first, the copy is discarded and the
+// writer tries again from the same node, so a failed CAS only repeats
+// work at one level of the trie.
+//
+// The arrays that a CAS replaces might still be in use by other
+// threads, so they are kept on a list in the Tbl until Tcollect() is
+// called when no other threads are using the table. Because replaced
+// memory is never reused while threads are running, a CAS cannot be
+// fooled by an address that was freed and allocated again. Deletion is
+// not concurrent: Tdelkv() frees memory immediately and also empties
+// the garbage list.
+//
+// Without deletion or snapshots there is no need for the generation
+// counters that Ctrie uses to detect that part of a path was copied;
+// indirection nodes are only created or freed by a single thread.
+//
+// Otherwise the trie is like ht.c: SipHash with a random key, lglgN
+// bits per level, canonical chains of one-twig branches, and hash
+// fingerprints in the spare bits of leaf values.
+
+typedef unsigned char byte;
+typedef unsigned int uint;
+
+// Word size parameters, as in ht.h
+
+#if UINTPTR_MAX == 0xFFFFFFFFFFFFFFFF
+
+#define   lgN 64
+#define lglgN 6
+
+static inline uint
+popcount(uintptr_t w) {
+	return((uint)__builtin_popcountll(w));
+}
+
+#endif
+#if UINTPTR_MAX == 0xFFFFFFFF
+
+#define   lgN 32
+#define lglgN 5
+
+static inline uint
+popcount(uintptr_t w) {
+	return((uint)__builtin_popcount(w));
+}
+
+#endif
+
+#define Hbits 64
+
+extern int
+siphash(uint8_t *out, const uint8_t *in, uint64_t inlen, const uint8_t *k);
+
+// The fingerprint uses the value pointer's word-alignment bits except
+// for the bottom one, which distinguishes leaves from branches.
+#define FPMASK ((uintptr_t)sizeof(void*) - 2)
+
+typedef struct Tleaf {
+	const char *key;
+	void *val;
+} Tleaf;
+
+// The indirection node is in the first word so that the second word
+// has the same tag bit as a leaf's value.
+typedef struct Tbranch {
+	struct Tnode *node;
+	uintptr_t tag;
+} Tbranch;
+
+typedef union Trie {
+	struct Tleaf   leaf;
+	struct Tbranch branch;
+} Trie;
+
+typedef struct Twigs {
+	uintptr_t map;
+	struct Twigs *retired;
+	union Trie twig[];
+} Twigs;
+
+typedef struct Tnode {
+	Twigs *twigs;
+} Tnode;
+
+// The root is always a branch, which is allowed to have a single leaf.
+//
+struct Tbl {
+	Tnode root;
+	Twigs *garbage;
+};
+
+static inline bool
+isbranch(Trie *t) {
+	return(t->branch.tag & 1);
+}
+
+static inline void
+branchset(Trie *t, Tnode *n) {
+	t->branch.node = n;
+	t->branch.tag = 1;
+}
+
+static inline Twigs *
+twigs(Tnode *n) {
+	return(__atomic_load_n(&n->twigs, __ATOMIC_ACQUIRE));
+}
+
+static inline void *
+leafval(Trie *t) {
+	return((void*)((uintptr_t)t->leaf.val & ~FPMASK));
+}
+
+static inline void
+leafset(Trie *t, void *val, uintptr_t fp) {
+	t->leaf.val = (void*)((uintptr_t)val | fp);
+}
+
+static inline bool
+leafmiss(Trie *t, uintptr_t fp) {
+	return(((uintptr_t)t->leaf.val & FPMASK) != fp);
+}
+
+static inline uintptr_t
+twigbit(uint64_t h) {
+	return((uintptr_t)1 << (h & (lgN-1)));
+}
+
+static inline bool
+hastwig(Twigs *c, uintptr_t bit) {
+	return(c->map & bit);
+}
+
+static inline uint
+twigoff(Twigs *c, uintptr_t bit) {
+	return(popcount(c->map & (bit - 1)));
+}
+
+static inline uint
+twigmax(Twigs *c) {
+	return(popcount(c->map));
+}
+
+// The position of a lookup in the sequence of hashes of a key.
+//   d1: how many times the key has been hashed
+//   d2: how many bits of this hash have been used
+//   fp: the key's fingerprint
+//
+typedef struct Hpos {
+	const char *key;
+	size_t len;
+	uint64_t h;
+	uint d1, d2;
+	uintptr_t fp;
+} Hpos;
+
+extern uint64_t siphash_key[2];
+
+static inline uint64_t
+hash(const char *key, size_t len, uint depth) {
+	uint64_t h, stir[2] = {
+		siphash_key[0] ^ depth,
+		siphash_key[1] ^ depth,
+	};
+	siphash((void*)&h, (const void *)key, len, (void*)stir);
+	return(h);
+}
+
+static inline void
+hstart(Hpos *hp, const char *key, size_t len) {
+	hp->key = key;
+	hp->len = len;
+	hp->h = hash(key, len, 0);
+	hp->fp = (uintptr_t)(hp->h >> (Hbits - 4)) & FPMASK;
+	hp->d1 = 0;
+	hp->d2 = lglgN;
+}
+
+static inline void
+hnext(Hpos *hp) {
+	hp->d2 += lglgN;
+	hp->h >>= lglgN;
+	if(hp->d2 < Hbits)
+		return;
+	hp->h = hash(hp->key, hp->len, ++hp->d1);
+	hp->d2 = lglgN;
+}
@@ -0,0 +1 @@
+ht-debug.c
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "Tbl.h"
 #include "ht.h"
@@ -17,7 +18,9 @@ static void
 dump_rec(Trie *t, int d) {
 	if(isbranch(t)) {
 		printf("Tdump%*s branch %p\n", d, "", t);
-		for(uint i = 0; i < 64; i++) {
+		// A one-twig branch must lead to another branch.
+		assert(twigmax(t) > 1 || isbranch(twig(t, 0)));
+		for(uint i = 0; i < lgN; i++) {
 			uint64_t b = twigbit(i);
 			if(hastwig(t, b)) {
 				printf("Tdump%*s twig %d\n", d, "", i);
@@ -28,8 +31,10 @@ dump_rec(Trie *t, int d) {
 		printf("Tdump%*s leaf %p\n", d, "", t);
 		printf("Tdump%*s leaf key %p %s\n", d, "",
 		       t->leaf.key, t->leaf.key);
-		printf("Tdump%*s leaf val %p\n", d, "",
-		       t->leaf.val);
+		printf("Tdump%*s leaf val %p fp %zu\n", d, "",
+		       leafval(t), (size_t)t->leaf.val & FPMASK);
+		Hpos hp; hstart(&hp, t->leaf.key, strlen(t->leaf.key));
+		assert(!leafmiss(t, hp.fp));
 	}
 }
 
@@ -41,14 +46,16 @@ Tdump(Tbl *tbl) {
 }
 
 static void
-size_rec(Trie *t, uint d, size_t *rsize, size_t *rdepth, size_t *rleaves) {
+size_rec(Trie *t, uint d, size_t *rsize,
+	 size_t *rdepth, size_t *rbranches, size_t *rleaves) {
 	*rsize += sizeof(*t);
 	if(isbranch(t)) {
-		for(uint i = 0; i < 64; i++) {
+		*rbranches += 1;
+		for(uint i = 0; i < lgN; i++) {
 			uint64_t b = twigbit(i);
 			if(hastwig(t, b))
 				size_rec(twig(t, twigoff(t, b)), d+1,
-					 rsize, rdepth, rleaves);
+					 rsize, rdepth, rbranches, rleaves);
 		}
 	} else {
 		*rdepth += d;
@@ -58,9 +65,9 @@ size_rec(Trie *t, uint d, size_t *rsize, size_t *rdepth, size_t *rleaves) {
 
 void
 Tsize(Tbl *tbl, const char **rtype,
-      size_t *rsize, size_t *rdepth, size_t *rleaves) {
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
 	*rtype = "ht";
-	*rsize = *rdepth = *rleaves = 0;
+	*rsize = *rdepth = *rbranches = *rleaves = 0;
 	if(tbl != NULL)
-		size_rec(tbl, 0, rsize, rdepth, rleaves);
+		size_rec(&tbl->root, 0, rsize, rdepth, rbranches, rleaves);
 }
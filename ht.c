@@ -1,4 +1,4 @@
-// qp.c: tables implemented with hash array mapped tries
+// ht.c: tables implemented with hash array mapped tries
 //
 // Written by Tony Finch <dot@dotat.at>
 // You may do anything with this. It has no warranty.
@@ -11,190 +11,216 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sys/random.h>
+
 #include "Tbl.h"
 #include "ht.h"
 
-static inline uint64_t
-hash(const char *key, size_t len, uint depth) {
-	uint64_t h, stir[2] = { depth, depth };
-	siphash((void*)&h, (const void *)key, len, (void*)stir);
-	return(h);
+#ifndef WITH_FAST_HASH
+
+uint64_t siphash_key[2];
+
+// If there is no entropy the key stays zero, which still works but
+// is predictable.
+//
+static void __attribute__((constructor))
+siphash_init(void) {
+	(void)getentropy(siphash_key, sizeof(siphash_key));
 }
 
+#endif
+
 bool
 Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 	if(tbl == NULL)
 		return(false);
 	Trie *t = &tbl->root;
-	for(uint d1 = 0 ;; ++d1) {
-		uint64_t h = hash(key, len, d1);
-		for(uint d2 = lglgN; d2 < Hbits; d2 += lglgN, h >>= lglgN) {
-			if(!isbranch(t))
-				goto leaf;
-			uintptr_t b = twigbit(h);
-			if(!hastwig(t, b))
-				return(false);
-			t = twig(t, twigoff(t, b));
-		}
+	Hpos hp; hstart(&hp, key, len);
+	while(isbranch(t)) {
+		uintptr_t b = twigbit(hp.h);
+		if(!hastwig(t, b))
+			return(false);
+		t = twig(t, twigoff(t, b));
+		hnext(&hp);
 	}
-leaf:	if(strcmp(key, t->leaf.key) != 0)
+	if(leafmiss(t, hp.fp) || strcmp(key, t->leaf.key) != 0)
 		return(false);
 	*pkey = t->leaf.key;
-	*pval = t->leaf.val;
+	*pval = leafval(t);
 	return(true);
 }
 
-static bool
-next_rec(Trie *t, const char **pkey, size_t *plen, void **pval,
-	 uint64_t h, uint d1, uint d2) {
+// Find the smallest key that is greater than prev.
+//
+static void
+next_rec(Trie *t, const char *prev, Trie **next) {
 	if(isbranch(t)) {
-		if(d2 >= Hbits) {
-			h = *pkey == NULL ? 0 :
-				hash(*pkey, *plen, d1++);
-			d2 = lglgN;
-		}
-		uintptr_t b = twigbit(h);
-		uint s = twigoff(t, b);
-		uint m = twigmax(t);
-		for(; s < m; s++)
-			if(next_rec(twig(t, s), pkey, plen, pval,
-				    h >> lglgN, d1, d2 + lglgN))
-				return(true);
-			else
-				h = 0;
-		return(false);
-	}
-	// We have found the next leaf.
-	if(*pkey == NULL) {
-		*pkey = t->leaf.key;
-		*plen = strlen(*pkey);
-		*pval = t->leaf.val;
-		return(true);
-	}
-	// We have found this leaf, so start looking for the next one.
-	if(strcmp(*pkey, t->leaf.key) == 0) {
-		*pkey = NULL;
-		*plen = 0;
-		return(false);
+		for(uint s = 0, m = twigmax(t); s < m; s++)
+			next_rec(twig(t, s), prev, next);
+		return;
 	}
-	// No match.
-	return(false);
+	if(prev != NULL && strcmp(t->leaf.key, prev) <= 0)
+		return;
+	if(*next == NULL || strcmp(t->leaf.key, (*next)->leaf.key) < 0)
+		*next = t;
 }
 
 bool
 Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
-	if(tbl == NULL) {
+	Trie *next = NULL;
+	if(tbl != NULL)
+		next_rec(&tbl->root, *pkey, &next);
+	if(next == NULL) {
 		*pkey = NULL;
 		*plen = 0;
-		return(NULL);
+		return(false);
 	}
-	return(next_rec(&tbl->root, pkey, plen, pval, 0, 0, Hbits));
+	*pkey = next->leaf.key;
+	*plen = strlen(*pkey);
+	*pval = leafval(next);
+	return(true);
 }
 
 Tbl *
 Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 	if(tbl == NULL)
 		return(NULL);
-	Trie *t = &tbl->root, *p = NULL;
-	uint64_t h = 0;
+	// top is the highest of a chain of one-twig branches above p
+	Trie *t = &tbl->root, *p = NULL, *top = NULL;
 	uintptr_t b = 0;
-	for(uint d1 = 0 ;; ++d1) {
-		h = hash(key, len, d1);
-		for(uint d2 = lglgN; d2 < Hbits; d2 += lglgN, h >>= lglgN) {
-			if(!isbranch(t))
-				goto leaf;
-			b = twigbit(h);
-			if(!hastwig(t, b))
-				return(tbl);
-			p = t; t = twig(t, twigoff(t, b));
+	Hpos hp; hstart(&hp, key, len);
+	while(isbranch(t)) {
+		b = twigbit(hp.h);
+		if(!hastwig(t, b))
+			return(tbl);
+		if(p != NULL && twigmax(p) == 1) {
+			if(top == NULL)
+				top = p;
+		} else {
+			top = NULL;
 		}
+		p = t; t = twig(t, twigoff(t, b));
+		hnext(&hp);
 	}
-leaf:	if(strcmp(key, t->leaf.key) != 0)
+	if(leafmiss(t, hp.fp) || strcmp(key, t->leaf.key) != 0)
 		return(tbl);
 	*pkey = t->leaf.key;
-	*pval = t->leaf.val;
+	*pval = leafval(t);
 	if(p == NULL) {
 		free(tbl);
 		return(NULL);
 	}
 	t = p; p = NULL; // Becuase t is the usual name
 	uint s = twigoff(t, b), m = twigmax(t);
-	if(m == 2) {
-		// Move the other twig to the parent branch.
-		// XXX: May need to unsplice deep hash collision here.
-		Trie *twigs = twig(t, 0);
-		*t = *twig(t, !s);
-		free(twigs);
+	if(m == 2 && !isbranch(twig(t, !s))) {
+		// Move the other leaf up to the top of the chain of
+		// one-twig branches (if any) above this branch, and
+		// free the chain.
+		Trie leaf = *twig(t, !s);
+		Trie *up = top != NULL ? top : t;
+		free(twig(t, 0));
+		for(Trie *x = up; x != t; ) {
+			Trie *down = twig(x, 0);
+			if(x != up) free(x);
+			x = down;
+		}
+		if(t != up) free(t);
+		*up = leaf;
 		return(tbl);
 	}
-	Trie *twigs = malloc(sizeof(Trie) * (m - 1));
-	if(twigs == NULL) return(NULL);
-	memcpy(twigs, twig(t, 0), sizeof(Trie) * s);
-	memcpy(twigs+s, twig(t, s+1), sizeof(Trie) * (m - s - 1));
-	free(twig(t, 0));
-	twigset(t, twigs);
+	// If the other twig is a branch it must stay at this depth,
+	// so this branch is left with one twig.
+	memmove(twig(t, s), twig(t, s+1), sizeof(Trie) * (m - s - 1));
 	t->branch.map &= ~b;
+	// We have now correctly removed the twig from the trie, so if
+	// realloc() fails we can ignore it and continue to use the
+	// slightly oversized twig array.
+	Trie *twigs = realloc(twig(t, 0), sizeof(Trie) * (m - 1));
+	if(twigs != NULL) twigset(t, twigs);
 	return(tbl);
 }
 
 Tbl *
 Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
-	// Ensure flag bits are zero.
-	if(((uintptr_t)val & 1) != 0) {
+	// Ensure flag and fingerprint bits are zero.
+	if(((uintptr_t)val & (FPMASK | 1)) != 0) {
 		errno = EINVAL;
 		return(NULL);
 	}
 	if(val == NULL)
 		return(Tdell(tbl, key, len));
+	Hpos hp; hstart(&hp, key, len);
 	// First leaf in an empty tbl?
 	if(tbl == NULL) {
 		tbl = malloc(sizeof(*tbl));
 		if(tbl == NULL) return(NULL);
 		tbl->root.leaf.key = key;
-		tbl->root.leaf.val = val;
+		leafset(&tbl->root, val, hp.fp);
 		return(tbl);
 	}
 	Trie *t = &tbl->root;
-	Trie t1 = { .leaf = { .key = key, .val = val } };
-	uint d1, d2;
+	Trie t1 = { .leaf = { .key = key } };
+	leafset(&t1, val, hp.fp);
 	uintptr_t b1;
-	for(d1 = 0 ;; ++d1) {
-		uint64_t h = hash(key, len, d1);
-		for(d2 = lglgN; d2 < Hbits; d2 += lglgN, h >>= lglgN) {
-			b1 = twigbit(h);
-			if(!isbranch(t))
-				goto leaf;
-			if(!hastwig(t, b1))
-				goto growbranch;
-			t = twig(t, twigoff(t, b1));
-		}
+	while(isbranch(t)) {
+		b1 = twigbit(hp.h);
+		if(!hastwig(t, b1))
+			goto growbranch;
+		t = twig(t, twigoff(t, b1));
+		hnext(&hp);
 	}
-leaf:	if(strcmp(key, t->leaf.key) != 0)
-		goto newbranch;
-	t->leaf.val = val;
-	return(tbl);
-newbranch:;
-	// XXX May need multiple levels of trie here.
-	Trie *twigs = malloc(sizeof(Trie) * 2);
+	if(!leafmiss(t, hp.fp) && strcmp(key, t->leaf.key) == 0) {
+		leafset(t, val, hp.fp);
+		return(tbl);
+	}
+	// Find where the old leaf's hash differs from the new key's hash.
+	// Each hash is different so this loop terminates.
+	Hpos h2; hstart(&h2, t->leaf.key, strlen(t->leaf.key));
+	while(h2.d1 < hp.d1 || h2.d2 < hp.d2)
+		hnext(&h2);
+	uint chain = 0;
+	for(Hpos x1 = hp, x2 = h2; twigbit(x1.h) == twigbit(x2.h); chain++) {
+		hnext(&x1);
+		hnext(&x2);
+	}
+	// Allocate all the twig arrays before changing the trie.
+	Trie **twigs = malloc(sizeof(*twigs) * (chain + 1));
 	if(twigs == NULL) return(NULL);
-	Trie t2 = *t; // Save before overwriting.
-	uint64_t h2 = hash(t->leaf.key, strlen(t->leaf.key), d1);
-	uint64_t b2 = twigbit(h2 >>= d2 - lglgN);
+	for(uint i = 0; i <= chain; i++) {
+		twigs[i] = malloc(sizeof(Trie) * (i < chain ? 1 : 2));
+		if(twigs[i] != NULL)
+			continue;
+		while(i > 0)
+			free(twigs[--i]);
+		free(twigs);
+		return(NULL);
+	}
+	Trie t2 = *t;
+	for(uint i = 0; i < chain; i++) {
+		t->branch.map = twigbit(hp.h);
+		twigset(t, twigs[i]);
+		t = twig(t, 0);
+		hnext(&hp);
+		hnext(&h2);
+	}
+	b1 = twigbit(hp.h);
+	uintptr_t b2 = twigbit(h2.h);
 	t->branch.map = b1 | b2;
-	twigset(t, twigs);
+	twigset(t, twigs[chain]);
 	*twig(t, twigoff(t, b1)) = t1;
 	*twig(t, twigoff(t, b2)) = t2;
+	free(twigs);
 	return(tbl);
 growbranch:;
 	assert(!hastwig(t, b1));
 	uint s = twigoff(t, b1), m = twigmax(t);
-	twigs = malloc(sizeof(Trie) * (m + 1));
-	if(twigs == NULL) return(NULL);
-	memcpy(twigs, twig(t, 0), sizeof(Trie) * s);
-	memcpy(twigs+s, &t1, sizeof(Trie));
-	memcpy(twigs+s+1, twig(t, s), sizeof(Trie) * (m - s));
+	Trie *nt = malloc(sizeof(Trie) * (m + 1));
+	if(nt == NULL) return(NULL);
+	memcpy(nt, twig(t, 0), sizeof(Trie) * s);
+	memcpy(nt+s, &t1, sizeof(Trie));
+	memcpy(nt+s+1, twig(t, s), sizeof(Trie) * (m - s));
 	free(twig(t, 0));
-	twigset(t, twigs);
+	twigset(t, nt);
 	t->branch.map |= b1;
 	return(tbl);
 }
@@ -4,6 +4,35 @@
 // You may do anything with this. It has no warranty.
 // <http://creativecommons.org/publicdomain/zero/1.0/>
 
+// A hash array mapped trie (HAMT) is a trie keyed on a hash of the
+// key, so it is only useful for point lookups. It uses lglgN bits of
+// the hash at each level, and a branch has a bitmap of lgN bits
+// marking which twigs are present, like a qp trie with wider nodes.
+//
+// When we run out of hash bits we hash the key again with a different
+// seed for each successive 64 bit hash. That only happens when keys
+// collide in the first 60 bits, so an operation usually computes one
+// hash. A leaf lives at the shallowest point where its hash is
+// different from every other key, so two keys whose hashes share a
+// prefix are separated by a chain of branches that each have one twig;
+// deleting one of the keys collapses the chain again.
+//
+// By default the hash is SipHash with a random key; -DWITH_FAST_HASH
+// selects a faster unkeyed hash for trusted keys.
+//
+// Each leaf keeps a few bits of its key's hash in the spare alignment
+// bits of its value pointer, as a fingerprint. They come from bits
+// 60-63 of the first hash: depths 0-9 branch on bits 0-59, and depth
+// 10 starts on the second hash, so the fingerprint bits are not used
+// for branching and do not depend on the leaf's depth. A lookup for a
+// missing key that reaches a leaf can usually reject it without
+// reading the leaf's key. -DWITHOUT_FINGERPRINT turns this off, to
+// measure what it saves.
+//
+// The hash has no order, so Tnextl() has to search the whole trie for
+// the key that follows the previous one, like oa.c, which means that
+// iterating over a table takes quadratic time.
+
 typedef unsigned char byte;
 typedef unsigned int uint;
 
@@ -45,6 +74,10 @@ extern int
 siphash(uint8_t *out, const uint8_t *in, uint64_t inlen, const uint8_t *k);
 
 
+// The fingerprint uses the value pointer's word-alignment bits except
+// for the bottom one, which distinguishes leaves from branches.
+#define FPMASK ((uintptr_t)sizeof(void*) - 2)
+
 typedef struct Tleaf {
 	const char *key;
 	void *val;
@@ -69,6 +102,26 @@ isbranch(Trie *t) {
 	return(t->branch.twigs & 1);
 }
 
+static inline void *
+leafval(Trie *t) {
+	return((void*)((uintptr_t)t->leaf.val & ~FPMASK));
+}
+
+static inline void
+leafset(Trie *t, void *val, uintptr_t fp) {
+	t->leaf.val = (void*)((uintptr_t)val | fp);
+}
+
+static inline bool
+leafmiss(Trie *t, uintptr_t fp) {
+#ifdef WITHOUT_FINGERPRINT
+	(void)t, (void)fp;
+	return(false);
+#else
+	return(((uintptr_t)t->leaf.val & FPMASK) != fp);
+#endif
+}
+
 static inline uintptr_t
 twigbit(uint64_t h) {
 	return((uintptr_t)1 << (h & (lgN-1)));
@@ -98,3 +151,92 @@ static inline void
 twigset(Trie *t, Trie *twigs) {
 	t->branch.twigs = (uintptr_t)twigs | 1;
 }
+
+// The position of a lookup in the sequence of hashes of a key.
+//   d1: how many times the key has been hashed
+//   d2: how many bits of this hash have been used
+//   fp: the key's fingerprint
+//
+typedef struct Hpos {
+	const char *key;
+	size_t len;
+	uint64_t h;
+	uint d1, d2;
+	uintptr_t fp;
+} Hpos;
+
+#ifdef WITH_FAST_HASH
+
+// A multiply-mix hash in the style of wyhash, which is several times
+// faster than SipHash for short keys but is not keyed, so it is not
+// safe from hash flooding. The depth is mixed in first, so keys whose
+// hashes collide at one depth are unlikely to collide at the next.
+
+static inline uint64_t
+mum(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t)a * b;
+	return((uint64_t)r ^ (uint64_t)(r >> 64));
+}
+
+static inline uint64_t
+hash(const char *key, size_t len, uint depth) {
+	const uint64_t p0 = 0xa0761d6478bd642f;
+	const uint64_t p1 = 0xe7037ed1a0b428db;
+	const uint64_t p2 = 0x8ebc6af09c88c6e3;
+	const byte *p = (const byte *)key;
+	uint64_t w, h = mum(p0 ^ depth, p1 ^ len);
+	size_t n = len;
+	for(; n >= 8; n -= 8, p += 8) {
+		memcpy(&w, p, 8);
+		h = mum(h ^ w, p1);
+	}
+	if(n > 0) {
+		w = 0;
+		memcpy(&w, p, n);
+		h = mum(h ^ w, p2);
+	}
+	return(mum(h ^ len, p0));
+}
+
+#else
+
+// SipHash is keyed with a random secret, so an attacker cannot
+// choose keys that collide to make the trie deep.
+
+extern uint64_t siphash_key[2];
+
+static inline uint64_t
+hash(const char *key, size_t len, uint depth) {
+	uint64_t h, stir[2] = {
+		siphash_key[0] ^ depth,
+		siphash_key[1] ^ depth,
+	};
+	siphash((void*)&h, (const void *)key, len, (void*)stir);
+	return(h);
+}
+
+#endif
+
+static inline void
+hstart(Hpos *hp, const char *key, size_t len) {
+	hp->key = key;
+	hp->len = len;
+	hp->h = hash(key, len, 0);
+#ifdef WITHOUT_FINGERPRINT
+	hp->fp = 0;
+#else
+	hp->fp = (uintptr_t)(hp->h >> (Hbits - 4)) & FPMASK;
+#endif
+	hp->d1 = 0;
+	hp->d2 = lglgN;
+}
+
+static inline void
+hnext(Hpos *hp) {
+	hp->d2 += lglgN;
+	hp->h >>= lglgN;
+	if(hp->d2 < Hbits)
+		return;
+	hp->h = hash(hp->key, hp->len, ++hp->d1);
+	hp->d2 = lglgN;
+}
@@ -0,0 +1,122 @@
+// keys.c: DNS-trie key conversion microbenchmark.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/time.h>
+
+#include "Tbl.h"
+#include "dns.h"
+#include "util.h"
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s <count> <input>\n"
+"	Convert each name in the input to a key <count> times.\n"
+		, progname);
+	exit(1);
+}
+
+static struct timeval tu;
+
+static void
+start(const char *s) {
+	printf("%s... ", s);
+	fflush(stdout);
+	gettimeofday(&tu, NULL);
+}
+
+static void
+done(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	tv.tv_sec -= tu.tv_sec;
+	tv.tv_usec -= tu.tv_usec;
+	if(tv.tv_usec < 0) {
+		tv.tv_sec -= 1;
+		tv.tv_usec += 1000000;
+	}
+	printf("%ld.%06ld s\n",
+	       (long)tv.tv_sec, (long)tv.tv_usec);
+}
+
+// stdtext_to_key() crashes on names that are not valid, so we only
+// give it names with labels of 1 to 63 bytes and no escapes.
+//
+static bool
+hostname(const char *name) {
+	size_t llen = 0;
+	for(const char *p = name; *p != '\0'; p++) {
+		if(*p == '\\')
+			return(false);
+		if(*p != '.')
+			llen++;
+		else if(llen == 0)
+			return(false);
+		else
+			llen = 0;
+		if(llen > 62)
+			return(false);
+	}
+	return(*name != '\0');
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	if(argc != 3 || argv[1][0] == '-') usage();
+	size_t N = (size_t)atoi(argv[1]);
+
+	char *fbuf;
+	size_t lines, l, hosts = 0, bytes = 0;
+	char **line = read_lines(argv[2], &lines, &fbuf);
+	for(l = 0; l < lines; l++) {
+		bytes += strlen(line[l]);
+		if(hostname(line[l]))
+			line[hosts++] = line[l];
+	}
+	printf("- got %zu lines, %zu bytes, %zu hostnames\n",
+	       lines, bytes, hosts);
+
+	// The checksums should not depend on how the keys are converted,
+	// so they can be compared between variant builds.
+	Key key;
+	size_t total = 0;
+	uint32_t sum = 0;
+	for(l = 0; l < hosts; l++) {
+		size_t len = text_to_key((const byte *)line[l], key);
+		for(size_t k = 0; k <= len; k++)
+			sum = sum * 33 + key[k];
+	}
+	printf("- text checksum %08x\n", sum);
+	sum = 0;
+	for(l = 0; l < hosts; l++) {
+		size_t len = stdtext_to_key((const byte *)line[l], key);
+		for(size_t k = 0; k <= len; k++)
+			sum = sum * 33 + key[k];
+	}
+	printf("- stdtext checksum %08x\n", sum);
+
+	start("text");
+	for(size_t i = 0; i < N; i++)
+		for(l = 0; l < hosts; l++)
+			total += text_to_key((const byte *)line[l], key);
+	done();
+
+	start("stdtext");
+	for(size_t i = 0; i < N; i++)
+		for(l = 0; l < hosts; l++)
+			total += stdtext_to_key((const byte *)line[l], key);
+	done();
+
+	printf("- %zu key bytes\n", total);
+	return(0);
+}
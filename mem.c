@@ -0,0 +1,290 @@
+// mem.c: exact memory accounting for table implementations.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Tsize() counts the nodes in a trie, but it does not know that malloc()
+// rounds each allocation up to a size class and adds its own header.
+// This program is linked with -Wl,--wrap=malloc etc. so that every
+// allocation made by the table implementation goes through the wrappers
+// below, which record how many bytes were requested and how many
+// malloc_usable_size() says were allocated, for each request size.
+//
+// Each twig array is a separate allocation, so when the request size
+// is a whole number of nodes the histogram of request sizes is also the
+// histogram of branch fan-out. (The table header is usually the size of
+// one node, so it appears as one twig.)
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "util.h"
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s <input>\n"
+"	Load each line of the input into a table and report how much\n"
+"	memory the table uses, including allocator overhead.\n"
+		, progname);
+	exit(1);
+}
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+int __real_posix_memalign(void **ptr, size_t align, size_t size);
+
+// glibc puts a word of bookkeeping before each chunk, which is not
+// included in the usable size.
+//
+#ifdef __GLIBC__
+#define HEADER sizeof(size_t)
+#else
+#define HEADER 0
+#endif
+
+// Statistics for each request size; the last one is for anything bigger.
+//
+#define SIZES 4096
+
+typedef struct Class {
+	size_t count, requested, allocated;
+} Class;
+
+static Class class[SIZES + 1];
+
+// The request size of each live allocation, so that we know which
+// class to debit when it is freed. This is an open-addressed hash table
+// with linear probing, and deletion by shifting entries backwards.
+//
+typedef struct Live {
+	void *ptr;
+	size_t size;
+} Live;
+
+static Live *live;
+static size_t lives, maxlives;
+
+// Allocations are only accounted after the input has been loaded.
+//
+static bool accounting;
+
+static inline size_t
+hash(void *ptr, size_t mask) {
+	return((size_t)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15) & mask);
+}
+
+static void
+live_add(void *ptr, size_t size);
+
+static void
+live_grow(void) {
+	Live *old = live;
+	size_t max = maxlives;
+	maxlives = max == 0 ? 1024 : max * 2;
+	live = __real_calloc(maxlives, sizeof(*live));
+	if(live == NULL) die("calloc");
+	lives = 0;
+	for(size_t i = 0; i < max; i++)
+		if(old[i].ptr != NULL)
+			live_add(old[i].ptr, old[i].size);
+	__real_free(old);
+}
+
+static void
+live_add(void *ptr, size_t size) {
+	if(lives * 2 >= maxlives)
+		live_grow();
+	size_t mask = maxlives - 1;
+	size_t i = hash(ptr, mask);
+	while(live[i].ptr != NULL)
+		i = (i + 1) & mask;
+	live[i].ptr = ptr;
+	live[i].size = size;
+	lives++;
+}
+
+// Pointers that were allocated before the wrappers were linked in, or
+// by the unaccounted allocations in main(), are not found.
+//
+static bool
+live_del(void *ptr, size_t *psize) {
+	if(maxlives == 0)
+		return(false);
+	size_t mask = maxlives - 1;
+	size_t i = hash(ptr, mask);
+	while(live[i].ptr != ptr) {
+		if(live[i].ptr == NULL)
+			return(false);
+		i = (i + 1) & mask;
+	}
+	*psize = live[i].size;
+	for(size_t j = (i + 1) & mask; live[j].ptr != NULL; j = (j + 1) & mask) {
+		size_t h = hash(live[j].ptr, mask);
+		// move j into the hole at i unless its home is between them
+		if(((j - h) & mask) >= ((j - i) & mask)) {
+			live[i] = live[j];
+			i = j;
+		}
+	}
+	live[i].ptr = NULL;
+	lives--;
+	return(true);
+}
+
+static void
+account(void *ptr, size_t size) {
+	if(ptr == NULL || !accounting)
+		return;
+	Class *c = &class[size < SIZES ? size : SIZES];
+	c->count += 1;
+	c->requested += size;
+	c->allocated += malloc_usable_size(ptr) + HEADER;
+	live_add(ptr, size);
+}
+
+static void
+unaccount(void *ptr) {
+	size_t size;
+	if(ptr == NULL || !live_del(ptr, &size))
+		return;
+	Class *c = &class[size < SIZES ? size : SIZES];
+	c->count -= 1;
+	c->requested -= size;
+	c->allocated -= malloc_usable_size(ptr) + HEADER;
+}
+
+void *
+__wrap_malloc(size_t size) {
+	void *ptr = __real_malloc(size);
+	account(ptr, size);
+	return(ptr);
+}
+
+void *
+__wrap_calloc(size_t n, size_t size) {
+	void *ptr = __real_calloc(n, size);
+	account(ptr, n * size);
+	return(ptr);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size) {
+	size_t old = 0;
+	bool tracked = ptr != NULL && live_del(ptr, &old);
+	Class *c = &class[old < SIZES ? old : SIZES];
+	size_t usable = tracked ? malloc_usable_size(ptr) + HEADER : 0;
+	void *new = __real_realloc(ptr, size);
+	if(new == NULL && size != 0) {
+		if(tracked)
+			live_add(ptr, old);
+		return(NULL);
+	}
+	if(tracked) {
+		c->count -= 1;
+		c->requested -= old;
+		c->allocated -= usable;
+	}
+	account(new, size);
+	return(new);
+}
+
+void
+__wrap_free(void *ptr) {
+	unaccount(ptr);
+	__real_free(ptr);
+}
+
+int
+__wrap_posix_memalign(void **ptr, size_t align, size_t size) {
+	int r = __real_posix_memalign(ptr, align, size);
+	if(r == 0)
+		account(*ptr, size);
+	return(r);
+}
+
+// Print a summary, then a line for each request size, like
+//	MEM qp keys 100000 bytes/key 31.20 requested 2841216 ...
+//	- bytes 32 twigs 2 count 20731 requested 663392 allocated 663392
+//
+static void
+report(Tbl *t, const char *input) {
+	const char *type;
+	size_t size, depth, branches, leaves;
+	Tsize(t, &type, &size, &depth, &branches, &leaves);
+	size_t node = branches + leaves == 0 ? 0 : size / (branches + leaves);
+	Class total = { 0, 0, 0 };
+	for(size_t i = 0; i <= SIZES; i++) {
+		total.count += class[i].count;
+		total.requested += class[i].requested;
+		total.allocated += class[i].allocated;
+	}
+	double keys = leaves == 0 ? 1 : (double)leaves;
+	printf("MEM %s %s keys %zu bytes/key %.2f requested/key %.2f "
+	       "allocations %zu requested %zu allocated %zu "
+	       "fragmentation %.2f%%\n",
+	       type, input, leaves,
+	       (double)total.allocated / keys,
+	       (double)total.requested / keys,
+	       total.count, total.requested, total.allocated,
+	       total.allocated == 0 ? 0.0 :
+	       100.0 * (double)(total.allocated - total.requested) /
+	       (double)total.allocated);
+	for(size_t i = 0; i <= SIZES; i++) {
+		Class *c = &class[i];
+		if(c->count == 0)
+			continue;
+		if(i == SIZES)
+			printf("- bytes >%d", SIZES - 1);
+		else
+			printf("- bytes %zu", i);
+		if(node != 0 && i < SIZES && i % node == 0)
+			printf(" twigs %zu", i / node);
+		printf(" count %zu requested %zu allocated %zu waste %.2f%%\n",
+		       c->count, c->requested, c->allocated,
+		       100.0 * (double)(c->allocated - c->requested) /
+		       (double)c->allocated);
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	if(argc != 2 || argv[1][0] == '-') usage();
+
+	char *fbuf;
+	size_t lines, l;
+	char **line = read_lines(argv[1], &lines, &fbuf);
+	accounting = true;
+
+	// values must be word aligned, so they point to the line array
+	Tbl *t = NULL;
+	for(l = 0; l < lines; l++) {
+		t = Tset(t, line[l], &line[l]);
+		if(t == NULL) die("Tset");
+	}
+#if defined(WITH_CONCURRENCY)
+	// free the memory that concurrent changes leave for readers
+	Tcollect(t);
+#endif
+	report(t, argv[1]);
+
+	for(l = 0; l < lines; l++)
+		t = Tset(t, line[l], NULL);
+	if(t != NULL || lives != 0) {
+		fprintf(stderr, "%s: %zu allocations leaked\n",
+			progname, lives);
+		exit(1);
+	}
+	free(line);
+	free(fbuf);
+	return(0);
+}
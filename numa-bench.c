@@ -0,0 +1,159 @@
+// numa-bench.c: lookups in one shared table and in per-node copies
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// The table is built from the input by the main thread, so it lives
+// on the main thread's node, and then it is published to a copy on
+// each node. We run with 1, 2, 4, ... threads up to the maximum, spread
+// across the nodes, first searching the shared table and then the copy
+// on each thread's node.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "replica.h"
+#include "util.h"
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s [-n <nodes>] <seed> <count> <input> <threads>\n"
+"	The seed must be at least 12 characters.\n"
+"	Each thread makes <count> lookups of random lines of the input.\n"
+"	The number of threads doubles up to <threads>.\n"
+"	-n <nodes>	divide the CPUs into emulated NUMA nodes\n"
+		, progname);
+	exit(1);
+}
+
+static Replicas *replicas;
+static Tbl *master;
+static char **line;
+static size_t lines, N;
+static bool local;
+
+// Each thread's counters are in their own cache line.
+//
+typedef struct Thread {
+	pthread_t tid;
+	size_t id;
+	uint64_t rng;
+	size_t found;
+	double secs;
+} __attribute__((aligned(64))) Thread;
+
+static void *
+run_thread(void *arg) {
+	Thread *r = arg;
+	if(!replicas_pin(replicas, r->id))
+		die("replicas_pin");
+	Rreader *reader = replicas_reader(replicas);
+	if(reader == NULL)
+		die("replicas_reader");
+	double t0 = now_sec();
+	replicas_enter(reader);
+	for(size_t i = 0; i < N; i++) {
+		const char *key = line[xorshift(&r->rng) % lines], *rkey;
+		void *val;
+		if(local)
+			r->found += replicas_get(reader, key, strlen(key), &val);
+		else
+			r->found += Tgetkv(master, key, strlen(key), &rkey, &val);
+	}
+	replicas_leave(reader);
+	r->secs = now_sec() - t0;
+	replicas_reader_free(reader);
+	return(NULL);
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	unsigned nodes = 0;
+	if(argc > 2 && strcmp(argv[1], "-n") == 0) {
+		nodes = (unsigned)atoi(argv[2]);
+		if(nodes < 1) usage();
+		argv += 2;
+		argc -= 2;
+	}
+	if(argc != 5 || argv[1][0] == '-') usage();
+	if(ssrandom(argv[1]) < 0) usage();
+	N = (size_t)atoi(argv[2]);
+	size_t T = (size_t)atoi(argv[4]);
+	if(T < 1) usage();
+
+	char *fbuf;
+	line = read_lines(argv[3], &lines, &fbuf);
+	if(lines == 0) usage();
+	for(size_t l = 0; l < lines; l++) {
+		master = Tsetl(master, line[l], strlen(line[l]), &line[l]);
+		if(master == NULL) die("Tsetl");
+	}
+
+	replicas = replicas_create(nodes);
+	if(replicas == NULL) die("replicas_create");
+	double t0 = now_sec();
+	if(!replicas_publish(replicas, master)) die("replicas_publish");
+	printf("- got %zu lines, published to %u nodes in %.3f s\n", lines,
+	       replicas_nodes(replicas), now_sec() - t0);
+
+	Thread *thread = NULL;
+	errno = posix_memalign((void **)&thread, 64, T * sizeof(*thread));
+	if(errno != 0) die("posix_memalign");
+
+	for(size_t n = 1;; n = n * 2 < T ? n * 2 : T) {
+		for(int pass = 0; pass < 2; pass++) {
+			local = pass;
+			for(size_t i = 0; i < n; i++) {
+				memset(&thread[i], 0, sizeof(thread[i]));
+				thread[i].id = i;
+				thread[i].rng = (uint64_t)random() << 32 |
+						(uint64_t)random() | 1;
+			}
+			t0 = now_sec();
+			for(size_t i = 0; i < n; i++) {
+				errno = pthread_create(&thread[i].tid, NULL,
+						       run_thread, &thread[i]);
+				if(errno != 0) die("pthread_create");
+			}
+			for(size_t i = 0; i < n; i++)
+				pthread_join(thread[i].tid, NULL);
+			double secs = now_sec() - t0;
+			printf("%s threads %zu: %.3f Mops/s in %.3f s\n",
+			       local ? "local " : "shared", n,
+			       (double)(n * N) / secs / 1e6, secs);
+			for(size_t i = 0; i < n; i++) {
+				if(thread[i].found == N)
+					continue;
+				fprintf(stderr, "%s: thread %zu found %zu/%zu\n",
+					progname, i, thread[i].found, N);
+				exit(1);
+			}
+		}
+		if(n == T)
+			break;
+	}
+
+	replicas_destroy(replicas);
+	while(master != NULL) {
+		const char *key = NULL;
+		size_t len = 0;
+		void *val;
+		Tnextl(master, &key, &len, &val);
+		master = Tdell(master, key, len);
+	}
+	free(thread);
+	free(line);
+	free(fbuf);
+	return(0);
+}
@@ -0,0 +1,53 @@
+// oa-debug.c: open-addressing hash table debug support
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Tbl.h"
+#include "oa.h"
+
+void
+Tdump(Tbl *tbl) {
+	printf("Tdump root %p\n", tbl);
+	if(tbl == NULL)
+		return;
+	printf("Tdump count %zu size %zu\n", tbl->count, tbl->mask + 1);
+	size_t count = 0;
+	for(size_t i = 0; i <= tbl->mask; i++) {
+		Slot *s = &tbl->slot[i];
+		if(s->key == NULL)
+			continue;
+		count++;
+		printf("Tdump slot %zu home %zu\n", i,
+		       (size_t)hash(s->key) & tbl->mask);
+		printf("Tdump slot key %p %s\n", s->key, s->key);
+		printf("Tdump slot val %p\n", s->val);
+	}
+	assert(count == tbl->count);
+}
+
+// The depth of an entry is its distance from its home slot.
+//
+void
+Tsize(Tbl *tbl, const char **rtype,
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	*rtype = "oa";
+	*rsize = *rdepth = *rbranches = *rleaves = 0;
+	if(tbl == NULL)
+		return;
+	*rsize = sizeof(*tbl) + sizeof(Slot) * (tbl->mask + 1);
+	for(size_t i = 0; i <= tbl->mask; i++) {
+		Slot *s = &tbl->slot[i];
+		if(s->key == NULL)
+			continue;
+		*rleaves += 1;
+		*rdepth += (i - (size_t)hash(s->key)) & tbl->mask;
+	}
+}
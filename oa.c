@@ -0,0 +1,147 @@
+// oa.c: tables implemented with open-addressing hash tables.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "oa.h"
+
+// Returns the slot containing the key, or the empty slot where it
+// should be inserted.
+//
+static Slot *
+probe(Tbl *tbl, const char *key) {
+	size_t i = (size_t)hash(key) & tbl->mask;
+	while(tbl->slot[i].key != NULL && strcmp(key, tbl->slot[i].key) != 0)
+		i = (i + 1) & tbl->mask;
+	return(&tbl->slot[i]);
+}
+
+bool
+Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	(void)len;
+	if(tbl == NULL)
+		return(false);
+	Slot *s = probe(tbl, key);
+	if(s->key == NULL)
+		return(false);
+	*pkey = s->key;
+	*pval = s->val;
+	return(true);
+}
+
+bool
+Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
+	Slot *next = NULL;
+	for(size_t i = 0; tbl != NULL && i <= tbl->mask; i++) {
+		Slot *s = &tbl->slot[i];
+		if(s->key == NULL)
+			continue;
+		if(*pkey != NULL && strcmp(s->key, *pkey) <= 0)
+			continue;
+		if(next == NULL || strcmp(s->key, next->key) < 0)
+			next = s;
+	}
+	if(next == NULL) {
+		*pkey = NULL;
+		*plen = 0;
+		return(false);
+	}
+	*pkey = next->key;
+	*plen = strlen(next->key);
+	*pval = next->val;
+	return(true);
+}
+
+// Move the entries into a new array of the given size. If that fails
+// when shrinking we can keep using the bigger array.
+//
+static Tbl *
+resize(Tbl *tbl, size_t size) {
+	Tbl *new = calloc(1, sizeof(*new) + sizeof(Slot) * size);
+	if(new == NULL)
+		return(NULL);
+	new->count = tbl->count;
+	new->mask = size - 1;
+	for(size_t i = 0; i <= tbl->mask; i++)
+		if(tbl->slot[i].key != NULL)
+			*probe(new, tbl->slot[i].key) = tbl->slot[i];
+	free(tbl);
+	return(new);
+}
+
+Tbl *
+Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	(void)len;
+	if(tbl == NULL)
+		return(NULL);
+	Slot *s = probe(tbl, key);
+	if(s->key == NULL)
+		return(tbl);
+	*pkey = s->key;
+	*pval = s->val;
+	if(--tbl->count == 0) {
+		free(tbl);
+		return(NULL);
+	}
+	// Fill the gap with a later entry whose home slot is not between
+	// the gap and the entry, until we reach an empty slot.
+	size_t mask = tbl->mask;
+	size_t i = (size_t)(s - tbl->slot);
+	for(size_t j = (i + 1) & mask; tbl->slot[j].key != NULL; j = (j + 1) & mask) {
+		size_t h = (size_t)hash(tbl->slot[j].key) & mask;
+		if(((j - h) & mask) >= ((j - i) & mask)) {
+			tbl->slot[i] = tbl->slot[j];
+			i = j;
+		}
+	}
+	tbl->slot[i].key = NULL;
+	tbl->slot[i].val = NULL;
+	if(mask + 1 > MINSIZE && tbl->count < (mask + 1) / 8) {
+		Tbl *new = resize(tbl, (mask + 1) / 2);
+		if(new != NULL)
+			tbl = new;
+	}
+	return(tbl);
+}
+
+Tbl *
+Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
+	// Ensure values are word-aligned, like the tries.
+	if(((uint64_t)val & 3) != 0) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if(val == NULL)
+		return(Tdell(tbl, key, len));
+	if(tbl == NULL) {
+		tbl = calloc(1, sizeof(*tbl) + sizeof(Slot) * MINSIZE);
+		if(tbl == NULL)
+			return(NULL);
+		tbl->mask = MINSIZE - 1;
+	}
+	Slot *s = probe(tbl, key);
+	if(s->key != NULL) {
+		s->val = val;
+		return(tbl);
+	}
+	if((tbl->count + 1) * 4 > (tbl->mask + 1) * 3) {
+		Tbl *new = resize(tbl, (tbl->mask + 1) * 2);
+		if(new == NULL)
+			return(NULL);
+		tbl = new;
+		s = probe(tbl, key);
+	}
+	s->key = key;
+	s->val = val;
+	tbl->count += 1;
+	return(tbl);
+}
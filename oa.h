@@ -0,0 +1,48 @@
+// oa.h: tables implemented with open-addressing hash tables.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This is a comparison baseline. The table is one array of key and
+// value pointers, searched with linear probing, so a lookup usually
+// needs one hash, one or two cache lines of the array, and one strcmp().
+// Deletion moves later entries in the probe sequence back into the gap,
+// so there are no tombstones. The array doubles when it is 3/4 full and
+// halves when it is 1/8 full, so the overhead is between 1/3 and 7
+// empty slots (of two words each) per entry.
+//
+// The hash is FNV-1a followed by the MurmurHash3 finalizer, which is
+// quick for short keys and mixes well enough for power-of-two tables.
+// This is not safe against hash flooding attacks.
+//
+// A hash table has no order, so Tnextl() has to scan the whole array to
+// find the key that follows the previous one. Iterating over a table
+// therefore takes quadratic time.
+
+typedef unsigned int uint;
+
+typedef struct Slot {
+	const char *key;
+	void *val;
+} Slot;
+
+struct Tbl {
+	size_t count, mask;
+	Slot slot[];
+};
+
+#define MINSIZE 8
+
+static inline uint64_t
+hash(const char *key) {
+	uint64_t h = 0xcbf29ce484222325;
+	for(const unsigned char *p = (const void *)key; *p != '\0'; p++)
+		h = (h ^ *p) * 0x100000001b3;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53;
+	h ^= h >> 33;
+	return(h);
+}
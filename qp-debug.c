@@ -39,8 +39,15 @@ dump_rec(Trie *t, int d) {
 void
 Tdump(Tbl *tbl) {
 	printf("Tdump root %p\n", tbl);
-	if(tbl != NULL)
-		dump_rec(&tbl->root, 0);
+	if(tbl == NULL)
+		return;
+	for(Trie *t = jumproot(tbl, "", 0); t < jumpend(tbl); t++) {
+		if(isempty(t))
+			continue;
+		if(jumpend(tbl) - jumproot(tbl, "", 0) > 1)
+			printf("Tdump slot %zu\n", (size_t)(t - jumproot(tbl, "", 0)));
+		dump_rec(t, 0);
+	}
 }
 
 static void
@@ -66,6 +73,12 @@ Tsize(Tbl *tbl, const char **rtype,
     size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
 	*rtype = "qp";
 	*rsize = *rdepth = *rbranches = *rleaves = 0;
-	if(tbl != NULL)
-		size_rec(&tbl->root, 0, rsize, rdepth, rbranches, rleaves);
+	if(tbl == NULL)
+		return;
+	for(Trie *t = jumproot(tbl, "", 0); t < jumpend(tbl); t++) {
+		if(isempty(t))
+			*rsize += sizeof(*t);
+		else
+			size_rec(t, 0, rsize, rdepth, rbranches, rleaves);
+	}
 }
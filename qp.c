@@ -13,26 +13,563 @@
 
 #include "Tbl.h"
 #include "qp.h"
+#include "trace.h"
 
-bool
-Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+#ifdef WITH_SNAPSHOTS
+
+// With -DWITH_SNAPSHOTS, each twig array has a reference count in a
+// header word in front of it, which counts the branches that point to
+// it, in all the versions of the table. A snapshot is a copy of the
+// root that adds a reference to the root's twigs. Before a change, the
+// twigs on the path to it are copied if they are shared, and the copy
+// adds a reference to the twigs of each of its branches; so when we
+// reach an array with only one reference, nothing else can see it and
+// we can change it in place.
+//
+// The counts are atomic, so that a snapshot can be released by another
+// thread while the table is changing.
+
+static inline uint64_t *
+twigrefs(Trie *twigs) {
+	return((uint64_t *)twigs - 1);
+}
+
+static Trie *
+twigalloc(size_t m) {
+	uint64_t *refs = malloc(sizeof(*refs) + sizeof(Trie) * m);
+	if(refs == NULL)
+		return(NULL);
+	*refs = 1;
+	return((Trie *)(refs + 1));
+}
+
+static Trie *
+twigrealloc(Trie *twigs, size_t m) {
+	uint64_t *refs = realloc(twigrefs(twigs), sizeof(*refs) + sizeof(Trie) * m);
+	return(refs == NULL ? NULL : (Trie *)(refs + 1));
+}
+
+static void
+twigfree(Trie *twigs) {
+	if(twigs != NULL)
+		free(twigrefs(twigs));
+}
+
+static void
+incref(Trie *t) {
+	if(isbranch(t))
+		__atomic_add_fetch(twigrefs(t->branch.twigs), 1, __ATOMIC_RELAXED);
+}
+
+// Drop a branch's reference to its twigs, and free them if that was
+// the last one.
+//
+static void
+decref(Trie *t) {
+	if(!isbranch(t))
+		return;
+	Trie *twigs = t->branch.twigs;
+	if(__atomic_sub_fetch(twigrefs(twigs), 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	for(uint s = 0, m = popcount(t->branch.bitmap); s < m; s++)
+		decref(&twigs[s]);
+	twigfree(twigs);
+}
+
+// Ensure a branch's twigs are not shared, so they can be changed in
+// place. The branch itself must not be shared.
+//
+static bool
+cowtwigs(Trie *t) {
+	Trie *twigs = t->branch.twigs;
+	if(__atomic_load_n(twigrefs(twigs), __ATOMIC_ACQUIRE) == 1)
+		return(true);
+	uint m = popcount(t->branch.bitmap);
+	Trie *copy = twigalloc(m);
+	if(copy == NULL)
+		return(false);
+	memcpy(copy, twigs, sizeof(Trie) * m);
+	for(uint s = 0; s < m; s++)
+		incref(&copy[s]);
+	decref(t);
+	t->branch.twigs = copy;
+	return(true);
+}
+
+// Walk down to the key's leaf, making the path to it private. Sets *pt
+// to the leaf and *pp (if not NULL) to its parent. The key must be in
+// the table.
+//
+static bool
+cowpath(Tbl *tbl, const char *key, size_t len, Trie **pt, Trie **pp) {
+	Trie *t = &tbl->root, *p = NULL;
+	while(isbranch(t)) {
+		if(!cowtwigs(t))
+			return(false);
+		p = t; t = twig(t, twigoff(t, twigbit(t, key, len)));
+	}
+	*pt = t;
+	if(pp != NULL)
+		*pp = p;
+	return(true);
+}
+
+Tbl *
+Tsnapshot(Tbl *tbl) {
+	if(tbl == NULL)
+		return(NULL);
+	Tbl *snap = malloc(sizeof(*snap));
+	if(snap == NULL)
+		return(NULL);
+	*snap = *tbl;
+	incref(&snap->root);
+	return(snap);
+}
+
+void
+Trelease(Tbl *tbl) {
+	if(tbl == NULL)
+		return;
+	decref(&tbl->root);
+	free(tbl);
+}
+
+#else
+
+static inline Trie *
+twigalloc(size_t m) {
+	return(malloc(sizeof(Trie) * m));
+}
+
+static inline Trie *
+twigrealloc(Trie *twigs, size_t m) {
+	return(realloc(twigs, sizeof(Trie) * m));
+}
+
+static inline void
+twigfree(Trie *twigs) {
+	free(twigs);
+}
+
+static inline bool
+cowtwigs(Trie *t) {
+	(void)t;
+	return(true);
+}
+
+static inline bool
+cowpath(Tbl *tbl, const char *key, size_t len, Trie **pt, Trie **pp) {
+	(void)tbl; (void)key; (void)len; (void)pt; (void)pp;
+	return(true);
+}
+
+#endif
+
+#ifdef WITH_SEQLOCK
+
+// With -DWITH_SEQLOCK, one writer at a time can change the table while
+// readers search it without locking. The writer makes the sequence
+// number odd before it changes anything and even again afterwards, and
+// a reader retries if the sequence number was odd when it started or
+// has changed by the time it finishes. So readers cost two extra loads
+// of the same word, and no atomic read-modify-write.
+//
+// Readers must not trip over a half-made change before they find out
+// that they need to retry. Replacing a value is a single store in
+// place. Any other change to a twig is made to a copy of the array
+// that contains it, and published by a single store of the pointer
+// to the copy; arrays are never changed in place otherwise. The
+// replaced arrays are kept until Tcollect(), so a reader that is
+// looking at an old version of the trie still sees a well-formed one.
+
+static inline uint64_t
+readbegin(Tbl *tbl) {
+	uint64_t seq;
+	while((seq = __atomic_load_n(&tbl->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return(seq);
+}
+
+static inline bool
+readretry(Tbl *tbl, uint64_t seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return(__atomic_load_n(&tbl->seq, __ATOMIC_RELAXED) != seq);
+}
+
+static inline void
+writebegin(Tbl *tbl) {
+	__atomic_store_n(&tbl->seq, tbl->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+writeend(Tbl *tbl) {
+	__atomic_store_n(&tbl->seq, tbl->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline void
+valset(Tbl *tbl, Trie *t, void *val) {
+	writebegin(tbl);
+	__atomic_store_n(&t->leaf.val, val, __ATOMIC_RELAXED);
+	writeend(tbl);
+}
+
+static void
+seqnew(Tbl *tbl) {
+	tbl->slot = &tbl->root;
+	tbl->seq = 0;
+	tbl->garbage = NULL;
+	tbl->retired = tbl->space = 0;
+}
+
+void
+Tcollect(Tbl *tbl) {
 	if(tbl == NULL)
+		return;
+	for(size_t i = 0; i < tbl->retired; i++)
+		free(tbl->garbage[i]);
+	tbl->retired = 0;
+}
+
+static Tbl *
+seqfree(Tbl *tbl) {
+	Tcollect(tbl);
+	free(tbl->garbage);
+	if(tbl->slot != &tbl->root)
+		free(tbl->slot);
+	free(tbl);
+	return(NULL);
+}
+
+// Make room in the garbage before changing anything, so that a change
+// can not fail after it has been published.
+//
+static bool
+reserve(Tbl *tbl, size_t n) {
+	if(tbl->retired + n <= tbl->space)
+		return(true);
+	size_t space = tbl->space * 2 + n;
+	Trie **garbage = realloc(tbl->garbage, sizeof(*garbage) * space);
+	if(garbage == NULL)
+		return(false);
+	tbl->garbage = garbage;
+	tbl->space = space;
+	return(true);
+}
+
+static void
+retire(Tbl *tbl, Trie *twigs) {
+	if(twigs != NULL && twigs != &tbl->root)
+		tbl->garbage[tbl->retired++] = twigs;
+}
+
+// Replace the twig t on the path to the key with n, by publishing a
+// copy of the array that contains t. The old array is retired, and so
+// is the old twig array that n replaces, if any.
+//
+static bool
+replace(Tbl *tbl, const char *key, size_t len, Trie *t, Trie n, Trie *old) {
+	Trie **owner = &tbl->slot;
+	uint m = 1;
+	for(Trie *p = tbl->slot; p != t; p = twig(p, twigoff(p, twigbit(p, key, len)))) {
+		owner = &p->branch.twigs;
+		m = popcount(p->branch.bitmap);
+	}
+	Trie *twigs = *owner, *copy = malloc(sizeof(Trie) * m);
+	if(copy == NULL || !reserve(tbl, 2)) {
+		free(copy);
 		return(false);
-	Trie *t = &tbl->root;
+	}
+	memcpy(copy, twigs, sizeof(Trie) * m);
+	copy[t - twigs] = n;
+	writebegin(tbl);
+	__atomic_store_n(owner, copy, __ATOMIC_RELEASE);
+	writeend(tbl);
+	retire(tbl, twigs);
+	retire(tbl, old);
+	return(true);
+}
+
+#else
+
+static inline uint64_t
+readbegin(Tbl *tbl) {
+	(void)tbl;
+	return(0);
+}
+
+static inline bool
+readretry(Tbl *tbl, uint64_t seq) {
+	(void)tbl; (void)seq;
+	return(false);
+}
+
+static inline void
+valset(Tbl *tbl, Trie *t, void *val) {
+	(void)tbl;
+	t->leaf.val = val;
+}
+
+static inline void
+seqnew(Tbl *tbl) {
+	(void)tbl;
+}
+
+static inline Tbl *
+seqfree(Tbl *tbl) {
+	free(tbl);
+	return(NULL);
+}
+
+static inline bool
+replace(Tbl *tbl, const char *key, size_t len, Trie *t, Trie n, Trie *old) {
+	(void)tbl; (void)key; (void)len;
+	*t = n;
+	twigfree(old);
+	return(true);
+}
+
+#endif
+
+#ifdef WITH_JUMP_TABLE
+
+// The byte of a key at index i, or zero if the key is shorter.
+//
+static byte
+keybyte(const char *key, size_t i) {
+	return(strnlen(key, i) < i ? 0 : (byte)key[i]);
+}
+
+// Move a subtrie into the 256 slots that replace it when the jump
+// table grows from j to j+1 bytes. Only the branches that test byte j
+// are discarded; everything below them moves as it is.
+//
+static void
+jumpsplit(Trie *t, uint j, Trie *slot) {
+	if(isbranch(t) && t->branch.index == j) {
+		uint m = popcount(t->branch.bitmap);
+		for(uint s = 0; s < m; s++)
+			jumpsplit(twig(t, s), j, slot);
+		free(t->branch.twigs);
+		return;
+	}
+	Trie *l = t;
+	while(isbranch(l))
+		l = twig(l, 0);
+	slot[keybyte(l->leaf.key, j)] = *t;
+}
+
+// Free the branches that jumpmerge() added above a subtrie.
+//
+static void
+jumpunmerge(Trie *t, uint j) {
+	if(!isbranch(t) || t->branch.index != j - 1)
+		return;
+	uint m = popcount(t->branch.bitmap);
+	for(uint s = 0; s < m; s++)
+		jumpunmerge(twig(t, s), j);
+	free(t->branch.twigs);
+}
+
+static void
+jumpbranch(Trie *t, uint j, uint flags, Tbitmap bitmap, Trie *twigs) {
+	t->branch.twigs = twigs;
+	t->branch.flags = flags;
+	t->branch.index = j - 1;
+	t->branch.bitmap = bitmap;
+}
+
+// Combine 256 slots into one subtrie when the jump table shrinks from
+// j to j-1 bytes, by adding branches that test byte j-1. Returns false
+// if allocation failed, after undoing its work.
+//
+static bool
+jumpmerge(Trie *slot, uint j, Trie *t) {
+	Trie hi[16];
+	Tbitmap bh = 0;
+	uint mh = 0;
+	for(uint h = 0; h < 16; h++) {
+		Trie *lo = slot + h * 16;
+		Tbitmap bl = 0;
+		for(uint l = 0; l < 16; l++)
+			if(!isempty(&lo[l]))
+				bl |= 1U << l;
+		if(bl == 0)
+			continue;
+		bh |= 1U << h;
+		Trie *n = &hi[mh++];
+		uint ml = popcount(bl);
+		if(ml == 1) {
+			*n = lo[__builtin_ctz(bl)];
+			continue;
+		}
+		Trie *twigs = malloc(sizeof(Trie) * ml);
+		if(twigs == NULL) {
+			while(--mh > 0)
+				jumpunmerge(&hi[mh - 1], j);
+			return(false);
+		}
+		for(uint l = 0, s = 0; l < 16; l++)
+			if(bl & (1U << l))
+				twigs[s++] = lo[l];
+		jumpbranch(n, j, 2, bl, twigs);
+	}
+	if(mh == 0) {
+		t->leaf.key = NULL;
+		t->leaf.val = NULL;
+		return(true);
+	}
+	if(mh == 1) {
+		*t = hi[0];
+		return(true);
+	}
+	Trie *twigs = malloc(sizeof(Trie) * mh);
+	if(twigs == NULL) {
+		while(mh-- > 0)
+			jumpunmerge(&hi[mh], j);
+		return(false);
+	}
+	memcpy(twigs, hi, sizeof(Trie) * mh);
+	jumpbranch(t, j, 1, bh, twigs);
+	return(true);
+}
+
+// If allocation fails the table stays as it was, which is fine.
+//
+static void
+jumpresize(Tbl *tbl, uint jump) {
+	Trie *slot = calloc(jumpsize(jump), sizeof(Trie));
+	if(slot == NULL)
+		return;
+	Trie *old = tbl->slot;
+	if(jump > tbl->jump) {
+		for(size_t i = 0; old + i < jumpend(tbl); i++)
+			if(!isempty(&old[i]))
+				jumpsplit(&old[i], tbl->jump, slot + i * 256);
+	} else {
+		for(size_t i = 0; i < jumpsize(jump); i++) {
+			if(jumpmerge(old + i * 256, tbl->jump, slot + i))
+				continue;
+			while(i-- > 0)
+				jumpunmerge(slot + i, tbl->jump);
+			free(slot);
+			return;
+		}
+	}
+	if(old != &tbl->root)
+		free(old);
+	if(jump == 0) {
+		tbl->root = slot[0];
+		free(slot);
+		slot = &tbl->root;
+	}
+	tbl->slot = slot;
+	tbl->jump = jump;
+}
+
+static void
+jumpnew(Tbl *tbl) {
+	tbl->slot = &tbl->root;
+	tbl->count = 1;
+	tbl->jump = 0;
+}
+
+// Called after adding a key.
+//
+static Tbl *
+jumpadd(Tbl *tbl) {
+	tbl->count++;
+	if(tbl->jump < JUMPMAX && tbl->count > jumpmin[tbl->jump + 1])
+		jumpresize(tbl, tbl->jump + 1);
+	return(tbl);
+}
+
+// Called after deleting a key.
+//
+static Tbl *
+jumpdel(Tbl *tbl) {
+	tbl->count--;
+	if(tbl->jump > 0 && tbl->count < jumpmin[tbl->jump] / 4)
+		jumpresize(tbl, tbl->jump - 1);
+	return(tbl);
+}
+
+// Called when deleting the only key in a subtrie.
+//
+static Tbl *
+jumpempty(Tbl *tbl, Trie *t) {
+	if(tbl->count == 1) {
+		if(tbl->slot != &tbl->root)
+			free(tbl->slot);
+		free(tbl);
+		return(NULL);
+	}
+	t->leaf.key = NULL;
+	t->leaf.val = NULL;
+	return(jumpdel(tbl));
+}
+
+#else
+
+static inline void
+jumpnew(Tbl *tbl) {
+	seqnew(tbl);
+}
+
+static inline Tbl *
+jumpadd(Tbl *tbl) {
+	return(tbl);
+}
+
+static inline Tbl *
+jumpdel(Tbl *tbl) {
+	return(tbl);
+}
+
+static inline Tbl *
+jumpempty(Tbl *tbl, Trie *t) {
+	(void)t;
+	return(seqfree(tbl));
+}
+
+#endif
+
+static inline bool
+getkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	Trie *t = jumproot(tbl, key, len);
 	while(isbranch(t)) {
-		__builtin_prefetch(t->branch.twigs);
+		TRACE(TRACE_BRANCH, t, sizeof(*t));
+		if(t->branch.index < len)
+			TRACE(TRACE_SEARCH, key + t->branch.index, 1);
+		__builtin_prefetch(twig(t, 0));
 		Tbitmap b = twigbit(t, key, len);
 		if(!hastwig(t, b))
 			return(false);
 		t = twig(t, twigoff(t, b));
 	}
+	if(isempty(t))
+		return(false);
+	TRACE(TRACE_LEAF, t, sizeof(*t));
+	TRACE_STRCMP(key, t->leaf.key);
 	if(strcmp(key, t->leaf.key) != 0)
 		return(false);
 	*pkey = t->leaf.key;
-	*pval = t->leaf.val;
+	*pval = leafval(t);
 	return(true);
 }
 
+bool
+Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	if(tbl == NULL)
+		return(false);
+	for(;;) {
+		uint64_t seq = readbegin(tbl);
+		bool found = getkv(tbl, key, len, pkey, pval);
+		if(!readretry(tbl, seq))
+			return(found);
+	}
+}
+
 static bool
 next_rec(Trie *t, const char **pkey, size_t *plen, void **pval) {
 	if(isbranch(t)) {
@@ -49,7 +586,7 @@ next_rec(Trie *t, const char **pkey, size_t *plen, void **pval) {
 	if(*pkey == NULL) {
 		*pkey = t->leaf.key;
 		*plen = strlen(*pkey);
-		*pval = t->leaf.val;
+		*pval = leafval(t);
 		return(true);
 	}
 	// We have found this leaf, so start looking for the next one.
@@ -69,14 +606,27 @@ Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
 		*plen = 0;
 		return(NULL);
 	}
-	return(next_rec(&tbl->root, pkey, plen, pval));
+	const char *key = *pkey;
+	size_t len = *plen;
+	for(;;) {
+		uint64_t seq = readbegin(tbl);
+		bool found = false;
+		// Start in the subtrie of the previous key, if any.
+		for(Trie *t = jumproot(tbl, key, len); t != NULL && !found;
+		    t = jumpnext(tbl, t))
+			found = !isempty(t) && next_rec(t, pkey, plen, pval);
+		if(!readretry(tbl, seq))
+			return(found);
+		*pkey = key;
+		*plen = len;
+	}
 }
 
 Tbl *
 Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 	if(tbl == NULL)
 		return(NULL);
-	Trie *t = &tbl->root, *p = NULL;
+	Trie *t = jumproot(tbl, key, len), *p = NULL;
 	Tbitmap b = 0;
 	while(isbranch(t)) {
 		__builtin_prefetch(t->branch.twigs);
@@ -85,31 +635,45 @@ Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
 			return(tbl);
 		p = t; t = twig(t, twigoff(t, b));
 	}
-	if(strcmp(key, t->leaf.key) != 0)
+	if(isempty(t) || strcmp(key, t->leaf.key) != 0)
 		return(tbl);
+	// The key is present, so now we can copy the path to it.
+	if(!cowpath(tbl, key, len, &t, &p))
+		return(NULL);
 	*pkey = t->leaf.key;
 	*pval = t->leaf.val;
-	if(p == NULL) {
-		free(tbl);
-		return(NULL);
-	}
+	if(p == NULL)
+		return(jumpempty(tbl, t));
 	t = p; p = NULL; // Becuase t is the usual name
 	uint s, m; TWIGOFFMAX(s, m, t, b);
 	if(m == 2) {
 		// Move the other twig to the parent branch.
-		Trie *twigs = t->branch.twigs;
-		*t = *twig(t, !s);
-		free(twigs);
-		return(tbl);
+		if(!replace(tbl, key, len, t, *twig(t, !s), t->branch.twigs))
+			return(NULL);
+		return(jumpdel(tbl));
 	}
+#ifdef WITH_SEQLOCK
+	Trie n = *t, *twigs = malloc(sizeof(Trie) * (m - 1));
+	if(twigs == NULL)
+		return(NULL);
+	memcpy(twigs, twig(t, 0), sizeof(Trie) * s);
+	memcpy(twigs+s, twig(t, s+1), sizeof(Trie) * (m - s - 1));
+	n.branch.twigs = twigs;
+	n.branch.bitmap &= ~b;
+	if(replace(tbl, key, len, t, n, t->branch.twigs))
+		return(jumpdel(tbl));
+	free(twigs);
+	return(NULL);
+#else
 	memmove(t->branch.twigs+s, t->branch.twigs+s+1, sizeof(Trie) * (m - s - 1));
 	t->branch.bitmap &= ~b;
 	// We have now correctly removed the twig from the trie, so if
 	// realloc() fails we can ignore it and continue to use the
 	// slightly oversized twig array.
-	Trie *twigs = realloc(t->branch.twigs, sizeof(Trie) * (m - 1));
+	Trie *twigs = twigrealloc(t->branch.twigs, m - 1);
 	if(twigs != NULL) t->branch.twigs = twigs;
-	return(tbl);
+	return(jumpdel(tbl));
+#endif
 }
 
 Tbl *
@@ -127,9 +691,15 @@ Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
 		if(tbl == NULL) return(NULL);
 		tbl->root.leaf.key = key;
 		tbl->root.leaf.val = val;
+		jumpnew(tbl);
 		return(tbl);
 	}
-	Trie *t = &tbl->root;
+	Trie *root = jumproot(tbl, key, len), *t = root;
+	if(isempty(t)) {
+		t->leaf.key = key;
+		t->leaf.val = val;
+		return(jumpadd(tbl));
+	}
 	// Find the most similar leaf node in the trie. We will compare
 	// its key with our new key to find the first differing nibble,
 	// which can be at a lower index than the point at which we
@@ -151,7 +721,9 @@ Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
 		if(key[i] != t->leaf.key[i])
 			goto newkey;
 	}
-	t->leaf.val = val;
+	if(!cowpath(tbl, key, len, &t, NULL))
+		return(NULL);
+	valset(tbl, t, val);
 	return(tbl);
 newkey:; // We have the branch's index; what are its flags?
 	byte k1 = (byte)key[i], k2 = (byte)t->leaf.key[i];
@@ -161,7 +733,7 @@ newkey:; // We have the branch's index; what are its flags?
 	Tbitmap b1 = nibbit(k1, f);
 	Trie t1 = { .leaf = { .key = key, .val = val } };
 	// Find where to insert a branch or grow an existing branch.
-	t = &tbl->root;
+	t = root;
 	while(isbranch(t)) {
 		__builtin_prefetch(t->branch.twigs);
 		if(i == t->branch.index && f == t->branch.flags)
@@ -172,28 +744,135 @@ newkey:; // We have the branch's index; what are its flags?
 			goto newbranch;
 		Tbitmap b = twigbit(t, key, len);
 		assert(hastwig(t, b));
+		if(!cowtwigs(t)) return(NULL);
 		t = twig(t, twigoff(t, b));
 	}
 newbranch:;
-	Trie *twigs = malloc(sizeof(Trie) * 2);
+	Trie *twigs = twigalloc(2);
 	if(twigs == NULL) return(NULL);
-	Trie t2 = *t; // Save before overwriting.
+	Trie n;
 	Tbitmap b2 = nibbit(k2, f);
-	t->branch.twigs = twigs;
-	t->branch.flags = f;
-	t->branch.index = i;
-	t->branch.bitmap = b1 | b2;
-	*twig(t, twigoff(t, b1)) = t1;
-	*twig(t, twigoff(t, b2)) = t2;
-	return(tbl);
+	n.branch.twigs = twigs;
+	n.branch.flags = f;
+	n.branch.index = i;
+	n.branch.bitmap = b1 | b2;
+	twigs[twigoff(&n, b1)] = t1;
+	twigs[twigoff(&n, b2)] = *t;
+	if(replace(tbl, key, len, t, n, NULL))
+		return(jumpadd(tbl));
+	twigfree(twigs);
+	return(NULL);
 growbranch:;
 	assert(!hastwig(t, b1));
+	if(!cowtwigs(t)) return(NULL);
 	uint s, m; TWIGOFFMAX(s, m, t, b1);
-	twigs = realloc(t->branch.twigs, sizeof(Trie) * (m + 1));
+#ifdef WITH_SEQLOCK
+	twigs = malloc(sizeof(Trie) * (m + 1));
+	if(twigs == NULL) return(NULL);
+	memcpy(twigs, twig(t, 0), sizeof(Trie) * s);
+	twigs[s] = t1;
+	memcpy(twigs+s+1, twig(t, s), sizeof(Trie) * (m - s));
+	n = *t;
+	n.branch.twigs = twigs;
+	n.branch.bitmap |= b1;
+	if(replace(tbl, key, len, t, n, t->branch.twigs))
+		return(jumpadd(tbl));
+	free(twigs);
+	return(NULL);
+#else
+	twigs = twigrealloc(t->branch.twigs, m + 1);
 	if(twigs == NULL) return(NULL);
 	memmove(twigs+s+1, twigs+s, sizeof(Trie) * (m - s));
 	memmove(twigs+s, &t1, sizeof(Trie));
 	t->branch.twigs = twigs;
 	t->branch.bitmap |= b1;
-	return(tbl);
+	return(jumpadd(tbl));
+#endif
+}
+
+// Structural statistics.
+//
+// The walk is a pre-order traversal, so when it resumes, the branches
+// on the path to the cursor have already been counted, and so have the
+// leaves before it. It only stops at a leaf, so that it does not count
+// a branch twice.
+
+static inline size_t
+stat_bucket(size_t i, size_t n) {
+	return(i < n ? i : n - 1);
+}
+
+static bool
+stat_cursor(Tstats *st, const char *key) {
+	size_t len = strlen(key);
+	char *cursor = realloc(st->cursor, len + 1);
+	if(cursor == NULL) {
+		free(st->cursor);
+		st->cursor = NULL;
+		return(false);
+	}
+	st->cursor = memcpy(cursor, key, len + 1);
+	st->cursorlen = len;
+	return(true);
+}
+
+// Returns false to stop the walk.
+//
+static bool
+stat_rec(Trie *t, size_t d, Tstats *st, size_t *budget, bool resume) {
+	if(*budget > 0)
+		*budget -= 1;
+	if(!isbranch(t)) {
+		if(resume && strcmp(t->leaf.key, st->cursor) <= 0)
+			return(true);
+		st->leaves += 1;
+		st->depth[stat_bucket(d, TSTAT_DEPTH)] += 1;
+		if(*budget == 0) {
+			stat_cursor(st, t->leaf.key);
+			return(false);
+		}
+		return(true);
+	}
+	uint s = 0, m = popcount(t->branch.bitmap);
+	if(resume) {
+		Tbitmap b = twigbit(t, st->cursor, st->cursorlen);
+		s = twigoff(t, b);
+		if(hastwig(t, b) && !stat_rec(twig(t, s++), d+1, st, budget, true))
+			return(false);
+	} else {
+		size_t pos = t->branch.index * 2 + t->branch.flags - 1;
+		pos = stat_bucket(pos, TSTAT_POSITION);
+		st->branches += 1;
+		st->twigs += m;
+		st->fanout[stat_bucket(m, TSTAT_FANOUT)] += 1;
+		st->position[pos] += 1;
+		st->postwigs[pos] += m;
+	}
+	for(; s < m; s++)
+		if(!stat_rec(twig(t, s), d+1, st, budget, false))
+			return(false);
+	return(true);
+}
+
+bool
+Tstat(Tbl *tbl, Tstats *st, size_t budget) {
+	st->type = "qp";
+	if(budget == 0)
+		budget = 1;
+	bool resume = st->cursor != NULL;
+	Trie *t = tbl == NULL ? NULL
+		: jumproot(tbl, st->cursor, resume ? st->cursorlen : 0);
+	for(; t != NULL; t = jumpnext(tbl, t), resume = false) {
+		if(isempty(t))
+			continue;
+		// a subtrie that we are resuming was counted before
+		if(!resume)
+			st->roots += 1;
+		if(!stat_rec(t, 0, st, &budget, resume))
+			return(st->cursor != NULL);
+	}
+	free(st->cursor);
+	st->cursor = NULL;
+	st->complete = true;
+	return(false);
 }
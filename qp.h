@@ -161,15 +161,154 @@ typedef union Trie {
 	struct Tbranch branch;
 } Trie;
 
+#if defined(WITH_JUMP_TABLE) + defined(WITH_SEQLOCK) + defined(WITH_SNAPSHOTS) > 1
+#error "WITH_JUMP_TABLE, WITH_SEQLOCK, and WITH_SNAPSHOTS do not work together"
+#endif
+
+#ifdef WITH_JUMP_TABLE
+
+// When a table gets big, its top levels are nearly always full, so
+// with -DWITH_JUMP_TABLE the trie is split into 256^jump subtries,
+// indexed directly by the first `jump` bytes of the key, like the root
+// expansion in Judy arrays or an ART. The subtries are in key order so
+// Tnextl() walks them one after another. An empty subtrie is a leaf
+// with a NULL key. A key shorter than `jump` bytes is padded with
+// zeroes, which is how twigbit() treats the end of a key, so every
+// branch in a subtrie tests a byte at or after `jump`.
+//
+// The jump table grows or shrinks by one byte when the number of keys
+// crosses the limits below, with some hysteresis. It stays small
+// enough compared with the keys that its size does not matter.
+
+#define JUMPMAX 2
+
+static const size_t jumpmin[JUMPMAX + 1] = { 0, 1 << 12, 1 << 20 };
+
+struct Tbl {
+	union Trie *slot;
+	size_t count;
+	uint jump;
+	union Trie root;
+};
+
+static inline size_t
+jumpsize(uint jump) {
+	return((size_t)1 << (8 * jump));
+}
+
+static inline Trie *
+jumproot(Tbl *tbl, const char *key, size_t len) {
+	size_t i = 0;
+	for(uint j = 0; j < tbl->jump; j++)
+		i = i << 8 | (j < len ? (byte)key[j] : 0);
+	return(&tbl->slot[i]);
+}
+
+static inline Trie *
+jumpend(Tbl *tbl) {
+	return(tbl->slot + jumpsize(tbl->jump));
+}
+
+static inline Trie *
+jumpnext(Tbl *tbl, Trie *t) {
+	return(t + 1 < jumpend(tbl) ? t + 1 : NULL);
+}
+
+static inline bool
+isempty(Trie *t) {
+	return(t->leaf.key == NULL);
+}
+
+#elif defined(WITH_SEQLOCK)
+
+// With -DWITH_SEQLOCK, lookups do not lock, and check a sequence
+// number that changes whenever the table does. The root is kept in a
+// one-twig array, like every other twig, so that any change to the
+// shape of the trie can be made to a copy of an array and published
+// by storing one pointer. Replaced arrays wait in the garbage until
+// Tcollect(). See qp.c for details.
+
 struct Tbl {
+	union Trie *slot;
+	uint64_t seq;
+	union Trie **garbage;
+	size_t retired, space;
 	union Trie root;
 };
 
+static inline Trie *
+jumproot(Tbl *tbl, const char *key, size_t len) {
+	(void)key; (void)len;
+	return(__atomic_load_n(&tbl->slot, __ATOMIC_ACQUIRE));
+}
+
+static inline Trie *
+jumpend(Tbl *tbl) {
+	return(jumproot(tbl, "", 0) + 1);
+}
+
+static inline Trie *
+jumpnext(Tbl *tbl, Trie *t) {
+	(void)tbl; (void)t;
+	return(NULL);
+}
+
+static inline bool
+isempty(Trie *t) {
+	(void)t;
+	return(false);
+}
+
+#else
+
+struct Tbl {
+	union Trie root;
+};
+
+static inline Trie *
+jumproot(Tbl *tbl, const char *key, size_t len) {
+	(void)key; (void)len;
+	return(&tbl->root);
+}
+
+static inline Trie *
+jumpend(Tbl *tbl) {
+	return(&tbl->root + 1);
+}
+
+static inline Trie *
+jumpnext(Tbl *tbl, Trie *t) {
+	(void)tbl; (void)t;
+	return(NULL);
+}
+
+static inline bool
+isempty(Trie *t) {
+	(void)t;
+	return(false);
+}
+
+#endif
+
 // Test flags to determine type of this node.
 
 static inline bool
 isbranch(Trie *t) {
+#ifdef WITH_SEQLOCK
+	// A leaf's value can change under our feet.
+	return(((uint64_t)__atomic_load_n(&t->leaf.val, __ATOMIC_RELAXED) & 3) != 0);
+#else
 	return(t->branch.flags != 0);
+#endif
+}
+
+static inline void *
+leafval(Trie *t) {
+#ifdef WITH_SEQLOCK
+	return(__atomic_load_n(&t->leaf.val, __ATOMIC_RELAXED));
+#else
+	return(t->leaf.val);
+#endif
 }
 
 // Make a bitmask for testing a branch bitmap.
@@ -210,7 +349,12 @@ twigoff(Trie *t, Tbitmap b) {
 
 static inline Trie *
 twig(Trie *t, uint i) {
+#ifdef WITH_SEQLOCK
+	// A branch's twigs can be replaced under our feet.
+	return(&__atomic_load_n(&t->branch.twigs, __ATOMIC_ACQUIRE)[i]);
+#else
 	return(&t->branch.twigs[i]);
+#endif
 }
 
 #ifdef HAVE_NARROW_CPU
@@ -0,0 +1 @@
+qp-debug.c
\ No newline at end of file
@@ -0,0 +1,67 @@
+// rb-debug.c: red-black tree debug support
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "rb.h"
+
+// Returns the black height, checking the red-black invariants.
+//
+static int
+dump_rec(Node *n, int d) {
+	if(n == NULL)
+		return(1);
+	printf("Tdump%*s node %p %s\n", d, "", n, n->red ? "red" : "black");
+	printf("Tdump%*s node key %p %s\n", d, "", n->key, n->key);
+	printf("Tdump%*s node val %p\n", d, "", n->val);
+	for(uint i = 0; i < 2; i++) {
+		if(n->child[i] == NULL)
+			continue;
+		assert(n->child[i]->parent == n);
+		assert(!(n->red && n->child[i]->red));
+		assert((strcmp(n->child[i]->key, n->key) > 0) == i);
+	}
+	int h0 = dump_rec(n->child[0], d+1);
+	int h1 = dump_rec(n->child[1], d+1);
+	assert(h0 == h1);
+	return(h0 + !n->red);
+}
+
+void
+Tdump(Tbl *tbl) {
+	printf("Tdump root %p\n", tbl);
+	assert(tbl == NULL || (tbl->parent == NULL && !tbl->red));
+	dump_rec(tbl, 0);
+}
+
+// Every node is a leaf and none are branches, in the terms of the tries,
+// and the overhead is the node size minus the key and value pointers.
+//
+static void
+size_rec(Node *n, uint d,
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	if(n == NULL)
+		return;
+	*rsize += sizeof(*n);
+	*rleaves += 1;
+	*rdepth += d;
+	size_rec(n->child[0], d+1, rsize, rdepth, rbranches, rleaves);
+	size_rec(n->child[1], d+1, rsize, rdepth, rbranches, rleaves);
+}
+
+void
+Tsize(Tbl *tbl, const char **rtype,
+    size_t *rsize, size_t *rdepth, size_t *rbranches, size_t *rleaves) {
+	*rtype = "rb";
+	*rsize = *rdepth = *rbranches = *rleaves = 0;
+	size_rec(tbl, 0, rsize, rdepth, rbranches, rleaves);
+}
@@ -0,0 +1,221 @@
+// rb.c: tables implemented with red-black trees.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "rb.h"
+
+static Node *
+find(Node *n, const char *key) {
+	while(n != NULL) {
+		int cmp = strcmp(key, n->key);
+		if(cmp == 0)
+			return(n);
+		n = n->child[cmp > 0];
+	}
+	return(NULL);
+}
+
+bool
+Tgetkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	(void)len;
+	Node *n = find(tbl, key);
+	if(n == NULL)
+		return(false);
+	*pkey = n->key;
+	*pval = n->val;
+	return(true);
+}
+
+bool
+Tnextl(Tbl *tbl, const char **pkey, size_t *plen, void **pval) {
+	Node *n = NULL;
+	if(tbl != NULL && *pkey == NULL) {
+		n = extreme(tbl, 0);
+	} else if(tbl != NULL) {
+		n = find(tbl, *pkey);
+		assert(n != NULL);
+		if(n->child[1] != NULL) {
+			n = extreme(n->child[1], 0);
+		} else {
+			while(n->parent != NULL && side(n) == 1)
+				n = n->parent;
+			n = n->parent;
+		}
+	}
+	if(n == NULL) {
+		*pkey = NULL;
+		*plen = 0;
+		return(false);
+	}
+	*pkey = n->key;
+	*plen = strlen(n->key);
+	*pval = n->val;
+	return(true);
+}
+
+// Move n's dir child up into n's place, and return the new root.
+//
+static Node *
+rotate(Node *root, Node *n, uint dir) {
+	Node *c = n->child[dir];
+	n->child[dir] = c->child[!dir];
+	if(c->child[!dir] != NULL)
+		c->child[!dir]->parent = n;
+	c->parent = n->parent;
+	if(n->parent == NULL)
+		root = c;
+	else
+		n->parent->child[side(n)] = c;
+	c->child[!dir] = n;
+	n->parent = c;
+	return(root);
+}
+
+// Replace the subtree at u with the one at v, which may be NULL.
+//
+static Node *
+transplant(Node *root, Node *u, Node *v) {
+	if(u->parent == NULL)
+		root = v;
+	else
+		u->parent->child[side(u)] = v;
+	if(v != NULL)
+		v->parent = u->parent;
+	return(root);
+}
+
+Tbl *
+Tdelkv(Tbl *tbl, const char *key, size_t len, const char **pkey, void **pval) {
+	(void)len;
+	Node *root = tbl, *z = find(root, key);
+	if(z == NULL)
+		return(tbl);
+	*pkey = z->key;
+	*pval = z->val;
+	// x takes the place of the node that is removed from the tree,
+	// and because x can be NULL we also keep track of its parent.
+	Node *x, *xp;
+	bool red = z->red;
+	if(z->child[0] == NULL || z->child[1] == NULL) {
+		x = z->child[z->child[0] == NULL];
+		xp = z->parent;
+		root = transplant(root, z, x);
+	} else {
+		Node *y = extreme(z->child[1], 0);
+		red = y->red;
+		x = y->child[1];
+		if(y->parent == z) {
+			xp = y;
+		} else {
+			xp = y->parent;
+			root = transplant(root, y, x);
+			y->child[1] = z->child[1];
+			y->child[1]->parent = y;
+		}
+		root = transplant(root, z, y);
+		y->child[0] = z->child[0];
+		y->child[0]->parent = y;
+		y->red = z->red;
+	}
+	free(z);
+	if(red)
+		return(root);
+	// A black node was removed, so the paths through x are one short.
+	while(x != root && !isred(x)) {
+		uint dir = xp->child[1] == x;
+		Node *w = xp->child[!dir];
+		if(isred(w)) {
+			w->red = false;
+			xp->red = true;
+			root = rotate(root, xp, !dir);
+			w = xp->child[!dir];
+		}
+		if(!isred(w->child[0]) && !isred(w->child[1])) {
+			w->red = true;
+			x = xp;
+			xp = x->parent;
+			continue;
+		}
+		if(!isred(w->child[!dir])) {
+			w->child[dir]->red = false;
+			w->red = true;
+			root = rotate(root, w, dir);
+			w = xp->child[!dir];
+		}
+		w->red = xp->red;
+		xp->red = false;
+		w->child[!dir]->red = false;
+		root = rotate(root, xp, !dir);
+		x = root;
+	}
+	if(x != NULL)
+		x->red = false;
+	return(root);
+}
+
+Tbl *
+Tsetl(Tbl *tbl, const char *key, size_t len, void *val) {
+	// Ensure values are word-aligned, like the tries.
+	if(((uint64_t)val & 3) != 0) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	if(val == NULL)
+		return(Tdell(tbl, key, len));
+	Node *root = tbl, *p = NULL;
+	uint dir = 0;
+	for(Node *n = root; n != NULL; n = n->child[dir]) {
+		int cmp = strcmp(key, n->key);
+		if(cmp == 0) {
+			n->val = val;
+			return(root);
+		}
+		p = n;
+		dir = cmp > 0;
+	}
+	Node *n = malloc(sizeof(*n));
+	if(n == NULL)
+		return(NULL);
+	n->key = key;
+	n->val = val;
+	n->child[0] = n->child[1] = NULL;
+	n->parent = p;
+	n->red = true;
+	if(p == NULL)
+		root = n;
+	else
+		p->child[dir] = n;
+	// Fix any red node with a red parent.
+	while(isred(n->parent)) {
+		p = n->parent;
+		Node *g = p->parent;
+		dir = side(p);
+		Node *u = g->child[!dir];
+		if(isred(u)) {
+			p->red = u->red = false;
+			g->red = true;
+			n = g;
+			continue;
+		}
+		if(side(n) != dir) {
+			root = rotate(root, p, !dir);
+			n = p;
+			p = n->parent;
+		}
+		p->red = false;
+		g->red = true;
+		root = rotate(root, g, dir);
+	}
+	root->red = false;
+	return(root);
+}
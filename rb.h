@@ -0,0 +1,50 @@
+// rb.h: tables implemented with red-black trees.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This is a comparison baseline, laid out like the nodes of a typical
+// C++ std::map: each node has the key and value pointers, pointers to
+// its two children and its parent, and a colour bit. That is three words
+// of overhead per entry plus malloc's header, compared with about one
+// word for a qp trie, and a search makes a full strcmp() at every level
+// of a tree that is about log2(N) deep.
+//
+// The algorithms are the usual ones from Cormen, Leiserson, Rivest and
+// Stein, "Introduction to Algorithms", chapter 13, except that the
+// leaves are NULL pointers instead of a sentinel node. The table
+// pointer is the root node, which changes when the tree is rebalanced.
+
+typedef unsigned int uint;
+
+typedef struct Tbl Node;
+
+struct Tbl {
+	const char *key;
+	void *val;
+	Node *child[2];
+	Node *parent;
+	bool red;
+};
+
+static inline bool
+isred(Node *n) {
+	return(n != NULL && n->red);
+}
+
+// Which side of its parent is this node?
+//
+static inline uint
+side(Node *n) {
+	return(n->parent->child[1] == n);
+}
+
+// The first or last node in a subtree, depending on dir.
+//
+static inline Node *
+extreme(Node *n, uint dir) {
+	while(n->child[dir] != NULL)
+		n = n->child[dir];
+	return(n);
+}
@@ -0,0 +1,369 @@
+// replica.c: a read-mostly table copied to each NUMA node
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+
+#include <unistd.h>
+
+#include "Tbl.h"
+#include "replica.h"
+#include "util.h"
+
+// The node numbers that fit in the memory policy's mask.
+//
+#define MAXNODES 64
+
+typedef struct Replica {
+	Tbl *tbl;		// read without locking
+	cpu_set_t cpus;
+	int node;		// or -1 if emulated
+} __attribute__((aligned(LINE))) Replica;
+
+// A reader's epoch is zero when it is not searching the copies,
+// otherwise it is the epoch when it started, as in cache.c. The reader
+// searches the copy on the node where it last entered.
+//
+struct Rreader {
+	uint64_t epoch;
+	Replica *home;
+	Rreader *next;
+	Replicas *replicas;
+} __attribute__((aligned(LINE)));
+
+struct Replicas {
+	// read by everyone
+	uint64_t epoch;
+	unsigned count;
+	size_t ncpus, norder;
+	unsigned *home;		// the replica for each CPU
+	size_t *order;		// for replicas_pin()
+	// the rest belongs to the publisher
+	pthread_mutex_t lock __attribute__((aligned(LINE)));
+	Rreader *readers;
+	Replica replica[];
+};
+
+// Parse a node's CPU list, which looks like "0-7,16-23".
+//
+static bool
+cpulist(unsigned node, cpu_set_t *set) {
+	char path[64];
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/node/node%u/cpulist", node);
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return(false);
+	CPU_ZERO(set);
+	unsigned lo, hi;
+	while(fscanf(f, "%u", &lo) == 1) {
+		hi = lo;
+		int c = getc(f);
+		if(c == '-') {
+			if(fscanf(f, "%u", &hi) != 1)
+				break;
+			c = getc(f);
+		}
+		for(unsigned i = lo; i <= hi && i < CPU_SETSIZE; i++)
+			CPU_SET(i, set);
+		if(c != ',')
+			break;
+	}
+	fclose(f);
+	return(true);
+}
+
+// Free a copy and its keys.
+//
+static void
+freecopy(Tbl *t) {
+	while(t != NULL) {
+		const char *key = NULL;
+		size_t len = 0;
+		void *val;
+		Tnextl(t, &key, &len, &val);
+		t = Tdell(t, key, len);
+		free((char *)key);
+	}
+}
+
+Replicas *
+replicas_create(unsigned nodes) {
+	if(nodes > MAXNODES) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	long conf = sysconf(_SC_NPROCESSORS_CONF);
+	size_t ncpus = conf < 1 ? 1 : (size_t)conf;
+	if(ncpus > CPU_SETSIZE)
+		ncpus = CPU_SETSIZE;
+	cpu_set_t set[MAXNODES];
+	int node[MAXNODES];
+	unsigned count = 0;
+	if(nodes == 0) {
+		// Nodes with memory but no CPUs have no readers.
+		for(unsigned n = 0; n < MAXNODES; n++)
+			if(cpulist(n, &set[count]) && CPU_COUNT(&set[count]) > 0)
+				node[count++] = (int)n;
+		if(count == 0)
+			nodes = 1;
+	}
+	if(count == 0) {
+		// Divide the CPUs into equal ranges, and share them if
+		// there are more nodes than CPUs.
+		count = nodes;
+		for(unsigned k = 0; k < count; k++) {
+			CPU_ZERO(&set[k]);
+			node[k] = -1;
+			for(size_t c = 0; c < ncpus; c++)
+				if(c * count / ncpus == k)
+					CPU_SET(c, &set[k]);
+			if(CPU_COUNT(&set[k]) == 0)
+				CPU_SET(k % ncpus, &set[k]);
+		}
+	}
+	size_t norder = 0;
+	for(unsigned k = 0; k < count; k++)
+		norder += (size_t)CPU_COUNT(&set[k]);
+	Replicas *r = NULL;
+	errno = posix_memalign((void **)&r, LINE,
+			       sizeof(*r) + count * sizeof(*r->replica));
+	if(errno != 0)
+		return(NULL);
+	r->home = calloc(ncpus, sizeof(*r->home));
+	r->order = calloc(norder, sizeof(*r->order));
+	if(r->home == NULL || r->order == NULL) {
+		free(r->home);
+		free(r->order);
+		free(r);
+		return(NULL);
+	}
+	r->epoch = 1;
+	r->count = count;
+	r->ncpus = ncpus;
+	r->norder = norder;
+	pthread_mutex_init(&r->lock, NULL);
+	r->readers = NULL;
+	for(unsigned k = 0; k < count; k++) {
+		Replica *rep = &r->replica[k];
+		rep->tbl = NULL;
+		rep->cpus = set[k];
+		rep->node = node[k];
+	}
+	// Each CPU reads from the first node that has it.
+	for(size_t c = 0; c < ncpus; c++)
+		for(unsigned k = count; k-- > 0; )
+			if(CPU_ISSET(c, &set[k]))
+				r->home[c] = k;
+	// Take the CPUs from each node in turn.
+	for(size_t i = 0, c = 0; i < norder; c++)
+		for(unsigned k = 0; k < count; k++) {
+			size_t n = 0;
+			for(size_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+				if(!CPU_ISSET(cpu, &set[k]))
+					continue;
+				if(n++ == c) {
+					r->order[i++] = cpu;
+					break;
+				}
+			}
+		}
+	return(r);
+}
+
+void
+replicas_destroy(Replicas *r) {
+	for(unsigned k = 0; k < r->count; k++)
+		freecopy(r->replica[k].tbl);
+	while(r->readers != NULL) {
+		Rreader *rd = r->readers;
+		r->readers = rd->next;
+		free(rd);
+	}
+	pthread_mutex_destroy(&r->lock);
+	free(r->home);
+	free(r->order);
+	free(r);
+}
+
+unsigned
+replicas_nodes(Replicas *r) {
+	return(r->count);
+}
+
+typedef struct Build {
+	pthread_t tid;
+	Replica *rep;
+	Tbl *master, *old;
+	bool started;
+	int err;
+} Build;
+
+// Runs on the replica's CPUs. The builder prefers memory on the node,
+// but if that fails (or the node is emulated) the kernel allocates
+// pages on the node that first touches them, which is usually the
+// same thing. The old copy is left for replicas_publish() to free
+// when no reader can still be using it.
+//
+static void *
+build(void *arg) {
+	Build *b = arg;
+	if(b->rep->node >= 0) {
+		unsigned long mask = 1UL << b->rep->node;
+		(void)syscall(SYS_set_mempolicy, MPOL_PREFERRED,
+			      &mask, sizeof(mask) * 8 + 1);
+	}
+	Tbl *copy = NULL;
+	const char *key = NULL;
+	size_t len = 0;
+	void *val;
+	while(Tnextl(b->master, &key, &len, &val)) {
+		char *k = malloc(len + 1);
+		Tbl *t = NULL;
+		if(k != NULL)
+			t = Tsetl(copy, memcpy(k, key, len + 1), len, val);
+		if(t == NULL) {
+			b->err = errno;
+			free(k);
+			freecopy(copy);
+			return(NULL);
+		}
+		copy = t;
+	}
+	b->old = __atomic_exchange_n(&b->rep->tbl, copy, __ATOMIC_RELEASE);
+	return(NULL);
+}
+
+Rreader *
+replicas_reader(Replicas *r) {
+	Rreader *rd = NULL;
+	errno = posix_memalign((void **)&rd, LINE, sizeof(*rd));
+	if(errno != 0)
+		return(NULL);
+	rd->epoch = 0;
+	rd->home = &r->replica[0];
+	rd->replicas = r;
+	pthread_mutex_lock(&r->lock);
+	rd->next = r->readers;
+	r->readers = rd;
+	pthread_mutex_unlock(&r->lock);
+	return(rd);
+}
+
+void
+replicas_reader_free(Rreader *rd) {
+	Replicas *r = rd->replicas;
+	pthread_mutex_lock(&r->lock);
+	for(Rreader **p = &r->readers; *p != NULL; p = &(*p)->next) {
+		if(*p == rd) {
+			*p = rd->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+	free(rd);
+}
+
+// The reader's epoch must be visible to the publisher before the reader
+// loads a copy, and the new copies must be visible to readers before
+// the publisher looks at their epochs, hence the fences here and in
+// synchronize(), which leave only an acquire load in replicas_get().
+//
+void
+replicas_enter(Rreader *rd) {
+	Replicas *r = rd->replicas;
+	int cpu = sched_getcpu();
+	unsigned k = cpu < 0 || (size_t)cpu >= r->ncpus ? 0 : r->home[cpu];
+	rd->home = &r->replica[k];
+	uint64_t epoch = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&rd->epoch, epoch, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void
+replicas_leave(Rreader *rd) {
+	__atomic_store_n(&rd->epoch, 0, __ATOMIC_RELEASE);
+}
+
+// After the new copies have been published, wait for every reader that
+// might be using an old copy to finish.
+//
+static void
+synchronize(Replicas *r) {
+	uint64_t epoch = __atomic_add_fetch(&r->epoch, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for(Rreader *rd = r->readers; rd != NULL; rd = rd->next) {
+		for(;;) {
+			uint64_t e = __atomic_load_n(&rd->epoch, __ATOMIC_ACQUIRE);
+			if(e == 0 || e >= epoch)
+				break;
+			sched_yield();
+		}
+	}
+}
+
+bool
+replicas_publish(Replicas *r, Tbl *master) {
+	Build *b = calloc(r->count, sizeof(*b));
+	if(b == NULL)
+		return(false);
+	for(unsigned k = 0; k < r->count; k++) {
+		b[k].rep = &r->replica[k];
+		b[k].master = master;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setaffinity_np(&attr, sizeof(b[k].rep->cpus),
+					    &b[k].rep->cpus);
+		int err = pthread_create(&b[k].tid, &attr, build, &b[k]);
+		pthread_attr_destroy(&attr);
+		if(err == 0)
+			b[k].started = true;
+		else
+			b[k].err = err;
+	}
+	int err = 0;
+	for(unsigned k = 0; k < r->count; k++) {
+		if(b[k].started)
+			pthread_join(b[k].tid, NULL);
+		if(err == 0)
+			err = b[k].err;
+	}
+	pthread_mutex_lock(&r->lock);
+	synchronize(r);
+	pthread_mutex_unlock(&r->lock);
+	for(unsigned k = 0; k < r->count; k++)
+		freecopy(b[k].old);
+	free(b);
+	errno = err;
+	return(err == 0);
+}
+
+bool
+replicas_get(Rreader *rd, const char *key, size_t len, void **pval) {
+	Tbl *tbl = __atomic_load_n(&rd->home->tbl, __ATOMIC_ACQUIRE);
+	const char *rkey;
+	return(Tgetkv(tbl, key, len, &rkey, pval));
+}
+
+bool
+replicas_pin(Replicas *r, size_t i) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(r->order[i % r->norder], &set);
+	errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	return(errno == 0);
+}
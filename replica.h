@@ -0,0 +1,64 @@
+// replica.h: a read-mostly table copied to each NUMA node
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// On a machine with several NUMA nodes, a lookup in a table that lives
+// on another node pays the remote memory latency at every level of the
+// trie. Instead, a table that changes rarely can be copied to each node,
+// and each reader searches the copy on the node it is running on.
+//
+// Changes are made to a master table, which can be any Tbl.h table,
+// and then published, which rebuilds every node's copy from it. Each
+// copy is built by a thread pinned to the node's CPUs, with a memory
+// policy that prefers the node, so its branches, leaves, and keys are
+// allocated locally. Readers search the copies without locking; a
+// publisher replaces each copy and then frees the old one after every
+// reader that might be using it has finished, as in cache.h.
+//
+// The node topology comes from /sys/devices/system/node. For testing
+// on a machine without NUMA, the CPUs can instead be divided into a
+// given number of emulated nodes, which are pinned but not allocated
+// differently.
+//
+// The values are borrowed, as in Tbl.h, but the copies have their own
+// keys. The functions that can fail return false or NULL and set errno.
+
+typedef struct Replicas Replicas;
+typedef struct Rreader Rreader;
+
+// With nodes == 0, use the real NUMA nodes.
+//
+Replicas *replicas_create(unsigned nodes);
+
+// Frees the copies and reader handles, but not the master table or
+// the values.
+//
+void replicas_destroy(Replicas *replicas);
+
+unsigned replicas_nodes(Replicas *replicas);
+
+// Rebuild every node's copy from the master table, which must not
+// change until this returns. Waits for readers to leave the old copies.
+//
+bool replicas_publish(Replicas *replicas, Tbl *master);
+
+// Each reader thread needs its own handle, which the publisher uses to
+// find out when the reader has finished with the old copies.
+//
+Rreader *replicas_reader(Replicas *replicas);
+void replicas_reader_free(Rreader *reader);
+
+// Searches must be made between replicas_enter() and replicas_leave(),
+// which a publisher waits for, so a reader should leave now and then.
+// A search looks in the copy on the node where the caller entered.
+//
+void replicas_enter(Rreader *reader);
+void replicas_leave(Rreader *reader);
+bool replicas_get(Rreader *reader, const char *key, size_t len, void **pval);
+
+// Pin the calling thread to the i'th CPU, in an order that takes one
+// CPU from each node in turn, so that threads are spread across nodes.
+//
+bool replicas_pin(Replicas *replicas, size_t i);
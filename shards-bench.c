@@ -0,0 +1,203 @@
+// shards-bench.c: write scaling of a sharded table.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Each thread makes random changes and lookups. We run with 1, 2, 4,
+// ... threads up to the maximum, first with a single shard, which is
+// the same as one table with a global lock, then with the requested
+// number of shards. The table starts with the even-numbered lines of
+// the input, which are the only ones that lookups search for, and the
+// changes can insert the odd-numbered lines. After each round we check
+// that a cursor visits the keys in order, and remove the odd lines.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "shards.h"
+#include "util.h"
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s [-o] [-u <percent>] <seed> <count> <input> <threads> <bits>\n"
+"	The seed must be at least 12 characters.\n"
+"	Each thread makes <count> operations, of which <percent>\n"
+"	(default 100) are changes and the rest are lookups.\n"
+"	The number of threads doubles up to <threads>, first with\n"
+"	one shard and then with 2^<bits> shards.\n"
+"	-o	route keys by their leading bits, not by hash\n"
+		, progname);
+	exit(1);
+}
+
+static Shards *shards;
+static char **line;
+static size_t lines, N;
+static unsigned update = 100;
+
+// Each thread's counters are in their own cache line.
+//
+typedef struct Thread {
+	pthread_t tid;
+	uint64_t rng;
+	size_t lookups, found;
+	double secs;
+} __attribute__((aligned(64))) Thread;
+
+static void *
+run_thread(void *arg) {
+	Thread *r = arg;
+	double t0 = now_sec();
+	for(size_t i = 0; i < N; i++) {
+		size_t l = xorshift(&r->rng) % lines;
+		if(xorshift(&r->rng) % 100 < update) {
+			void *val = xorshift(&r->rng) % 2
+				? (void *)line : (void *)r;
+			if(!shards_setl(shards, line[l], strlen(line[l]), val))
+				die("shards_setl");
+		} else {
+			const char *key = line[l & ~(size_t)1], *rkey;
+			void *rval;
+			r->lookups++;
+			r->found += shards_getkv(shards, key, strlen(key),
+						 &rkey, &rval);
+		}
+	}
+	r->secs = now_sec() - t0;
+	return(NULL);
+}
+
+static int
+bystr(const void *a, const void *b) {
+	return(strcmp(*(char *const *)a, *(char *const *)b));
+}
+
+// Check that the cursor returns the keys in order, then remove the
+// odd-numbered lines. Returns the number of keys.
+//
+static size_t
+check(char **sorted) {
+	Scursor *c = shards_cursor(shards);
+	if(c == NULL) die("shards_cursor");
+	const char *key;
+	size_t len, n = 0;
+	void *val;
+	while(shards_nextl(c, &key, &len, &val)) {
+		while(n < lines && strcmp(sorted[n], key) < 0)
+			n++;
+		if(n == lines || strcmp(sorted[n], key) != 0) {
+			fprintf(stderr, "%s: cursor out of order at %s\n",
+				progname, key);
+			exit(1);
+		}
+		n++;
+	}
+	shards_cursor_free(c);
+	size_t keys = 0;
+	for(size_t l = 0; l < lines; l++) {
+		const char *rkey;
+		if(l % 2 == 0)
+			keys += shards_getkv(shards, line[l], strlen(line[l]),
+					     &rkey, &val);
+		else
+			shards_delkv(shards, line[l], strlen(line[l]),
+				     &rkey, &val);
+	}
+	return(keys);
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	bool ordered = false;
+	for(;;) {
+		if(argc > 1 && strcmp(argv[1], "-o") == 0) {
+			ordered = true;
+			argv++;
+			argc--;
+		} else if(argc > 2 && strcmp(argv[1], "-u") == 0) {
+			update = (unsigned)atoi(argv[2]);
+			if(update > 100) usage();
+			argv += 2;
+			argc -= 2;
+		} else {
+			break;
+		}
+	}
+	if(argc != 6 || argv[1][0] == '-') usage();
+	if(ssrandom(argv[1]) < 0) usage();
+	N = (size_t)atoi(argv[2]);
+	size_t T = (size_t)atoi(argv[4]);
+	unsigned bits = (unsigned)atoi(argv[5]);
+	if(T < 1) usage();
+
+	char *fbuf;
+	line = read_lines(argv[3], &lines, &fbuf);
+	if(lines == 0) usage();
+	char **sorted = calloc(lines, sizeof(*sorted));
+	if(sorted == NULL) die("calloc");
+	memcpy(sorted, line, lines * sizeof(*line));
+	qsort(sorted, lines, sizeof(*sorted), bystr);
+	printf("- got %zu lines\n", lines);
+
+	Thread *thread = NULL;
+	errno = posix_memalign((void **)&thread, 64, T * sizeof(*thread));
+	if(errno != 0) die("posix_memalign");
+
+	for(unsigned b = 0;; b = bits) {
+		shards = shards_create(b, ordered);
+		if(shards == NULL) die("shards_create");
+		for(size_t l = 0; l < lines; l += 2)
+			if(!shards_setl(shards, line[l], strlen(line[l]), line))
+				die("shards_setl");
+		for(size_t n = 1;; n = n * 2 < T ? n * 2 : T) {
+			for(size_t i = 0; i < n; i++) {
+				memset(&thread[i], 0, sizeof(thread[i]));
+				thread[i].rng = (uint64_t)random() << 32 |
+						(uint64_t)random() | 1;
+			}
+			double t0 = now_sec();
+			for(size_t i = 0; i < n; i++) {
+				errno = pthread_create(&thread[i].tid, NULL,
+						       run_thread, &thread[i]);
+				if(errno != 0) die("pthread_create");
+			}
+			for(size_t i = 0; i < n; i++)
+				pthread_join(thread[i].tid, NULL);
+			double secs = now_sec() - t0;
+			printf("shards %u threads %zu: %.3f Mops/s in %.3f s\n",
+			       1U << b, n, (double)(n * N) / secs / 1e6, secs);
+			for(size_t i = 0; i < n; i++) {
+				if(thread[i].found == thread[i].lookups)
+					continue;
+				fprintf(stderr, "%s: thread %zu found %zu/%zu\n",
+					progname, i, thread[i].found,
+					thread[i].lookups);
+				exit(1);
+			}
+			if(check(sorted) != (lines + 1) / 2) {
+				fprintf(stderr, "%s: lost keys\n", progname);
+				exit(1);
+			}
+			if(n == T)
+				break;
+		}
+		shards_destroy(shards);
+		if(b == bits)
+			break;
+	}
+
+	free(thread);
+	free(sorted);
+	free(line);
+	free(fbuf);
+	return(0);
+}
@@ -0,0 +1,204 @@
+// shards.c: a table divided into independently locked shards
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/random.h>
+
+#include "Tbl.h"
+#include "shards.h"
+#include "util.h"
+
+extern int
+siphash(uint8_t *out, const uint8_t *in, uint64_t inlen, const uint8_t *k);
+
+// Ordered routing uses the first two bytes of the key.
+//
+#define MAXBITS 16
+
+typedef struct Shard {
+	pthread_rwlock_t lock;
+	Tbl *tbl;
+} __attribute__((aligned(LINE))) Shard;
+
+struct Shards {
+	unsigned bits;
+	bool ordered;
+	uint8_t sipkey[16];
+	Shard shard[];
+};
+
+typedef enum Hstate {
+	START, LIVE, DONE
+} Hstate;
+
+// The next key in each shard.
+//
+typedef struct Shead {
+	const char *key;
+	size_t len;
+	void *val;
+	Hstate state;
+} Shead;
+
+struct Scursor {
+	Shards *shards;
+	size_t first;		// shards before this are DONE
+	Shead head[];
+};
+
+static inline size_t
+count(Shards *s) {
+	return((size_t)1 << s->bits);
+}
+
+static inline Shard *
+shard(Shards *s, const char *key, size_t len) {
+	if(s->ordered) {
+		unsigned w = (len > 0 ? (unsigned)(uint8_t)key[0] << 8 : 0)
+			   | (len > 1 ? (unsigned)(uint8_t)key[1] : 0);
+		return(&s->shard[w >> (MAXBITS - s->bits)]);
+	}
+	uint64_t h;
+	siphash((void *)&h, (const void *)key, len, s->sipkey);
+	return(&s->shard[h & (count(s) - 1)]);
+}
+
+Shards *
+shards_create(unsigned bits, bool ordered) {
+	if(bits > MAXBITS) {
+		errno = EINVAL;
+		return(NULL);
+	}
+	Shards *s = NULL;
+	size_t n = (size_t)1 << bits;
+	errno = posix_memalign((void **)&s, LINE,
+			       sizeof(*s) + n * sizeof(*s->shard));
+	if(errno != 0)
+		return(NULL);
+	s->bits = bits;
+	s->ordered = ordered;
+	if(getentropy(s->sipkey, sizeof(s->sipkey)) < 0)
+		memset(s->sipkey, 0, sizeof(s->sipkey));
+	for(size_t i = 0; i < n; i++) {
+		pthread_rwlock_init(&s->shard[i].lock, NULL);
+		s->shard[i].tbl = NULL;
+	}
+	return(s);
+}
+
+void
+shards_destroy(Shards *s) {
+	for(size_t i = 0; i < count(s); i++) {
+		Tbl *t = s->shard[i].tbl;
+		while(t != NULL) {
+			const char *key = NULL;
+			size_t len = 0;
+			void *val;
+			Tnextl(t, &key, &len, &val);
+			t = Tdell(t, key, len);
+		}
+		pthread_rwlock_destroy(&s->shard[i].lock);
+	}
+	free(s);
+}
+
+bool
+shards_getkv(Shards *s, const char *key, size_t len,
+	     const char **pkey, void **pval) {
+	Shard *sh = shard(s, key, len);
+	pthread_rwlock_rdlock(&sh->lock);
+	bool found = Tgetkv(sh->tbl, key, len, pkey, pval);
+	pthread_rwlock_unlock(&sh->lock);
+	return(found);
+}
+
+bool
+shards_setl(Shards *s, const char *key, size_t len, void *val) {
+	Shard *sh = shard(s, key, len);
+	pthread_rwlock_wrlock(&sh->lock);
+	// Only deleting the last key returns NULL without an error.
+	Tbl *t = Tsetl(sh->tbl, key, len, val);
+	bool ok = t != NULL || val == NULL;
+	if(ok) sh->tbl = t;
+	pthread_rwlock_unlock(&sh->lock);
+	return(ok);
+}
+
+bool
+shards_delkv(Shards *s, const char *key, size_t len,
+	     const char **pkey, void **pval) {
+	Shard *sh = shard(s, key, len);
+	*pkey = NULL;
+	pthread_rwlock_wrlock(&sh->lock);
+	sh->tbl = Tdelkv(sh->tbl, key, len, pkey, pval);
+	pthread_rwlock_unlock(&sh->lock);
+	return(*pkey != NULL);
+}
+
+Scursor *
+shards_cursor(Shards *s) {
+	Scursor *c = calloc(1, sizeof(*c) + count(s) * sizeof(*c->head));
+	if(c == NULL)
+		return(NULL);
+	c->shards = s;
+	return(c);
+}
+
+void
+shards_cursor_free(Scursor *c) {
+	free(c);
+}
+
+static void
+advance(Scursor *c, size_t i) {
+	Shard *sh = &c->shards->shard[i];
+	Shead *h = &c->head[i];
+	pthread_rwlock_rdlock(&sh->lock);
+	bool more = Tnextl(sh->tbl, &h->key, &h->len, &h->val);
+	pthread_rwlock_unlock(&sh->lock);
+	h->state = more ? LIVE : DONE;
+}
+
+// The shards of an ordered table are in key order, so the next key is
+// in the first shard that has any left. Otherwise this is a merge,
+// which looks at every shard's next key; a heap would be quicker when
+// there are many shards.
+//
+bool
+shards_nextl(Scursor *c, const char **pkey, size_t *plen, void **pval) {
+	Shards *s = c->shards;
+	size_t n = count(s), best = n;
+	for(size_t i = c->first; i < n; i++) {
+		Shead *h = &c->head[i];
+		if(h->state == START)
+			advance(c, i);
+		if(h->state == DONE) {
+			if(i == c->first)
+				c->first++;
+			continue;
+		}
+		if(best == n || strcmp(h->key, c->head[best].key) < 0)
+			best = i;
+		if(s->ordered)
+			break;
+	}
+	if(best == n) {
+		*pkey = NULL;
+		*plen = 0;
+		return(false);
+	}
+	*pkey = c->head[best].key;
+	*plen = c->head[best].len;
+	*pval = c->head[best].val;
+	advance(c, best);
+	return(true);
+}
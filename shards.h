@@ -0,0 +1,51 @@
+// shards.h: a table divided into independently locked shards
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// When many threads update one table, a single lock serializes all of
+// them. Instead, the keys can be divided between 2^bits shards, each of
+// which is a separate Tbl.h table with its own read-write lock, so
+// threads only wait for each other when they use the same shard. Any
+// Tbl.h implementation will do.
+//
+// An ordered table routes keys by their leading bits, so the shards
+// divide the key space into consecutive ranges and a walk through
+// them in turn visits the keys in order. But typical keys use few of
+// the possible leading bytes, so the shards are unevenly used. An
+// unordered table routes keys by a keyed hash, which spreads the load
+// evenly, and a walk in key order has to merge the shards.
+//
+// The keys and values are borrowed, as in Tbl.h. The functions that
+// can fail return false and set errno.
+
+typedef struct Shards Shards;
+typedef struct Scursor Scursor;
+
+Shards *shards_create(unsigned bits, bool ordered);
+
+// Frees the tables, but not the keys or values.
+//
+void shards_destroy(Shards *shards);
+
+bool shards_getkv(Shards *shards, const char *key, size_t len,
+		  const char **pkey, void **pval);
+
+// A NULL value deletes the key.
+//
+bool shards_setl(Shards *shards, const char *key, size_t len, void *val);
+
+// Returns false if the key was not found.
+//
+bool shards_delkv(Shards *shards, const char *key, size_t len,
+		  const char **pkey, void **pval);
+
+// A cursor walks through the table in key order, across all the
+// shards. Like Tnextl(), each shard remembers its place by its next
+// key, so that key must not be deleted while the cursor is in use.
+// Returns false when there are no more keys.
+//
+Scursor *shards_cursor(Shards *shards);
+void shards_cursor_free(Scursor *cursor);
+bool shards_nextl(Scursor *cursor, const char **pkey, size_t *plen, void **pval);
@@ -0,0 +1,114 @@
+// stats.c: incremental structural statistics.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/time.h>
+
+#include "Tbl.h"
+#include "util.h"
+
+static void
+fail(const char *what, size_t got, size_t want) {
+	fprintf(stderr, "%s: %s %zu should be %zu\n",
+		progname, what, got, want);
+	exit(1);
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s <budget> <input>\n"
+"	Load the input into a table, then gather statistics about\n"
+"	its structure, visiting about <budget> nodes per step.\n"
+"	The statistics are checked against Tsize() and printed\n"
+"	as JSON.\n"
+		, progname);
+	exit(1);
+}
+
+static double
+now_usec(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return((double)tv.tv_sec * 1e6 + (double)tv.tv_usec);
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	if(argc != 3 || argv[1][0] == '-') usage();
+	size_t budget = (size_t)atoi(argv[1]);
+	if(budget < 1) usage();
+
+	char *fbuf;
+	size_t lines, l;
+	char **line = read_lines(argv[2], &lines, &fbuf);
+
+	// values must be word aligned, so they point to the line array
+	Tbl *t = NULL;
+	for(l = 0; l < lines; l++) {
+		t = Tset(t, line[l], &line[l]);
+		if(t == NULL) die("Tset");
+	}
+
+	// Time each step, to see how long a serving thread is interrupted.
+	Tstats ts;
+	memset(&ts, 0, sizeof(ts));
+	size_t steps = 0;
+	double total = 0, longest = 0;
+	for(bool more = true; more; steps++) {
+		double t0 = now_usec();
+		more = Tstat(t, &ts, budget);
+		double us = now_usec() - t0;
+		total += us;
+		if(longest < us)
+			longest = us;
+	}
+	if(!ts.complete) die("Tstat");
+	printf("- %zu steps, mean %.1f us, max %.1f us\n",
+	       steps, total / (double)steps, longest);
+
+	const char *type;
+	size_t size, depth, branches, leaves;
+	Tsize(t, &type, &size, &depth, &branches, &leaves);
+	if(ts.leaves != leaves)
+		fail("leaves", ts.leaves, leaves);
+	if(ts.branches != branches)
+		fail("branches", ts.branches, branches);
+	if(ts.twigs != branches + leaves - ts.roots)
+		fail("twigs", ts.twigs, branches + leaves - ts.roots);
+	size_t sum = 0;
+	for(size_t i = 0; i < TSTAT_DEPTH; i++)
+		sum += i * ts.depth[i];
+	if(ts.depth[TSTAT_DEPTH - 1] == 0 && sum != depth)
+		fail("total depth", sum, depth);
+
+	size_t need = Tstatjson(&ts, NULL, 0);
+	char *json = malloc(need + 1);
+	if(json == NULL) die("malloc");
+	if(Tstatjson(&ts, json, need + 1) != need)
+		fail("JSON length", Tstatjson(&ts, json, need + 1), need);
+	puts(json);
+
+	// The walk still finishes if the table changes as it goes.
+	memset(&ts, 0, sizeof(ts));
+	for(l = 0; Tstat(t, &ts, budget); l++)
+		if(l < lines)
+			t = Tset(t, line[l], NULL);
+	if(!ts.complete) die("Tstat");
+
+	for(l = 0; l < lines; l++)
+		t = Tset(t, line[l], NULL);
+	free(json);
+	free(line);
+	free(fbuf);
+	return(0);
+}
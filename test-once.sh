@@ -13,4 +13,4 @@ done
 for i in "$@"
 do cmp test-out-pl test-out-$i
 done
-rm -f test-in test-out-??
+rm -f test-in test-out-?? test-out-???
@@ -9,21 +9,16 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "Tbl.h"
+#include "util.h"
 
-static const char *progname;
 static bool debug = false;
 
-static void
-die(const char *cause) {
-	fprintf(stderr, "%s: %s: %s\n", progname, cause, strerror(errno));
-	exit(1);
-}
-
 static void
 usage(void) {
 	fprintf(stderr,
@@ -42,6 +37,185 @@ trace(Tbl *t, int s, const char *key) {
 	}
 }
 
+#ifdef WITH_TRANSACTIONS
+
+// In the transaction variant of the test harness, changes are made in
+// copy-on-write transactions of a few changes each, so that they copy
+// shared twigs and modify private ones. Before each commit we check that
+// the original table still has the right number of keys, so keys that
+// are deleted during a transaction are not freed until it commits.
+
+#define BATCH 7
+
+static Ttxn *txn;
+static size_t changes, before, after;
+static size_t ndeleted;
+static char *deleted[BATCH];
+
+static size_t
+count(Tbl *t) {
+	const char *key = NULL;
+	void *val = NULL;
+	size_t n = 0;
+	while(Tnext(t, &key, &val))
+		n++;
+	return(n);
+}
+
+static void *
+tget(Tbl *t, const char *key) {
+	const char *rkey = NULL;
+	void *rval = NULL;
+	if(txn == NULL)
+		return(Tget(t, key));
+	Txgetkv(txn, key, strlen(key), &rkey, &rval);
+	return(rval);
+}
+
+static Tbl *
+tcommit(Tbl *t) {
+	if(txn == NULL)
+		return(t);
+	if(count(t) != before) {
+		fprintf(stderr, "%s: transaction changed the original table\n",
+			progname);
+		exit(1);
+	}
+	t = Tcommit(txn);
+	Treclaim(txn);
+	txn = NULL;
+	before = after;
+	changes = 0;
+	while(ndeleted > 0)
+		free(deleted[--ndeleted]);
+	return(t);
+}
+
+static Tbl *
+tchange(Tbl *t) {
+	if(++changes < BATCH)
+		return(t);
+	return(tcommit(t));
+}
+
+static Tbl *
+tsetl(Tbl *t, const char *key, size_t len, void *val) {
+	if(tget(t, key) == NULL)
+		after++;
+	if(txn == NULL && (txn = Tbegin(t)) == NULL)
+		return(NULL);
+	if(!Txsetl(txn, key, len, val))
+		return(NULL);
+	return(tchange(t));
+}
+
+static Tbl *
+tdelkv(Tbl *t, const char *key, size_t len, const char **rkey, void **rval) {
+	if(txn == NULL && (txn = Tbegin(t)) == NULL)
+		return(NULL);
+	if(!Txdelkv(txn, key, len, rkey, rval))
+		return(NULL);
+	if(*rkey != NULL)
+		after--;
+	return(tchange(t));
+}
+
+static void
+tfree(const char *key) {
+	if(txn == NULL)
+		free((char *)key);
+	else if(key != NULL)
+		deleted[ndeleted++] = (char *)key;
+}
+
+#elif defined(WITH_SNAPSHOTS)
+
+// In the snapshot variant of the test harness, we take a snapshot of
+// the table every few changes, and check that it still has the same
+// number of keys when we release it, so the changes since then must
+// have copied any twigs they shared with it. Deleted keys are not
+// freed until the snapshot that might contain them is released.
+
+#define BATCH 7
+
+static Tbl *snap;
+static size_t changes, keys;
+static size_t ndeleted;
+static char *deleted[BATCH];
+
+static size_t
+count(Tbl *t) {
+	const char *key = NULL;
+	void *val = NULL;
+	size_t n = 0;
+	while(Tnext(t, &key, &val))
+		n++;
+	return(n);
+}
+
+#define tget(t, key) Tget(t, key)
+
+static Tbl *
+tcommit(Tbl *t) {
+	if(count(snap) != keys) {
+		fprintf(stderr, "%s: snapshot changed with the table\n",
+			progname);
+		exit(1);
+	}
+	Trelease(snap);
+	snap = NULL;
+	changes = 0;
+	while(ndeleted > 0)
+		free(deleted[--ndeleted]);
+	return(t);
+}
+
+static Tbl *
+tchange(Tbl *t) {
+	if(++changes < BATCH)
+		return(t);
+	t = tcommit(t);
+	snap = Tsnapshot(t);
+	if(snap == NULL && t != NULL)
+		die("Tsnapshot");
+	keys = count(snap);
+	return(t);
+}
+
+static Tbl *
+tsetl(Tbl *t, const char *key, size_t len, void *val) {
+	t = Tsetl(t, key, len, val);
+	if(t == NULL)
+		return(NULL);
+	return(tchange(t));
+}
+
+static Tbl *
+tdelkv(Tbl *t, const char *key, size_t len, const char **rkey, void **rval) {
+	t = Tdelkv(t, key, len, rkey, rval);
+	if(t == NULL && errno != 0)
+		return(NULL);
+	return(tchange(t));
+}
+
+static void
+tfree(const char *key) {
+	if(snap == NULL)
+		free((char *)key);
+	else if(key != NULL)
+		deleted[ndeleted++] = (char *)key;
+}
+
+#else
+
+#define tget(t, key) Tget(t, key)
+#define tsetl(t, key, len, val) Tsetl(t, key, len, val)
+#define tdelkv(t, key, len, rkey, rval) Tdelkv(t, key, len, rkey, rval)
+#define tcommit(t) (t)
+#define tfree(key) free((char *)key)
+
+#endif
+
 int
 main(int argc, char *argv[]) {
 	progname = argv[0];
@@ -73,16 +247,16 @@ main(int argc, char *argv[]) {
 		default:
 			usage();
 		case('*'):
-			if(Tget(t, key))
+			if(tget(t, key))
 				putchar('*');
 			else
 				putchar('=');
 			continue;
 		case('+'):
 			errno = 0;
-			void *val = Tget(t, key);
-			t = Tsetl(t, key, len, val == NULL ? key : val);
-			if(t == NULL)
+			void *val = tget(t, key);
+			t = tsetl(t, key, len, val == NULL ? key : val);
+			if(t == NULL && errno != 0)
 				die("Tbl");
 			if(!val)
 				trace(t, s, key);
@@ -93,19 +267,20 @@ main(int argc, char *argv[]) {
 			errno = 0;
 			const char *rkey = NULL;
 			void *rval = NULL;
-			t = Tdelkv(t, key, len, &rkey, &rval);
+			t = tdelkv(t, key, len, &rkey, &rval);
 			if(t == NULL && errno != 0)
 				die("Tbl");
 			if(rkey)
 				trace(t, s, key);
 			free(key);
-			free(rkey);
+			tfree(rkey);
 			continue;
 		}
 	}
 	putchar('\n');
 	if(ferror(stdin))
 		die("read");
+	t = tcommit(t);
 	size_t size, depth, branches, leaves;
 	const char *type;
 	Tsize(t, &type, &size, &depth, &branches, &leaves);
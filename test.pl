@@ -5,13 +5,17 @@
 use warnings;
 use strict;
 
+# with -i, keys are ASCII case-insensitive and keep their first spelling
+my $fold = @ARGV && $ARGV[0] eq '-i' && shift;
+
 my %t;
 
 while(<>) {
 	m{^([-+*])(.*)$}s or die "bad input line";
-	delete $t{$2} if $1 eq '-';
-	$t{$2} = 1 if $1 eq '+';
-	print $t{$2} ? "*" : "=" if $1 eq '*';
+	my $k = $fold ? lc $2 : $2;
+	delete $t{$k} if $1 eq '-';
+	$t{$k} //= $2 if $1 eq '+';
+	print $t{$k} ? "*" : "=" if $1 eq '*';
 }
 print "\n";
-print for sort keys %t;
+print $t{$_} for sort keys %t;
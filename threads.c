@@ -0,0 +1,341 @@
+// threads.c: multi-threaded read scaling benchmark.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Each reader thread searches a shared table for random keys. We run
+// the readers with 1, 2, 4, ... threads up to the maximum, to see how
+// well lookups scale when the threads share the caches and memory.
+//
+// With the -w option, a writer thread changes the table while the
+// readers are running. Normally the readers and writer are serialized
+// by a read-write lock. When compiled WITH_TRANSACTIONS the writer
+// makes its changes in copy-on-write transactions, and the readers do
+// not lock; the writer waits until every reader has passed a quiescent
+// state before it frees the memory that a transaction replaced.
+//
+// With the -u option, every thread makes changes as well as lookups,
+// to see how well updates scale. Normally the threads are serialized
+// by the read-write lock. When compiled WITH_CONCURRENCY for a table
+// that supports concurrent updates, the threads do not lock, and the
+// replaced memory is collected after each round.
+//
+// When compiled WITH_SEQLOCK for a table that supports optimistic
+// readers, lookups do not lock, and changes still take the write lock
+// so that only one thread at a time makes them. The replaced memory is
+// collected after each round.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "Tbl.h"
+#include "util.h"
+
+// Changes per transaction
+//
+#define BATCH 64
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s [-w] [-u <percent>] [-p <stride>] <seed> <count> <input> <threads>\n"
+"	The seed must be at least 12 characters.\n"
+"	Each reader thread searches for <count> random keys.\n"
+"	The number of readers doubles up to <threads>.\n"
+"	-w		run a writer thread as well as the readers\n"
+"	-u <percent>	each thread's operations include this many\n"
+"			percent updates, half of them inserts\n"
+"	-p <stride>	pin thread i to CPU i * stride\n"
+		, progname);
+	exit(1);
+}
+
+static Tbl *tbl;
+static char **line;
+static size_t lines, N;
+static bool writing, locking;
+static unsigned update;
+static int stride = -1;
+static long cpus;
+
+#if !defined(WITH_TRANSACTIONS) && !defined(WITH_CONCURRENCY)
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+#endif
+
+// Each thread's counters are in their own cache line.
+//
+typedef struct Thread {
+	pthread_t tid;
+	size_t id;
+	uint64_t rng;
+	size_t found;
+	size_t updates;
+	uint64_t quiescent;	// bumped by readers after each search
+	bool finished;
+	double secs;
+} __attribute__((aligned(64))) Thread;
+
+static Thread *reader;
+static size_t readers;
+
+static void
+pin(size_t id) {
+	if(stride < 0)
+		return;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET((size_t)stride * id % (size_t)cpus, &set);
+	errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if(errno != 0) die("pthread_setaffinity_np");
+}
+
+// In update mode the table starts with the even-numbered lines, which
+// are the only ones that lookups search for, and updates can insert
+// the odd-numbered lines as well as changing the even ones.
+//
+static const char *
+read_key(uint64_t *rng) {
+	size_t l = xorshift(rng) % lines;
+	return(line[update ? l & ~(size_t)1 : l]);
+}
+
+#ifndef WITH_TRANSACTIONS
+
+static void
+set_key(uint64_t *rng) {
+	const char *key = line[xorshift(rng) % lines];
+	void *val = xorshift(rng) % 2 ? (void *)line : (void *)reader;
+#ifdef WITH_CONCURRENCY
+	if(Tset(tbl, key, val) == NULL) die("Tset");
+#elif defined(WITH_SEQLOCK)
+	// The table pointer does not change, and readers load it
+	// without locking, so leave it alone.
+	pthread_rwlock_wrlock(&lock);
+	Tbl *t = Tset(tbl, key, val);
+	pthread_rwlock_unlock(&lock);
+	if(t == NULL) die("Tset");
+#else
+	pthread_rwlock_wrlock(&lock);
+	tbl = Tset(tbl, key, val);
+	pthread_rwlock_unlock(&lock);
+	if(tbl == NULL) die("Tset");
+#endif
+}
+
+#endif
+
+static void *
+read_thread(void *arg) {
+	Thread *r = arg;
+	pin(r->id);
+	double t0 = now_sec();
+	for(size_t i = 0; i < N; i++) {
+#ifndef WITH_TRANSACTIONS
+		if(update && xorshift(&r->rng) % 100 < update) {
+			set_key(&r->rng);
+			r->updates++;
+			continue;
+		}
+#endif
+		const char *key = read_key(&r->rng);
+#ifdef WITH_TRANSACTIONS
+		// Sequentially consistent, so the next search's load of
+		// tbl cannot overtake this store, and the writer cannot
+		// see it before a search that uses the old table.
+		Tbl *t = __atomic_load_n(&tbl, __ATOMIC_SEQ_CST);
+		r->found += Tget(t, key) != NULL;
+		__atomic_store_n(&r->quiescent, i + 1, __ATOMIC_SEQ_CST);
+#elif defined(WITH_CONCURRENCY) || defined(WITH_SEQLOCK)
+		r->found += Tget(tbl, key) != NULL;
+#else
+		if(locking)
+			pthread_rwlock_rdlock(&lock);
+		r->found += Tget(tbl, key) != NULL;
+		if(locking)
+			pthread_rwlock_unlock(&lock);
+#endif
+	}
+	r->secs = now_sec() - t0;
+	__atomic_store_n(&r->finished, true, __ATOMIC_RELEASE);
+	return(NULL);
+}
+
+static bool
+readers_finished(void) {
+	for(size_t i = 0; i < readers; i++)
+		if(!__atomic_load_n(&reader[i].finished, __ATOMIC_ACQUIRE))
+			return(false);
+	return(true);
+}
+
+#ifdef WITH_TRANSACTIONS
+
+// Wait until each reader has finished a search since we published a
+// new version of the table, so none of them can still be using memory
+// from the old version. The loads are sequentially consistent, like
+// the store that published the new version, so they cannot be
+// reordered before it.
+//
+static void
+synchronize(uint64_t *seen) {
+	for(size_t i = 0; i < readers; i++)
+		seen[i] = __atomic_load_n(&reader[i].quiescent,
+					  __ATOMIC_SEQ_CST);
+	for(size_t i = 0; i < readers; i++)
+		while(!__atomic_load_n(&reader[i].finished, __ATOMIC_ACQUIRE) &&
+		      __atomic_load_n(&reader[i].quiescent,
+				      __ATOMIC_SEQ_CST) == seen[i])
+			sched_yield();
+}
+
+#endif
+
+static void *
+write_thread(void *arg) {
+	Thread *w = arg;
+	pin(w->id);
+	double t0 = now_sec();
+#ifdef WITH_TRANSACTIONS
+	uint64_t *seen = calloc(readers, sizeof(*seen));
+	if(seen == NULL) die("calloc");
+#endif
+	while(!readers_finished()) {
+#ifdef WITH_TRANSACTIONS
+		Ttxn *txn = Tbegin(tbl);
+		if(txn == NULL) die("Tbegin");
+		for(size_t i = 0; i < BATCH; i++) {
+			const char *key = line[xorshift(&w->rng) % lines];
+			void *val = xorshift(&w->rng) % 2
+				? (void *)line : (void *)reader;
+			if(!Txsetl(txn, key, strlen(key), val))
+				die("Txsetl");
+		}
+		__atomic_store_n(&tbl, Tcommit(txn), __ATOMIC_SEQ_CST);
+		synchronize(seen);
+		Treclaim(txn);
+		w->found += BATCH;
+#else
+		set_key(&w->rng);
+		w->found += 1;
+#endif
+	}
+#ifdef WITH_TRANSACTIONS
+	free(seen);
+#endif
+	w->secs = now_sec() - t0;
+	return(NULL);
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	for(;;) {
+		if(argc > 1 && strcmp(argv[1], "-w") == 0) {
+			writing = true;
+			argv++;
+			argc--;
+#ifndef WITH_TRANSACTIONS
+		} else if(argc > 2 && strcmp(argv[1], "-u") == 0) {
+			update = (unsigned)atoi(argv[2]);
+			if(update > 100) usage();
+			argv += 2;
+			argc -= 2;
+#endif
+		} else if(argc > 2 && strcmp(argv[1], "-p") == 0) {
+			stride = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+		} else {
+			break;
+		}
+	}
+	if(argc != 5 || argv[1][0] == '-') usage();
+	locking = writing || update;
+	if(ssrandom(argv[1]) < 0) usage();
+	N = (size_t)atoi(argv[2]);
+	size_t T = (size_t)atoi(argv[4]);
+	if(T < 1) usage();
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if(cpus < 1) cpus = 1;
+
+	char *fbuf;
+	line = read_lines(argv[3], &lines, &fbuf);
+	size_t l;
+	printf("- got %zu lines, %ld cpus\n", lines, cpus);
+
+	for(l = 0; l < lines; l += update ? 2 : 1) {
+		tbl = Tset(tbl, line[l], line);
+		if(tbl == NULL) die("Tset");
+	}
+
+	errno = posix_memalign((void **)&reader, 64, (T + 1) * sizeof(*reader));
+	if(errno != 0) die("posix_memalign");
+	for(readers = 1;; readers = readers * 2 < T ? readers * 2 : T) {
+		for(size_t i = 0; i <= readers; i++) {
+			memset(&reader[i], 0, sizeof(reader[i]));
+			reader[i].id = i;
+			reader[i].rng = (uint64_t)random() << 32 |
+					(uint64_t)random() | 1;
+		}
+		Thread *w = &reader[readers];
+		double t0 = now_sec();
+		for(size_t i = 0; i < readers; i++) {
+			errno = pthread_create(&reader[i].tid, NULL,
+					       read_thread, &reader[i]);
+			if(errno != 0) die("pthread_create");
+		}
+		if(writing) {
+			errno = pthread_create(&w->tid, NULL, write_thread, w);
+			if(errno != 0) die("pthread_create");
+		}
+		for(size_t i = 0; i < readers; i++)
+			pthread_join(reader[i].tid, NULL);
+		double secs = now_sec() - t0;
+		if(writing)
+			pthread_join(w->tid, NULL);
+
+		printf("%s %zu: %.3f Mops/s in %.3f s\n",
+		       update ? "threads" : "readers",
+		       readers, (double)(readers * N) / secs / 1e6, secs);
+		printf("- per thread Mops/s");
+		for(size_t i = 0; i < readers; i++) {
+			size_t lookups = N - reader[i].updates;
+			if(reader[i].found != lookups) {
+				fprintf(stderr, "%s: thread %zu found %zu/%zu\n",
+					progname, i, reader[i].found, lookups);
+				exit(1);
+			}
+			printf(" %.3f", (double)N / reader[i].secs / 1e6);
+		}
+		printf("\n");
+		if(writing)
+			printf("- writer %.3f Mops/s\n",
+			       (double)w->found / w->secs / 1e6);
+#if defined(WITH_CONCURRENCY) || defined(WITH_SEQLOCK)
+		Tcollect(tbl);
+#endif
+		// remove the odd-numbered lines that updates inserted
+		for(l = 1; update && l < lines; l += 2)
+			tbl = Tset(tbl, line[l], NULL);
+		if(readers == T)
+			break;
+	}
+
+	for(l = 0; l < lines; l++)
+		tbl = Tset(tbl, line[l], NULL);
+	free(reader);
+	free(line);
+	free(fbuf);
+	return(0);
+}
@@ -0,0 +1,217 @@
+// trace.c: count the cache lines touched by each lookup.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "trace.h"
+#include "util.h"
+
+typedef unsigned int uint;
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s [-o <trace>] <count> <input>\n"
+"	Load the input into a table, then look up <count> keys chosen\n"
+"	at random, tracing the memory that each lookup reads. Prints\n"
+"	the mean number of distinct cache lines of each kind per\n"
+"	lookup, the misses in a simulated L1 and L2 cache, and\n"
+"	histograms of lines and misses against depth.\n"
+"	-o writes every access to a file, as lines of\n"
+"	<kind> <hex address> <length>, where the kind is b (branch),\n"
+"	t (leaf twig), k (leaf key) or s (search key); each lookup\n"
+"	starts with a line containing '='.\n"
+		, progname);
+	exit(1);
+}
+
+static const char kindname[TRACE_KINDS][8] = {
+	"branch", "leaf", "key", "search"
+};
+
+// A set-associative cache with LRU replacement, in which each set
+// is an array of line numbers, most recently used first.
+//
+typedef struct Cache {
+	const char *name;
+	size_t sets, ways;
+	uintptr_t *tag;
+} Cache;
+
+static Cache cache[] = {
+	{ "L1", 64, 8, NULL },		// 32 KiB
+	{ "L2", 1024, 16, NULL },	// 1 MiB
+};
+#define CACHES (sizeof(cache) / sizeof(*cache))
+
+static bool
+cache_hit(Cache *c, uintptr_t line) {
+	uintptr_t *set = c->tag + (line % c->sets) * c->ways;
+	size_t i;
+	for(i = 0; i < c->ways - 1; i++)
+		if(set[i] == line)
+			break;
+	bool hit = set[i] == line;
+	memmove(set + 1, set, i * sizeof(*set));
+	set[0] = line;
+	return(hit);
+}
+
+// The lines touched by the current lookup, with a bitmap of the kinds
+// of memory in each line.
+//
+#define MAXLINES 256
+static struct {
+	uintptr_t line;
+	uint kinds;
+} seen[MAXLINES];
+static size_t nseen;
+
+static size_t depth;
+static size_t lines[TRACE_KINDS];
+static size_t misses[CACHES];
+static FILE *out;
+
+void
+trace(int kind, const void *p, size_t len) {
+	if(kind == TRACE_BRANCH)
+		depth++;
+	if(out != NULL)
+		fprintf(out, "%c %zx %zu\n", "btks"[kind], (size_t)p, len);
+	uintptr_t first = (uintptr_t)p / LINE;
+	uintptr_t last = ((uintptr_t)p + len - 1) / LINE;
+	for(uintptr_t line = first; line <= last; line++) {
+		size_t i;
+		for(i = 0; i < nseen; i++)
+			if(seen[i].line == line)
+				break;
+		if(i == nseen) {
+			if(nseen == MAXLINES)
+				continue;
+			seen[nseen].line = line;
+			seen[nseen].kinds = 0;
+			nseen++;
+			// The lookup only misses the first time it touches
+			// a line, so that is when the caches see it.
+			for(size_t c = 0; c < CACHES; c++)
+				if(!cache_hit(&cache[c], line))
+					misses[c]++;
+		}
+		if(!(seen[i].kinds & (1U << kind))) {
+			seen[i].kinds |= 1U << kind;
+			lines[kind]++;
+		}
+	}
+}
+
+#define MAXDEPTH 32
+#define MAXMISS 16
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	if(argc == 5 && strcmp(argv[1], "-o") == 0) {
+		out = fopen(argv[2], "w");
+		if(out == NULL) die("open");
+		argv += 2;
+		argc -= 2;
+	}
+	if(argc != 3 || argv[1][0] == '-') usage();
+	size_t N = (size_t)atoi(argv[1]);
+	if(N < 1) usage();
+
+	char *fbuf;
+	size_t nlines, l;
+	char **line = read_lines(argv[2], &nlines, &fbuf);
+	if(nlines == 0) usage();
+
+	// values must be word aligned, so they point to the line array
+	Tbl *t = NULL;
+	for(l = 0; l < nlines; l++) {
+		t = Tset(t, line[l], &line[l]);
+		if(t == NULL) die("Tset");
+	}
+
+	for(size_t c = 0; c < CACHES; c++) {
+		cache[c].tag = calloc(cache[c].sets * cache[c].ways,
+				      sizeof(*cache[c].tag));
+		if(cache[c].tag == NULL) die("calloc");
+	}
+
+	// totals over all lookups, and histograms indexed by depth
+	size_t total[TRACE_KINDS] = { 0 }, totmiss[CACHES] = { 0 };
+	size_t distinct = 0, dcount[MAXDEPTH] = { 0 };
+	size_t dlines[MAXDEPTH] = { 0 }, dmiss[MAXDEPTH][CACHES];
+	size_t hist[MAXDEPTH][MAXMISS];
+	memset(dmiss, 0, sizeof(dmiss));
+	memset(hist, 0, sizeof(hist));
+
+	srandom(1);
+	for(size_t n = 0; n < N; n++) {
+		const char *key = line[(size_t)random() % nlines];
+		nseen = depth = 0;
+		memset(lines, 0, sizeof(lines));
+		memset(misses, 0, sizeof(misses));
+		if(out != NULL)
+			fprintf(out, "= %zu\n", n);
+		if(Tget(t, key) == NULL) die("Tget");
+		size_t d = depth < MAXDEPTH ? depth : MAXDEPTH - 1;
+		for(size_t k = 0; k < TRACE_KINDS; k++)
+			total[k] += lines[k];
+		for(size_t c = 0; c < CACHES; c++) {
+			totmiss[c] += misses[c];
+			dmiss[d][c] += misses[c];
+		}
+		distinct += nseen;
+		dcount[d] += 1;
+		dlines[d] += nseen;
+		hist[d][misses[0] < MAXMISS ? misses[0] : MAXMISS - 1] += 1;
+	}
+
+	const char *type;
+	size_t size, tdepth, branches, leaves;
+	Tsize(t, &type, &size, &tdepth, &branches, &leaves);
+	printf("TRACE %s keys %zu lookups %zu line %d bytes\n",
+	       type, leaves, N, LINE);
+	printf("- lines per lookup");
+	for(size_t k = 0; k < TRACE_KINDS; k++)
+		printf(" %s %.2f", kindname[k], (double)total[k] / N);
+	printf(" distinct %.2f\n", (double)distinct / N);
+	printf("- misses per lookup");
+	for(size_t c = 0; c < CACHES; c++)
+		printf(" %s (%zu KiB %zu way) %.2f", cache[c].name,
+		       cache[c].sets * cache[c].ways * LINE / 1024,
+		       cache[c].ways, (double)totmiss[c] / N);
+	printf("\n");
+	for(size_t d = 0; d < MAXDEPTH; d++) {
+		if(dcount[d] == 0)
+			continue;
+		printf("- depth %zu lookups %zu lines %.2f", d, dcount[d],
+		       (double)dlines[d] / dcount[d]);
+		for(size_t c = 0; c < CACHES; c++)
+			printf(" %s %.2f", cache[c].name,
+			       (double)dmiss[d][c] / dcount[d]);
+		printf(" %s misses", cache[0].name);
+		for(size_t m = 0; m < MAXMISS; m++)
+			if(hist[d][m] != 0)
+				printf(" %zu:%zu", m, hist[d][m]);
+		printf("\n");
+	}
+
+	if(out != NULL && fclose(out) != 0) die("write");
+	for(l = 0; l < nlines; l++)
+		t = Tset(t, line[l], NULL);
+	for(size_t c = 0; c < CACHES; c++)
+		free(cache[c].tag);
+	free(line);
+	free(fbuf);
+	return(0);
+}
@@ -0,0 +1,54 @@
+// trace.h: memory access tracing for lookups.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// When an implementation is compiled with -DWITH_TRACE, its Tgetkv()
+// reports each piece of memory that it reads to trace(), which is in
+// trace.c. Otherwise the hooks compile to nothing.
+//
+// The kinds of memory are the branch nodes on the path from the root
+// (each of which is a twig of its parent, except for the root), the
+// leaf twig at the end of the path, and the bytes of the leaf's key
+// and of the search key that are compared. The search key bytes that
+// are read during the descent count as search key bytes too.
+
+#ifndef trace_h
+#define trace_h
+
+enum {
+	TRACE_BRANCH,
+	TRACE_LEAF,
+	TRACE_KEY,
+	TRACE_SEARCH,
+	TRACE_KINDS
+};
+
+#ifdef WITH_TRACE
+
+void trace(int kind, const void *p, size_t len);
+
+// Trace the bytes that strcmp() reads, up to and including the first
+// difference.
+//
+static inline void
+trace_strcmp(const char *key, const char *leaf) {
+	size_t i = 0;
+	while(key[i] != '\0' && key[i] == leaf[i])
+		i++;
+	trace(TRACE_SEARCH, key, i + 1);
+	trace(TRACE_KEY, leaf, i + 1);
+}
+
+#define TRACE(kind, p, len) trace(kind, p, len)
+#define TRACE_STRCMP(key, leaf) trace_strcmp(key, leaf)
+
+#else
+
+#define TRACE(kind, p, len) ((void)0)
+#define TRACE_STRCMP(key, leaf) ((void)0)
+
+#endif
+
+#endif // trace_h
@@ -0,0 +1,90 @@
+// txn.c: transactions made on snapshots
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// This implements the transaction API in Tbl.h for any table that
+// supports Tsnapshot(). A transaction changes a snapshot of the table,
+// so the first change that touches a shared twig array copies it, and
+// later changes in the same transaction find it private and change it
+// in place; the upper branches that every change passes through are
+// only copied once. Tcommit() returns the snapshot, which becomes the
+// current table. Until Treclaim() releases the original table, it keeps
+// the twigs that the transaction replaced, so readers that started
+// before the commit can carry on.
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "Tbl.h"
+
+struct Ttxn {
+	Tbl *tbl, *orig;
+};
+
+Ttxn *
+Tbegin(Tbl *tbl) {
+	Ttxn *txn = malloc(sizeof(*txn));
+	if(txn == NULL)
+		return(NULL);
+	txn->orig = tbl;
+	txn->tbl = Tsnapshot(tbl);
+	if(txn->tbl == NULL && tbl != NULL) {
+		free(txn);
+		return(NULL);
+	}
+	return(txn);
+}
+
+bool
+Txgetkv(Ttxn *txn, const char *key, size_t len, const char **pkey, void **pval) {
+	return(Tgetkv(txn->tbl, key, len, pkey, pval));
+}
+
+bool
+Txdelkv(Ttxn *txn, const char *key, size_t len, const char **pkey, void **pval) {
+	const char *rkey = NULL;
+	void *rval = NULL;
+	Tbl *tbl = Tdelkv(txn->tbl, key, len, &rkey, &rval);
+	// Did we fail to copy the path to the leaf?
+	if(tbl == NULL && rkey == NULL && txn->tbl != NULL)
+		return(false);
+	txn->tbl = tbl;
+	if(rkey != NULL) {
+		*pkey = rkey;
+		*pval = rval;
+	}
+	return(true);
+}
+
+bool
+Txsetl(Ttxn *txn, const char *key, size_t len, void *val) {
+	if(val == NULL) {
+		const char *rkey = NULL;
+		void *rval = NULL;
+		return(Txdelkv(txn, key, len, &rkey, &rval));
+	}
+	Tbl *tbl = Tsetl(txn->tbl, key, len, val);
+	if(tbl == NULL)
+		return(false);
+	txn->tbl = tbl;
+	return(true);
+}
+
+Tbl *
+Tcommit(Ttxn *txn) {
+	return(txn->tbl);
+}
+
+void
+Tabort(Ttxn *txn) {
+	Trelease(txn->tbl);
+	free(txn);
+}
+
+void
+Treclaim(Ttxn *txn) {
+	Trelease(txn->orig);
+	free(txn);
+}
@@ -0,0 +1,83 @@
+// util.c: helpers shared by the benchmark programs
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "util.h"
+
+const char *progname;
+
+void
+die(const char *cause) {
+	fprintf(stderr, "%s: %s: %s\n", progname, cause, strerror(errno));
+	exit(1);
+}
+
+int
+ssrandom(char *s) {
+	// initialize random(3) from a string
+	size_t len = strlen(s);
+	if(len < 12) return(-1);
+	unsigned seed = s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24;
+	initstate(seed, s+4, len-4);
+	return(0);
+}
+
+double
+now_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((double)ts.tv_sec + (double)ts.tv_nsec / 1e9);
+}
+
+char **
+read_lines(const char *path, size_t *plines, char **pbuf) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) die("open");
+	struct stat st;
+	if(fstat(fd, &st) < 0) die("stat");
+	size_t flen = (size_t)st.st_size;
+	char *fbuf = malloc(flen + 1);
+	if(fbuf == NULL) die("malloc");
+	if(read(fd, fbuf, flen) < 0) die("read");
+	close(fd);
+	fbuf[flen] = '\0';
+
+	size_t lines = 0;
+	for(char *p = fbuf; *p; p++)
+		if(*p == '\n')
+			++lines;
+	// one spare, so that the array is not empty
+	char **line = calloc(lines + 1, sizeof(*line));
+	if(line == NULL) die("calloc");
+	size_t l = 0;
+	bool bol = true;
+	for(char *p = fbuf; *p; p++) {
+		// ignore a last line without a newline
+		if(bol && l < lines) {
+			line[l++] = p;
+			bol = false;
+		}
+		if(*p == '\n') {
+			*p = '\0';
+			bol = true;
+		}
+	}
+	*plines = lines;
+	*pbuf = fbuf;
+	return(line);
+}
@@ -0,0 +1,44 @@
+// util.h: helpers shared by the benchmark programs and modules
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// Include <stdint.h> and <stdlib.h> first. Each program sets progname
+// from argv[0] before it can die().
+
+// Size of a cache line, to keep separately written data apart, or to
+// count the lines that a lookup touches.
+//
+#define LINE 64
+
+extern const char *progname;
+
+// Print the cause with strerror(errno) and exit.
+//
+void die(const char *cause);
+
+// Initialize random(3) from a string of at least 12 characters;
+// returns -1 if it is too short.
+//
+int ssrandom(char *s);
+
+double now_sec(void);
+
+// Read a file into *pbuf and split it into lines in place, with the
+// newlines replaced by NULs. Returns an array of pointers to the lines
+// and their number in *plines. The caller frees the array and *pbuf.
+// Dies on failure.
+//
+char **read_lines(const char *path, size_t *plines, char **pbuf);
+
+// random(3) is not thread-safe, so each thread has its own generator
+//
+static inline uint64_t
+xorshift(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return(*state = x);
+}
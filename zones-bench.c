@@ -0,0 +1,265 @@
+// zones-bench.c: per-zone DNS-tries compared with one big trie.
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/time.h>
+
+#include "Tbl.h"
+#include "zones.h"
+#include "util.h"
+
+static void
+fail(const char *name, const char *what) {
+	fprintf(stderr, "%s: %s: %s\n", progname, name, what);
+	exit(1);
+}
+
+static void
+usage(void) {
+	fprintf(stderr,
+"usage: %s <seed> <count> <input>\n"
+"	The seed must be at least 12 characters.\n"
+"	Each name in the input is put in a zone whose apex is\n"
+"	its parent, and <count> random names are looked up.\n"
+		, progname);
+	exit(1);
+}
+
+static struct timeval tu;
+
+static void
+start(const char *s) {
+	printf("%s... ", s);
+	fflush(stdout);
+	gettimeofday(&tu, NULL);
+}
+
+static void
+done(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	tv.tv_sec -= tu.tv_sec;
+	tv.tv_usec -= tu.tv_usec;
+	if(tv.tv_usec < 0) {
+		tv.tv_sec -= 1;
+		tv.tv_usec += 1000000;
+	}
+	printf("%ld.%06ld s\n",
+	       (long)tv.tv_sec, (long)tv.tv_usec);
+}
+
+// Names with an escaped dot would need more care to find their parent.
+//
+static bool
+usable(const char *name) {
+	size_t len = strlen(name);
+	if(len == 0 || len > 253 || name[len - 1] == '.')
+		return(false);
+	if(strchr(name, '\\') != NULL || strstr(name, "..") != NULL)
+		return(false);
+	return(name[0] != '.');
+}
+
+static const char *
+parent(const char *name) {
+	const char *dot = strchr(name, '.');
+	return(dot == NULL ? "." : dot + 1);
+}
+
+static void
+freetbl(Tbl *tbl) {
+	const char *key = NULL;
+	while(tbl != NULL) {
+		void *val = NULL;
+		key = NULL;
+		Tnext(tbl, &key, &val);
+		tbl = Tdel(tbl, key);
+	}
+}
+
+static void
+biggest(const char *apex, Tbl *tbl, void *ctx) {
+	const char **best = ctx;
+	static size_t max;
+	size_t n = 0;
+	const char *key = NULL;
+	void *val = NULL;
+	while(Tnext(tbl, &key, &val))
+		n++;
+	if(n > max) {
+		max = n;
+		*best = apex;
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+	progname = argv[0];
+	if(argc != 4 || argv[1][0] == '-') usage();
+	if(ssrandom(argv[1]) < 0) usage();
+	size_t N = (size_t)atoi(argv[2]);
+
+	char *fbuf;
+	size_t lines, l;
+	char **line = read_lines(argv[3], &lines, &fbuf);
+	for(size_t i = l = 0; i < lines; i++)
+		if(usable(line[i]))
+			line[l++] = line[i];
+	lines = l;
+	// values must be word aligned, so they point to the line array
+	if(lines == 0) usage();
+
+	// The apexes table is used to check the zone cuts that we find.
+	Zones *zs = zones_create();
+	if(zs == NULL) die("zones_create");
+	Tbl *apexes = NULL;
+	Tbl *big = NULL;
+	start("load");
+	for(l = 0; l < lines; l++) {
+		const char *apex = parent(line[l]);
+		if(Tget(apexes, apex) != NULL)
+			continue;
+		if(!zones_add(zs, apex, NULL)) die("zones_add");
+		apexes = Tset(apexes, apex, &line[l]);
+		if(apexes == NULL) die("Tset");
+	}
+	zones_reclaim(zs);
+	// Sort the names into zone tries before putting the tries in place.
+	Tbl *build = NULL;
+	size_t zones = 0;
+	for(l = 0; l < lines; l++) {
+		const char *apex, *key;
+		void *val;
+		zones_find(zs, line[l], &apex, &key, &val);
+		if(apex == NULL) fail(line[l], "no zone");
+		Tbl *tbl = Tget(build, apex);
+		zones += tbl == NULL;
+		tbl = Tset(tbl, line[l], &line[l]);
+		if(tbl == NULL) die("Tset");
+		build = Tset(build, apex, tbl);
+		if(build == NULL) die("Tset");
+	}
+	while(build != NULL) {
+		const char *apex = NULL;
+		void *val = NULL;
+		Tnext(build, &apex, &val);
+		Tbl *tbl = val;
+		if(!zones_swap(zs, apex, &tbl)) die("zones_swap");
+		build = Tdel(build, apex);
+	}
+	done();
+	printf("- %zu names in %zu zones\n", lines, zones);
+
+	start("big");
+	for(l = 0; l < lines; l++) {
+		big = Tset(big, line[l], &line[l]);
+		if(big == NULL) die("Tset");
+	}
+	done();
+
+	// Every name must be found in the deepest zone that encloses it.
+	for(l = 0; l < lines; l++) {
+		const char *apex, *key;
+		void *val;
+		if(!zones_find(zs, line[l], &apex, &key, &val))
+			fail(line[l], "not found");
+		if(strcmp(*(char **)val, line[l]) != 0)
+			fail(line[l], "wrong value");
+		const char *p = line[l];
+		for(; strcmp(p, apex) != 0; p = parent(p))
+			if(Tget(apexes, p) != NULL || strcmp(p, ".") == 0)
+				fail(line[l], "zone cut missed");
+	}
+
+	// DNS names are case-insensitive, so a query in mixed case must
+	// find the same zone and name.
+	for(l = 0; l < lines; l++) {
+		char mixed[256];
+		size_t len = strlen(line[l]);
+		for(size_t i = 0; i <= len; i++) {
+			char c = line[l][i];
+			mixed[i] = i % 2 && 'a' <= c && c <= 'z'
+				? c - 'a' + 'A' : c;
+		}
+		const char *apex, *mapex, *key;
+		void *val;
+		zones_find(zs, line[l], &apex, &key, &val);
+		if(!zones_find(zs, mixed, &mapex, &key, &val))
+			fail(mixed, "not found");
+		if(mapex != apex)
+			fail(mixed, "wrong zone");
+		if(strcmp(*(char **)val, line[l]) != 0)
+			fail(mixed, "wrong value");
+	}
+
+	size_t found = 0;
+	char **sample = calloc(N, sizeof(*sample));
+	if(sample == NULL) die("calloc");
+	for(size_t i = 0; i < N; i++)
+		sample[i] = line[random() % lines];
+
+	start("zones_find");
+	for(size_t i = 0; i < N; i++) {
+		const char *apex, *key;
+		void *val;
+		found += zones_find(zs, sample[i], &apex, &key, &val);
+	}
+	done();
+
+	start("Tget big");
+	for(size_t i = 0; i < N; i++)
+		found += Tget(big, sample[i]) != NULL;
+	done();
+
+	// Reload the biggest zone, compared with reloading everything.
+	const char *apex = NULL;
+	zones_each(zs, biggest, &apex);
+	char ***zone = calloc(lines, sizeof(*zone));
+	if(zone == NULL) die("calloc");
+	size_t size = 0;
+	for(l = 0; l < lines; l++) {
+		const char *p = Tget(apexes, line[l]) != NULL
+			? line[l] : parent(line[l]);
+		if(strcmp(p, apex) == 0)
+			zone[size++] = &line[l];
+	}
+	Tbl *tbl = NULL;
+	start("reload zone");
+	for(size_t i = 0; i < size; i++) {
+		tbl = Tset(tbl, *zone[i], zone[i]);
+		if(tbl == NULL) die("Tset");
+	}
+	if(!zones_swap(zs, apex, &tbl)) die("zones_swap");
+	freetbl(tbl);
+	done();
+	printf("- %zu names in %s\n", size, apex);
+
+	start("reload big");
+	tbl = NULL;
+	for(l = 0; l < lines; l++) {
+		tbl = Tset(tbl, line[l], &line[l]);
+		if(tbl == NULL) die("Tset");
+	}
+	freetbl(big);
+	big = tbl;
+	done();
+
+	printf("- %zu found\n", found);
+	zones_destroy(zs, freetbl);
+	freetbl(big);
+	freetbl(apexes);
+	free(sample);
+	free(zone);
+	free(line);
+	free(fbuf);
+	return(0);
+}
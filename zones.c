@@ -0,0 +1,252 @@
+// zones.c: per-zone DNS-tries with a zone-cut aware top-level index
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Tbl.h"
+#include "zones.h"
+
+// A domain name in presentation format is at most 253 bytes without the
+// trailing dot, and has at most 127 labels.
+//
+#define MAXNAME 253
+#define MAXLABELS 127
+
+// An index key has a dot before the first label and after every label.
+//
+#define MAXKEY (MAXNAME + 3)
+
+typedef struct Zone {
+	Tbl *tbl;
+	struct Zone *next;	// on the list of removed zones
+	const char *apex;
+	char key[];		// followed by the apex
+} Zone;
+
+struct Zones {
+	Tbl *index;
+	Zone *removed;
+	Ttxn **txn;		// waiting to be reclaimed
+	size_t txns, maxtxns;
+};
+
+// Convert a name to an index key, returning its length, or zero if
+// the name is not valid. ASCII letters are folded to lower case, since
+// DNS names are case-insensitive. Backslash escapes are not changed,
+// but we have to find them so that we do not split a label at an
+// escaped dot.
+//
+static size_t
+name_to_key(const char *name, char key[MAXKEY]) {
+	size_t len = strlen(name);
+	if(len > 0 && name[len - 1] == '.' &&
+	   (len < 2 || name[len - 2] != '\\'))
+		len--;
+	if(len > MAXNAME)
+		return(0);
+	size_t label[MAXLABELS + 1], labels = 0;
+	if(len > 0)
+		label[labels++] = 0;
+	for(size_t i = 0; i < len; i++) {
+		if(name[i] == '\\' && i + 1 < len)
+			i++;
+		else if(name[i] == '.' && labels < MAXLABELS)
+			label[labels++] = i + 1;
+		else if(name[i] == '.')
+			return(0);
+	}
+	label[labels] = len + 1;
+	size_t off = 0;
+	key[off++] = '.';
+	while(labels > 0) {
+		size_t start = label[labels - 1];
+		size_t llen = label[labels] - 1 - start;
+		if(llen == 0)
+			return(0);
+		for(size_t i = start; i < start + llen; i++) {
+			char c = name[i];
+			key[off++] = 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c;
+		}
+		key[off++] = '.';
+		labels--;
+	}
+	key[off] = '\0';
+	return(off);
+}
+
+static Zone *
+index_get(Tbl *index, const char *key, size_t len) {
+	const char *rkey = NULL;
+	void *rval = NULL;
+	if(Tgetkv(index, key, len, &rkey, &rval))
+		return(rval);
+	else
+		return(NULL);
+}
+
+bool
+zones_find(Zones *zs, const char *name,
+	   const char **papex, const char **pname, void **pval) {
+	char key[MAXKEY];
+	size_t len = name_to_key(name, key);
+	*papex = NULL;
+	if(len == 0)
+		return(false);
+	Tbl *index = __atomic_load_n(&zs->index, __ATOMIC_ACQUIRE);
+	const char *rkey = NULL;
+	void *rval = NULL;
+	if(!Tgetprefix(index, key, len, &rkey, &rval))
+		return(false);
+	Zone *z = rval;
+	*papex = z->apex;
+	Tbl *tbl = __atomic_load_n(&z->tbl, __ATOMIC_ACQUIRE);
+	return(Tgetkv(tbl, name, strlen(name), pname, pval));
+}
+
+// Publish a transaction's changes to the index, keeping it to be
+// reclaimed later.
+//
+static bool
+publish(Zones *zs, Ttxn *txn) {
+	if(zs->txns == zs->maxtxns) {
+		size_t max = zs->maxtxns * 2 + 8;
+		Ttxn **txns = realloc(zs->txn, sizeof(*txns) * max);
+		if(txns == NULL) {
+			Tabort(txn);
+			return(false);
+		}
+		zs->txn = txns;
+		zs->maxtxns = max;
+	}
+	zs->txn[zs->txns++] = txn;
+	__atomic_store_n(&zs->index, Tcommit(txn), __ATOMIC_RELEASE);
+	return(true);
+}
+
+bool
+zones_add(Zones *zs, const char *apex, Tbl *tbl) {
+	char key[MAXKEY];
+	size_t len = name_to_key(apex, key);
+	if(len == 0) {
+		errno = EINVAL;
+		return(false);
+	}
+	if(index_get(zs->index, key, len) != NULL) {
+		errno = EEXIST;
+		return(false);
+	}
+	size_t alen = strlen(apex);
+	Zone *z = malloc(sizeof(*z) + len + 1 + alen + 1);
+	if(z == NULL)
+		return(false);
+	z->tbl = tbl;
+	z->next = NULL;
+	memcpy(z->key, key, len + 1);
+	z->apex = memcpy(z->key + len + 1, apex, alen + 1);
+	Ttxn *txn = Tbegin(zs->index);
+	if(txn == NULL) {
+		free(z);
+		return(false);
+	}
+	if(!Txsetl(txn, z->key, len, z)) {
+		Tabort(txn);
+		free(z);
+		return(false);
+	}
+	if(!publish(zs, txn)) {
+		free(z);
+		return(false);
+	}
+	return(true);
+}
+
+bool
+zones_del(Zones *zs, const char *apex, Tbl **ptbl) {
+	char key[MAXKEY];
+	size_t len = name_to_key(apex, key);
+	Zone *z = len == 0 ? NULL : index_get(zs->index, key, len);
+	if(z == NULL) {
+		errno = ENOENT;
+		return(false);
+	}
+	Ttxn *txn = Tbegin(zs->index);
+	if(txn == NULL)
+		return(false);
+	const char *rkey = NULL;
+	void *rval = NULL;
+	if(!Txdelkv(txn, key, len, &rkey, &rval)) {
+		Tabort(txn);
+		return(false);
+	}
+	if(!publish(zs, txn))
+		return(false);
+	*ptbl = z->tbl;
+	z->next = zs->removed;
+	zs->removed = z;
+	return(true);
+}
+
+bool
+zones_swap(Zones *zs, const char *apex, Tbl **ptbl) {
+	char key[MAXKEY];
+	size_t len = name_to_key(apex, key);
+	Zone *z = len == 0 ? NULL : index_get(zs->index, key, len);
+	if(z == NULL) {
+		errno = ENOENT;
+		return(false);
+	}
+	*ptbl = __atomic_exchange_n(&z->tbl, *ptbl, __ATOMIC_ACQ_REL);
+	return(true);
+}
+
+void
+zones_reclaim(Zones *zs) {
+	for(size_t i = 0; i < zs->txns; i++)
+		Treclaim(zs->txn[i]);
+	zs->txns = 0;
+	while(zs->removed != NULL) {
+		Zone *z = zs->removed;
+		zs->removed = z->next;
+		free(z);
+	}
+}
+
+void
+zones_each(Zones *zs, void (*fn)(const char *apex, Tbl *tbl, void *ctx),
+	   void *ctx) {
+	const char *key = NULL;
+	size_t len = 0;
+	void *val = NULL;
+	while(Tnextl(zs->index, &key, &len, &val)) {
+		Zone *z = val;
+		fn(z->apex, z->tbl, ctx);
+	}
+}
+
+Zones *
+zones_create(void) {
+	return(calloc(1, sizeof(Zones)));
+}
+
+void
+zones_destroy(Zones *zs, void (*release)(Tbl *tbl)) {
+	zones_reclaim(zs);
+	while(zs->index != NULL) {
+		const char *key = NULL;
+		void *val = NULL;
+		Tnext(zs->index, &key, &val);
+		Zone *z = val;
+		zs->index = Tdel(zs->index, z->key);
+		if(release != NULL)
+			release(z->tbl);
+		free(z);
+	}
+	free(zs->txn);
+	free(zs);
+}
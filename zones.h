@@ -0,0 +1,71 @@
+// zones.h: per-zone DNS-tries with a zone-cut aware top-level index
+//
+// Written by Tony Finch <dot@dotat.at>
+// You may do anything with this. It has no warranty.
+// <http://creativecommons.org/publicdomain/zero/1.0/>
+
+// An authoritative server can keep all its zones in one big trie, but
+// then reloading a zone means changing shared structure, and the cost
+// of an update depends on the total amount of data.
+//
+// Instead, each zone has its own trie, which belongs to the caller.
+// The zones are found via an index, which is a DNS-trie keyed on each
+// zone's apex with its labels in reverse order (so that a zone's apex is
+// a prefix of every name in the zone) and with a dot after every label
+// (so that prefixes always end at a label boundary). For example, the
+// index key for "www.example.com" is ".com.example.www." and the root
+// zone is ".". A query finds the deepest enclosing zone cut with one
+// longest prefix match in the index, then searches the zone's own trie.
+//
+// Index keys have their ASCII letters folded to lower case, so finding
+// the zone is case-insensitive. The search in the zone's trie is only
+// case-insensitive if the DNS-trie is compiled WITH_CASE_FOLDING (as
+// zones-bench is); otherwise names must be given in lower case.
+//
+// Readers do not lock. Changes to the index are made in copy-on-write
+// transactions and published atomically. A zone's trie can be replaced
+// atomically without touching the index. Writers must be serialized by
+// the caller. Memory that readers might still be using is kept until
+// zones_reclaim(), which (like Treclaim()) must not be called until
+// every reader that started before the change has finished. The caller
+// is also responsible for freeing old zone tries after a grace period.
+
+typedef struct Zones Zones;
+
+Zones *zones_create(void);
+
+// Free the index. The release function (which may be NULL) is called
+// for each zone's trie.
+//
+void zones_destroy(Zones *zones, void (*release)(Tbl *tbl));
+
+// Find the zone that contains a name, and search for the name in that
+// zone. Returns false if the zone or the name is missing. If there is
+// a zone, its apex is returned even if the name is missing.
+//
+bool zones_find(Zones *zones, const char *name,
+		const char **papex, const char **pname, void **pval);
+
+// Add a new zone with the given trie, which may be NULL for an empty
+// zone. Returns false and sets errno to EEXIST if the zone exists.
+//
+bool zones_add(Zones *zones, const char *apex, Tbl *tbl);
+
+// Remove a zone and return its trie. Returns false and sets errno to
+// ENOENT if the zone does not exist.
+//
+bool zones_del(Zones *zones, const char *apex, Tbl **ptbl);
+
+// Replace a zone's trie with *ptbl, and return the old trie in *ptbl.
+// Returns false and sets errno to ENOENT if the zone does not exist.
+//
+bool zones_swap(Zones *zones, const char *apex, Tbl **ptbl);
+
+// Free old versions of the index and removed zones.
+//
+void zones_reclaim(Zones *zones);
+
+// Call a function for each zone's apex and trie, in index order.
+//
+void zones_each(Zones *zones, void (*fn)(const char *apex, Tbl *tbl, void *ctx),
+		void *ctx);